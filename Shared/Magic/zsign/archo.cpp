@@ -12,8 +12,6 @@
 #include "common/json.h"
 #include "signing.h"
 
-static uint64_t execSegLimit = 0;
-
 ZArchO::ZArchO() {
     m_pBase = NULL;
     m_uLength = 0;
@@ -29,89 +27,204 @@ ZArchO::ZArchO() {
     m_pCodeSignSegment = NULL;
     m_pLinkEditSegment = NULL;
     m_uLoadCommandsFreeSpace = 0;
+    m_bHeaderOnly = false;
+    m_uInfoPlistOffset = 0;
+    m_uInfoPlistSize = 0;
+    m_uSignDataSize = 0;
+    m_uExecSegLimit = 0;
+    m_pLayoutOps = NULL;
+}
+
+struct ZArchO::ZLayoutOps {
+    bool (ZArchO::*pfnParseLoadCommands)();
+    void (ZArchO::*pfnGrowCodeSignSpace)(uint32_t uNewLength);
+    bool (ZArchO::*pfnRewriteLoadCommands)(const vector<ZLoadCommandEdit> &arrEdits, bool &bChanged, bool bDryRun);
+    uint32_t (ZArchO::*pfnStripBitcode)();
+    uint32_t (ZArchO::*pfnStripLocalSymbols)();
+};
+
+bool ZArchO::InitHeader(uint8_t *pHeader, uint32_t uLength) {
+    m_bHeaderOnly = true;
+    return Init(pHeader, uLength);
 }
 
 bool ZArchO::Init(uint8_t *pBase, uint32_t uLength) {
-    if (NULL == pBase || uLength == 0) {
+    if (NULL == pBase || uLength < sizeof(mach_header)) {
         return false;
     }
 
+    // Init is also used to re-parse the slice after its load commands were edited
     m_pBase = pBase;
     m_uLength = uLength;
+    m_pSignBase = NULL;
+    m_uSignLength = 0;
+    m_bEncrypted = false;
+    m_pCodeSignSegment = NULL;
+    m_pLinkEditSegment = NULL;
+    m_uLoadCommandsFreeSpace = 0;
+    m_strInfoPlist.clear();
+    m_arrLoadCommands.clear();
     m_uCodeLength = (uLength % 16 == 0) ? uLength : uLength + 16 - (uLength % 16);
     m_pHeader = reinterpret_cast<mach_header *>(m_pBase);
-    if (MH_MAGIC != m_pHeader->magic && MH_CIGAM != m_pHeader->magic && MH_MAGIC_64 != m_pHeader->magic &&
-        MH_CIGAM_64 != m_pHeader->magic) {
-        return false;
+    switch (m_pHeader->magic) {
+        case MH_MAGIC:
+            m_pLayoutOps = GetLayoutOps<ZMachOLayout<false, false> >();
+            break;
+        case MH_CIGAM:
+            m_pLayoutOps = GetLayoutOps<ZMachOLayout<true, false> >();
+            break;
+        case MH_MAGIC_64:
+            m_pLayoutOps = GetLayoutOps<ZMachOLayout<false, true> >();
+            break;
+        case MH_CIGAM_64:
+            m_pLayoutOps = GetLayoutOps<ZMachOLayout<true, true> >();
+            break;
+        default:
+            return false;
     }
 
     m_b64 = (MH_MAGIC_64 == m_pHeader->magic || MH_CIGAM_64 == m_pHeader->magic) ? true : false;
     m_bBigEndian = (MH_CIGAM == m_pHeader->magic || MH_CIGAM_64 == m_pHeader->magic) ? true : false;
     m_uHeaderSize = m_b64 ? sizeof(mach_header_64) : sizeof(mach_header);
 
-    uint8_t *pLoadCommand = m_pBase + m_uHeaderSize;
-    for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-        load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-        switch (BO(plc->cmd)) {
-            case LC_SEGMENT: {
-                segment_command *seglc = reinterpret_cast<segment_command *>(pLoadCommand);
-                if (0 == strcmp("__TEXT", seglc->segname)) {
-                    execSegLimit = seglc->vmsize;
-                    for (uint32_t j = 0; j < BO(seglc->nsects); j++) {
-                        section *sect = reinterpret_cast<section *>((pLoadCommand + sizeof(segment_command)) + sizeof(section) * j);
-                        if (0 == strcmp("__text", sect->sectname)) {
-                            if (BO(sect->offset) > (BO(m_pHeader->sizeofcmds) + m_uHeaderSize)) {
-                                m_uLoadCommandsFreeSpace = BO(sect->offset) - BO(m_pHeader->sizeofcmds) - m_uHeaderSize;
-                            }
-                        } else if (0 == strcmp("__info_plist", sect->sectname)) {
-                            m_strInfoPlist.append((const char *)m_pBase + BO(sect->offset), BO(sect->size));
-                        }
-                    }
-                } else if (0 == strcmp("__LINKEDIT", seglc->segname)) {
-                    m_pLinkEditSegment = pLoadCommand;
+    // a header-only slice holds nothing past its load commands
+    uint32_t uViewLength = uLength;
+    if (m_bHeaderOnly && (uint64_t)m_uHeaderSize + BO(m_pHeader->sizeofcmds) < uLength) {
+        uViewLength = m_uHeaderSize + BO(m_pHeader->sizeofcmds);
+    }
+    m_view = ZMachOView(m_pBase, uViewLength);
+
+    return (this->*m_pLayoutOps->pfnParseLoadCommands)();
+}
+
+template <class L>
+const ZArchO::ZLayoutOps *ZArchO::GetLayoutOps() {
+    static const ZLayoutOps ops = {
+        &ZArchO::ParseLoadCommands<L>, &ZArchO::GrowCodeSignSpace<L>, &ZArchO::RewriteLoadCommands<L>,
+        &ZArchO::StripBitcode<L>,      &ZArchO::StripLocalSymbols<L>,
+    };
+    return &ops;
+}
+
+template <class L>
+bool ZArchO::ParseLoadCommands() {
+    typedef typename L::header_t header_t;
+    typedef typename L::segment_t segment_t;
+    typedef typename L::section_t section_t;
+
+    const header_t *pHeader = m_view.At<header_t>(0);
+    if (NULL == pHeader) {
+        return false;
+    }
+
+    uint32_t uSizeOfCmds = L::BO(pHeader->sizeofcmds);
+    uint32_t uOffset = sizeof(header_t);
+    for (uint32_t i = 0; i < L::BO(pHeader->ncmds); i++) {
+        const load_command *plc = m_view.At<load_command>(uOffset);
+        if (NULL == plc || L::BO(plc->cmdsize) < sizeof(load_command) || !m_view.Contains(uOffset, L::BO(plc->cmdsize))) {
+            ZLog::Warn(">>> Invalid Load Command!\n");
+            return false;
+        }
+
+        ZLoadCommand lc;
+        lc.uCmd = L::BO(plc->cmd);
+        lc.uSize = L::BO(plc->cmdsize);
+        lc.uOffset = uOffset;
+        if (LC_LOAD_DYLIB == lc.uCmd || LC_LOAD_WEAK_DYLIB == lc.uCmd || LC_ID_DYLIB == lc.uCmd ||
+            LC_REEXPORT_DYLIB == lc.uCmd || LC_LAZY_LOAD_DYLIB == lc.uCmd || LC_RPATH == lc.uCmd) {
+            uint32_t uNameOffset = lc.uSize;
+            if (LC_RPATH == lc.uCmd && lc.uSize >= sizeof(rpath_command)) {
+                uNameOffset = L::BO(m_view.At<rpath_command>(uOffset)->path.offset);
+            } else if (LC_RPATH != lc.uCmd && lc.uSize >= sizeof(dylib_command)) {
+                uNameOffset = L::BO(m_view.At<dylib_command>(uOffset)->dylib.name.offset);
+            }
+            if (uNameOffset < lc.uSize) {
+                lc.strPath = m_view.String(uOffset + uNameOffset, uOffset + lc.uSize);
+            }
+        }
+        m_arrLoadCommands.push_back(lc);
+
+        switch (lc.uCmd) {
+            case L::uSegmentCmd: {
+                segment_t *seglc = m_view.At<segment_t>(uOffset);
+                uint32_t uSections = (lc.uSize >= sizeof(segment_t)) ? L::BO(seglc->nsects) : 0;
+                const section_t *sect = m_view.At<section_t>(uOffset + sizeof(segment_t), uSections);
+                if (NULL == sect || sizeof(segment_t) + (uint64_t)uSections * sizeof(section_t) > lc.uSize) {
+                    ZLog::Warn(">>> Invalid Segment Command!\n");
+                    return false;
                 }
-            } break;
-            case LC_SEGMENT_64: {
-                segment_command_64 *seglc = reinterpret_cast<segment_command_64 *>(pLoadCommand);
-                if (0 == strcmp("__TEXT", seglc->segname)) {
-                    execSegLimit = seglc->vmsize;
-                    for (uint32_t j = 0; j < BO(seglc->nsects); j++) {
-                        section_64 *sect =
-                            reinterpret_cast<section_64 *>((pLoadCommand + sizeof(segment_command_64)) + sizeof(section_64) * j);
-                        if (0 == strcmp("__text", sect->sectname)) {
-                            if (BO(sect->offset) > (BO(m_pHeader->sizeofcmds) + m_uHeaderSize)) {
-                                m_uLoadCommandsFreeSpace = BO(sect->offset) - BO(m_pHeader->sizeofcmds) - m_uHeaderSize;
+
+                if (0 == strncmp("__TEXT", seglc->segname, sizeof(seglc->segname))) {
+                    m_uExecSegLimit = L::BO(seglc->vmsize);
+                    for (uint32_t j = 0; j < uSections; j++) {
+                        if (0 == strncmp("__text", sect[j].sectname, sizeof(sect[j].sectname))) {
+                            if (L::BO(sect[j].offset) > uSizeOfCmds + m_uHeaderSize) {
+                                m_uLoadCommandsFreeSpace = L::BO(sect[j].offset) - uSizeOfCmds - m_uHeaderSize;
+                            }
+                        } else if (0 == strncmp("__info_plist", sect[j].sectname, sizeof(sect[j].sectname))) {
+                            m_uInfoPlistOffset = L::BO(sect[j].offset);
+                            m_uInfoPlistSize = (uint32_t)L::BO(sect[j].size);
+                            if (!m_bHeaderOnly && m_view.Contains(m_uInfoPlistOffset, m_uInfoPlistSize)) {
+                                m_strInfoPlist.append((const char *)m_pBase + m_uInfoPlistOffset, m_uInfoPlistSize);
                             }
-                        } else if (0 == strcmp("__info_plist", sect->sectname)) {
-                            m_strInfoPlist.append((const char *)m_pBase + BO(sect->offset), BO((uint32_t)sect->size));
                         }
                     }
-                } else if (0 == strcmp("__LINKEDIT", seglc->segname)) {
-                    m_pLinkEditSegment = pLoadCommand;
+                } else if (0 == strncmp("__LINKEDIT", seglc->segname, sizeof(seglc->segname))) {
+                    m_pLinkEditSegment = reinterpret_cast<uint8_t *>(seglc);
                 }
             } break;
             case LC_ENCRYPTION_INFO:
             case LC_ENCRYPTION_INFO_64: {
-                encryption_info_command *crypt_cmd = reinterpret_cast<encryption_info_command *>(pLoadCommand);
-                if (BO(crypt_cmd->cryptid) >= 1) {
+                const encryption_info_command *crypt_cmd = m_view.At<encryption_info_command>(uOffset);
+                if (lc.uSize >= sizeof(encryption_info_command) && L::BO(crypt_cmd->cryptid) >= 1) {
                     m_bEncrypted = true;
                 }
             } break;
             case LC_CODE_SIGNATURE: {
-                codesignature_command *pcslc = reinterpret_cast<codesignature_command *>(pLoadCommand);
-                m_pCodeSignSegment = pLoadCommand;
-                m_uCodeLength = BO(pcslc->dataoff);
-                m_pSignBase = m_pBase + m_uCodeLength;
-                m_uSignLength = GetCodeSignatureLength(m_pSignBase);
+                codesignature_command *pcslc = m_view.At<codesignature_command>(uOffset);
+                if (lc.uSize < sizeof(codesignature_command)) {
+                    break;
+                }
+                m_pCodeSignSegment = reinterpret_cast<uint8_t *>(pcslc);
+                m_uCodeLength = L::BO(pcslc->dataoff);
+                m_uSignDataSize = L::BO(pcslc->datasize);
+                if (!m_bHeaderOnly && m_uCodeLength <= m_uLength) {
+                    m_pSignBase = m_pBase + m_uCodeLength;
+                    m_uSignLength = m_view.Contains(m_uCodeLength, sizeof(CS_SuperBlob)) ? GetCodeSignatureLength(m_pSignBase) : 0;
+                }
             } break;
         }
 
-        pLoadCommand += BO(plc->cmdsize);
+        uOffset += lc.uSize;
     }
 
     return true;
 }
 
+template <class L>
+void ZArchO::GrowCodeSignSpace(uint32_t uNewLength) {
+    typedef typename L::header_t header_t;
+    typedef typename L::segment_t segment_t;
+    typedef typename L::addr_t addr_t;
+
+    segment_t *seglc = reinterpret_cast<segment_t *>(m_pLinkEditSegment);
+    seglc->vmsize = L::BO((addr_t)ByteAlign((uint32_t)L::BO(seglc->vmsize) + (uNewLength - m_uLength), 4096));
+    seglc->filesize = L::BO((addr_t)(uNewLength - L::BO(seglc->fileoff)));
+
+    codesignature_command *pcslc = reinterpret_cast<codesignature_command *>(m_pCodeSignSegment);
+    if (NULL == pcslc) {
+        header_t *pHeader = m_view.At<header_t>(0);
+        pcslc = m_view.At<codesignature_command>(m_uHeaderSize + L::BO(pHeader->sizeofcmds));
+        pcslc->cmd = L::BO((uint32_t)LC_CODE_SIGNATURE);
+        pcslc->cmdsize = L::BO((uint32_t)sizeof(codesignature_command));
+        pcslc->dataoff = L::BO(m_uCodeLength);
+        pHeader->ncmds = L::BO(L::BO(pHeader->ncmds) + 1);
+        pHeader->sizeofcmds = L::BO(L::BO(pHeader->sizeofcmds) + (uint32_t)sizeof(codesignature_command));
+    }
+    pcslc->datasize = L::BO(uNewLength - m_uCodeLength);
+}
+
+
 // static to match header declaration
 const char *ZArchO::GetArch(int cpuType, int cpuSubType) {
     switch (cpuType) {
@@ -217,6 +330,13 @@ const char *ZArchO::GetFileType(uint32_t uFileType) {
 
 uint32_t ZArchO::BO(uint32_t uValue) const { return m_bBigEndian ? LE(uValue) : uValue; }
 
+const char *ZArchO::GetArchName() const {
+    if (NULL == m_pHeader) {
+        return "unknown";
+    }
+    return GetArch(BO(m_pHeader->cputype), BO(m_pHeader->cpusubtype) & ~CPU_SUBTYPE_MASK);
+}
+
 bool ZArchO::IsExecute() {
     if (NULL != m_pHeader) {
         return (MH_EXECUTE == BO(m_pHeader->filetype));
@@ -245,43 +365,33 @@ void ZArchO::PrintInfo() const {
     ZLog::PrintV("\tSpareLength: \t%d (%s)\n", m_uLength - m_uCodeLength - m_uSignLength,
                  FormatSize(m_uLength - m_uCodeLength - m_uSignLength).c_str());
 
-    uint8_t *pLoadCommand = m_pBase + m_uHeaderSize;
-    for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-        load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-        if (LC_VERSION_MIN_IPHONEOS == BO(plc->cmd)) {
-            ZLog::PrintV("\tMIN_IPHONEOS: \t0x%x\n", *reinterpret_cast<uint32_t *>(pLoadCommand + sizeof(load_command)));
-        } else if (LC_RPATH == BO(plc->cmd)) {
-            ZLog::PrintV("\tLC_RPATH: \t%s\n", reinterpret_cast<char *>(pLoadCommand + sizeof(load_command) + 4));
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        const ZLoadCommand &lc = m_arrLoadCommands[i];
+        if (LC_VERSION_MIN_IPHONEOS == lc.uCmd) {
+            ZLog::PrintV("\tMIN_IPHONEOS: \t0x%x\n", *reinterpret_cast<uint32_t *>(m_pBase + lc.uOffset + sizeof(load_command)));
+        } else if (LC_RPATH == lc.uCmd) {
+            ZLog::PrintV("\tLC_RPATH: \t%s\n", lc.strPath.c_str());
         }
-        pLoadCommand += BO(plc->cmdsize);
     }
 
     bool bHasWeakDylib = false;
     ZLog::PrintV("\tLC_LOAD_DYLIB: \n");
-    pLoadCommand = m_pBase + m_uHeaderSize;
-    for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-        load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-        if (LC_LOAD_DYLIB == BO(plc->cmd)) {
-            dylib_command *dlc = reinterpret_cast<dylib_command *>(pLoadCommand);
-            const char *szDyLib = reinterpret_cast<const char *>(pLoadCommand + BO(dlc->dylib.name.offset));
-            ZLog::PrintV("\t\t\t%s\n", szDyLib);
-        } else if (LC_LOAD_WEAK_DYLIB == BO(plc->cmd)) {
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        const ZLoadCommand &lc = m_arrLoadCommands[i];
+        if (LC_LOAD_DYLIB == lc.uCmd) {
+            ZLog::PrintV("\t\t\t%s\n", lc.strPath.c_str());
+        } else if (LC_LOAD_WEAK_DYLIB == lc.uCmd) {
             bHasWeakDylib = true;
         }
-        pLoadCommand += BO(plc->cmdsize);
     }
 
     if (bHasWeakDylib) {
         ZLog::PrintV("\tLC_LOAD_WEAK_DYLIB: \n");
-        pLoadCommand = m_pBase + m_uHeaderSize;
-        for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-            load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-            if (LC_LOAD_WEAK_DYLIB == BO(plc->cmd)) {
-                dylib_command *dlc = reinterpret_cast<dylib_command *>(pLoadCommand);
-                const char *szDyLib = reinterpret_cast<const char *>(pLoadCommand + BO(dlc->dylib.name.offset));
-                ZLog::PrintV("\t\t\t%s (weak)\n", szDyLib);
+        for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+            const ZLoadCommand &lc = m_arrLoadCommands[i];
+            if (LC_LOAD_WEAK_DYLIB == lc.uCmd) {
+                ZLog::PrintV("\t\t\t%s (weak)\n", lc.strPath.c_str());
             }
-            pLoadCommand += BO(plc->cmdsize);
         }
     }
 
@@ -306,20 +416,86 @@ void ZArchO::PrintInfo() const {
     ZLog::Print("------------------------------------------------------------------\n");
 }
 
-bool ZArchO::BuildCodeSignature(ZSignAsset *pSignAsset, bool bForce, const string &strBundleId,
-                                const string &strInfoPlistSHA1, const string &strInfoPlistSHA256,
-                                const string &strCodeResourcesSHA1, const string &strCodeResourcesSHA256,
-                                string &strOutput) {
+bool ZArchO::Verify(const string &strInfoPlistData, const string &strCodeResourcesData, JValue &jvOutput) const {
+    jvOutput["arch"] = GetArchName();
+    if (m_bHeaderOnly || NULL == m_pSignBase || 0 == m_uSignLength) {
+        jvOutput["signed"] = false;
+        jvOutput["errors"].push_back("no code signature");
+        jvOutput["valid"] = false;
+        return false;
+    }
+
+    // binaries outside a bundle bind their embedded __info_plist, as Sign does
+    bool bValid = VerifyCodeSignature(m_pSignBase, m_uLength - m_uCodeLength, m_pBase, m_uCodeLength,
+                                      strInfoPlistData.empty() ? m_strInfoPlist : strInfoPlistData,
+                                      strCodeResourcesData, true, jvOutput);
+    jvOutput["valid"] = bValid;
+    return bValid;
+}
+
+bool ZArchO::IsSignedBy(ZSignAsset *pSignAsset, const string &strBundleId, const string &strInfoPlistData,
+                        const string &strCodeResourcesData) {
+    if (m_bHeaderOnly || NULL == m_pSignBase || 0 == m_uSignLength) {
+        return false;
+    }
+
+    // the code slots aren't rehashed, only the code limit is checked against the current code length
+    JValue jvOutput;
+    uint32_t uCSLength = m_uLength - m_uCodeLength;
+    if (!VerifyCodeSignature(m_pSignBase, uCSLength, m_pBase, m_uCodeLength,
+                             strInfoPlistData.empty() ? m_strInfoPlist : strInfoPlistData, strCodeResourcesData,
+                             false, jvOutput)) {
+        return false;
+    }
+
+    // the certificate itself has to be this identity's, a renewed one keeps the team and CN
+    if (!jvOutput["signed"].asBool() || jvOutput["teamid"].asString() != pSignAsset->m_strTeamId ||
+        jvOutput["signer"].asString() != pSignAsset->m_strSubjectCN ||
+        jvOutput["signersha256"].asString() != pSignAsset->m_strCertSHA256 ||
+        jvOutput["signerserial"].asString() != pSignAsset->m_strCertSerial) {
+        return false;
+    }
+
+    // requirements and entitlements have to be what this identity would write
     string strRequirementsSlot;
     string strEntitlementsSlot;
     string strDerEntitlementsSlot;
+    SlotBuildRequirements(strBundleId, pSignAsset->m_strSubjectCN, strRequirementsSlot);
+    BuildEntitlementsSlots(pSignAsset, strEntitlementsSlot, strDerEntitlementsSlot);
+
+    string strSlot;
+    GetCodeSignatureSlot(m_pSignBase, uCSLength, CSSLOT_REQUIREMENTS, strSlot);
+    if (strSlot != strRequirementsSlot) {
+        return false;
+    }
 
+    GetCodeSignatureSlot(m_pSignBase, uCSLength, CSSLOT_ENTITLEMENTS, strSlot);
+    if (strSlot != strEntitlementsSlot) {
+        return false;
+    }
+
+    GetCodeSignatureSlot(m_pSignBase, uCSLength, CSSLOT_DER_ENTITLEMENTS, strSlot);
+    return (strSlot == strDerEntitlementsSlot);
+}
+
+void ZArchO::BuildEntitlementsSlots(ZSignAsset *pSignAsset, string &strEntitlementsSlot,
+                                    string &strDerEntitlementsSlot) {
     string strEmptyEntitlements =
         "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" "
         "\"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n<plist version=\"1.0\">\n<dict/>\n</plist>\n";
-    SlotBuildRequirements(strBundleId, pSignAsset->m_strSubjectCN, strRequirementsSlot);
     SlotBuildEntitlements(IsExecute() ? pSignAsset->m_strEntitlementsData : strEmptyEntitlements, strEntitlementsSlot);
     SlotBuildDerEntitlements(IsExecute() ? pSignAsset->m_strEntitlementsData : "", strDerEntitlementsSlot);
+}
+
+bool ZArchO::BuildCodeSignature(ZSignAsset *pSignAsset, bool bForce, const string &strBundleId,
+                                const string &strInfoPlistSHA1, const string &strInfoPlistSHA256,
+                                const string &strCodeResourcesSHA1, const string &strCodeResourcesSHA256,
+                                string &strOutput) {
+    string strRequirementsSlot;
+    string strEntitlementsSlot;
+    string strDerEntitlementsSlot;
+    SlotBuildRequirements(strBundleId, pSignAsset->m_strSubjectCN, strRequirementsSlot);
+    BuildEntitlementsSlots(pSignAsset, strEntitlementsSlot, strDerEntitlementsSlot);
 
     string strRequirementsSlotSHA1;
     string strRequirementsSlotSHA256;
@@ -366,11 +542,11 @@ bool ZArchO::BuildCodeSignature(ZSignAsset *pSignAsset, bool bForce, const strin
     string strCMSSignatureSlot;
     string strCodeDirectorySlot;
     string strAltnateCodeDirectorySlot;
-    SlotBuildCodeDirectory(false, m_pBase, m_uCodeLength, pCodeSlots1Data, uCodeSlots1DataLength, execSegLimit,
+    SlotBuildCodeDirectory(false, m_pBase, m_uCodeLength, pCodeSlots1Data, uCodeSlots1DataLength, m_uExecSegLimit,
                            execSegFlags, strBundleId, pSignAsset->m_strTeamId, strInfoPlistSHA1,
                            strRequirementsSlotSHA1, strCodeResourcesSHA1, strEntitlementsSlotSHA1,
                            strDerEntitlementsSlotSHA1, IsExecute(), strCodeDirectorySlot);
-    SlotBuildCodeDirectory(true, m_pBase, m_uCodeLength, pCodeSlots256Data, uCodeSlots256DataLength, execSegLimit,
+    SlotBuildCodeDirectory(true, m_pBase, m_uCodeLength, pCodeSlots256Data, uCodeSlots256DataLength, m_uExecSegLimit,
                            execSegFlags, strBundleId, pSignAsset->m_strTeamId, strInfoPlistSHA256,
                            strRequirementsSlotSHA256, strCodeResourcesSHA256, strEntitlementsSlotSHA256,
                            strDerEntitlementsSlotSHA256, IsExecute(), strAltnateCodeDirectorySlot);
@@ -474,22 +650,14 @@ bool ZArchO::BuildCodeSignature(ZSignAsset *pSignAsset, bool bForce, const strin
 }
 
 bool ZArchO::Sign(ZSignAsset *pSignAsset, bool bForce, const string &strBundleId, const string &strInfoPlistSHA1,
-                  const string &strInfoPlistSHA256, const string &strCodeResourcesData) {
+                  const string &strInfoPlistSHA256, const string &strCodeResourcesSHA1,
+                  const string &strCodeResourcesSHA256) {
     if (NULL == m_pSignBase) {
         m_bEnoughSpace = false;
         ZLog::Warn(">>> Can't Find CodeSignature Segment!\n");
         return false;
     }
 
-    string strCodeResourcesSHA1;
-    string strCodeResourcesSHA256;
-    if (strCodeResourcesData.empty()) {
-        strCodeResourcesSHA1.append(20, 0);
-        strCodeResourcesSHA256.append(32, 0);
-    } else {
-        SHASum(strCodeResourcesData, strCodeResourcesSHA1, strCodeResourcesSHA256);
-    }
-
     string strCodeSignBlob;
     BuildCodeSignature(pSignAsset, bForce, strBundleId, strInfoPlistSHA1, strInfoPlistSHA256, strCodeResourcesSHA1,
                        strCodeResourcesSHA256, strCodeSignBlob);
@@ -511,223 +679,528 @@ bool ZArchO::Sign(ZSignAsset *pSignAsset, bool bForce, const string &strBundleId
     return true;
 }
 
-uint32_t ZArchO::ReallocCodeSignSpace(const string &strNewFile) {
-    RemoveFile(strNewFile.c_str());
-
+uint32_t ZArchO::ReallocCodeSignSpace(bool bDryRun /*= false*/) {
     uint32_t uNewLength =
         m_uCodeLength + ByteAlign(((m_uCodeLength / 4096) + 1) * (20 + 32), 4096) + 16384; // 16K May Be Enough
     if (NULL == m_pLinkEditSegment || uNewLength <= m_uLength) {
         return 0;
     }
 
-    load_command *pseglc = reinterpret_cast<load_command *>(m_pLinkEditSegment);
-    switch (BO(pseglc->cmd)) {
-        case LC_SEGMENT: {
-            segment_command *seglc = reinterpret_cast<segment_command *>(m_pLinkEditSegment);
-            seglc->vmsize = ByteAlign(BO(seglc->vmsize) + (uNewLength - m_uLength), 4096);
-            seglc->vmsize = BO(seglc->vmsize);
-            seglc->filesize = uNewLength - BO(seglc->fileoff);
-            seglc->filesize = BO(seglc->filesize);
-        } break;
-        case LC_SEGMENT_64: {
-            segment_command_64 *seglc = reinterpret_cast<segment_command_64 *>(m_pLinkEditSegment);
-            seglc->vmsize = ByteAlign(BO((uint32_t)seglc->vmsize) + (uNewLength - m_uLength), 4096);
-            seglc->vmsize = BO((uint32_t)seglc->vmsize);
-            seglc->filesize = uNewLength - BO((uint32_t)seglc->fileoff);
-            seglc->filesize = BO((uint32_t)seglc->filesize);
-        } break;
+    if (NULL == m_pCodeSignSegment && m_uLoadCommandsFreeSpace < sizeof(codesignature_command)) {
+        ZLog::Error(">>> Can't Find Free Space Of LoadCommands For CodeSignature!\n");
+        return 0;
     }
 
-    codesignature_command *pcslc = reinterpret_cast<codesignature_command *>(m_pCodeSignSegment);
-    if (NULL == pcslc) {
-        if (m_uLoadCommandsFreeSpace < 4) {
-            ZLog::Error(">>> Can't Find Free Space Of LoadCommands For CodeSignature!\n");
-            return 0;
+    // only the load commands change here, the caller grows the slice to uNewLength with zeros
+    if (!bDryRun) {
+        (this->*m_pLayoutOps->pfnGrowCodeSignSpace)(uNewLength);
+    }
+    return uNewLength;
+}
+
+bool ZArchO::InjectDyLib(bool bWeakInject, const char *szDyLibPath, bool &bCreate) {
+    const ZLoadCommand *plc = FindLoadCommand(LC_LOAD_DYLIB, szDyLibPath);
+    if (NULL != plc) {
+        if ((bWeakInject && (LC_LOAD_WEAK_DYLIB != plc->uCmd)) || (!bWeakInject && (LC_LOAD_DYLIB != plc->uCmd))) {
+            ZLog::WarnV(">>> DyLib Load Type Changed! %s -> %s\n",
+                        (LC_LOAD_DYLIB == plc->uCmd) ? "LC_LOAD_DYLIB" : "LC_LOAD_WEAK_DYLIB",
+                        bWeakInject ? "LC_LOAD_WEAK_DYLIB" : "LC_LOAD_DYLIB");
+        } else {
+            ZLog::WarnV(">>> DyLib Is Already Existed! %s\n", szDyLibPath);
+            return true;
         }
+    }
 
-        pcslc = reinterpret_cast<codesignature_command *>(m_pBase + m_uHeaderSize + BO(m_pHeader->sizeofcmds));
-        pcslc->cmd = BO(LC_CODE_SIGNATURE);
-        pcslc->cmdsize = BO((uint32_t)sizeof(codesignature_command));
-        pcslc->dataoff = BO(m_uCodeLength);
-        m_pHeader->ncmds = BO(BO(m_pHeader->ncmds) + 1);
-        m_pHeader->sizeofcmds = BO(BO(m_pHeader->sizeofcmds) + sizeof(codesignature_command));
+    ZLoadCommandEdit edit;
+    edit.nType = bWeakInject ? ZLoadCommandEdit::E_INJECT_WEAK_DYLIB : ZLoadCommandEdit::E_INJECT_DYLIB;
+    edit.strPath = szDyLibPath;
+
+    bool bChanged = false;
+    if (!ApplyEdits(vector<ZLoadCommandEdit>(1, edit), bChanged)) {
+        return false;
+    }
+    if (NULL == plc) {
+        bCreate = true;
     }
-    pcslc->datasize = BO(uNewLength - m_uCodeLength);
+    return true;
+}
 
-    if (!AppendFile(strNewFile.c_str(), (const char *)m_pBase, m_uLength)) {
-        return 0;
+bool ZArchO::ChangeDylibPath(const char *oldPath, const char *newPath) {
+    if (NULL == FindLoadCommand(LC_LOAD_DYLIB, oldPath)) {
+        ZLog::PrintV(">>> Old Dylib Path Not Found: %s\n", oldPath);
+        return false;
     }
 
-    string strPadding;
-    strPadding.append(uNewLength - m_uLength, 0);
-    if (!AppendFile(strNewFile.c_str(), strPadding)) {
-        RemoveFile(strNewFile.c_str());
-        return 0;
+    ZLoadCommandEdit edit;
+    edit.nType = ZLoadCommandEdit::E_RENAME_DYLIB;
+    edit.strPath = oldPath;
+    edit.strNewPath = newPath;
+
+    bool bChanged = false;
+    return ApplyEdits(vector<ZLoadCommandEdit>(1, edit), bChanged);
+}
+
+void ZArchO::uninstallDylibs(const set<string> &dylibNames) {
+    vector<ZLoadCommandEdit> arrEdits;
+    for (set<string>::const_iterator it = dylibNames.begin(); it != dylibNames.end(); it++) {
+        ZLoadCommandEdit edit;
+        edit.nType = ZLoadCommandEdit::E_REMOVE_DYLIB;
+        edit.strPath = *it;
+        arrEdits.push_back(edit);
     }
 
-    return uNewLength;
+    bool bChanged = false;
+    ApplyEdits(arrEdits, bChanged);
 }
 
-bool ZArchO::InjectDyLib(bool bWeakInject, const char *szDyLibPath, bool &bCreate) {
-    if (NULL == m_pHeader) {
+std::vector<std::string> ZArchO::ListDylibs() {
+    std::vector<std::string> dylibList;
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        const ZLoadCommand &lc = m_arrLoadCommands[i];
+        if (LC_LOAD_DYLIB == lc.uCmd || LC_LOAD_WEAK_DYLIB == lc.uCmd) {
+            dylibList.push_back(lc.strPath);
+        }
+    }
+    return dylibList;
+}
+
+const ZLoadCommand *ZArchO::FindLoadCommand(uint32_t uCmd, const string &strPath) const {
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        const ZLoadCommand &lc = m_arrLoadCommands[i];
+        bool bMatch = (uCmd == lc.uCmd) || (LC_LOAD_DYLIB == uCmd && LC_LOAD_WEAK_DYLIB == lc.uCmd);
+        if (bMatch && strPath == lc.strPath) {
+            return &lc;
+        }
+    }
+    return NULL;
+}
+
+template <class L>
+string ZArchO::BuildPathCommand(uint32_t uCmd, const string &strPath, const dylib_command *pTemplate) const {
+    uint32_t uHeadSize = (LC_RPATH == uCmd) ? sizeof(rpath_command) : sizeof(dylib_command);
+    uint32_t uPathPadding = (8 - strPath.size() % 8); // keeps at least one terminating zero
+    uint32_t uCommandSize = uHeadSize + (uint32_t)strPath.size() + uPathPadding;
+
+    string strCommand(uCommandSize, 0);
+    if (LC_RPATH == uCmd) {
+        rpath_command *rlc = reinterpret_cast<rpath_command *>(&strCommand[0]);
+        rlc->cmd = L::BO(uCmd);
+        rlc->cmdsize = L::BO(uCommandSize);
+        rlc->path.offset = L::BO(uHeadSize);
+    } else {
+        dylib_command *dlc = reinterpret_cast<dylib_command *>(&strCommand[0]);
+        dlc->cmd = L::BO(uCmd);
+        dlc->cmdsize = L::BO(uCommandSize);
+        dlc->dylib.name.offset = L::BO(uHeadSize);
+        if (NULL != pTemplate) {
+            dlc->dylib.timestamp = pTemplate->dylib.timestamp;
+            dlc->dylib.current_version = pTemplate->dylib.current_version;
+            dlc->dylib.compatibility_version = pTemplate->dylib.compatibility_version;
+        } else {
+            dlc->dylib.timestamp = L::BO((uint32_t)2);
+        }
+    }
+    memcpy(&strCommand[uHeadSize], strPath.data(), strPath.size());
+    return strCommand;
+}
+
+bool ZArchO::ApplyEdits(const vector<ZLoadCommandEdit> &arrEdits, bool &bChanged, bool bDryRun /*= false*/) {
+    if (NULL == m_pHeader || m_bHeaderOnly) {
         return false;
     }
+    return (this->*m_pLayoutOps->pfnRewriteLoadCommands)(arrEdits, bChanged, bDryRun);
+}
 
-    uint8_t *pLoadCommand = m_pBase + m_uHeaderSize;
-    for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-        load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-        uint32_t uLoadType = BO(plc->cmd);
-        if (LC_LOAD_DYLIB == uLoadType || LC_LOAD_WEAK_DYLIB == uLoadType) {
-            dylib_command *dlc = reinterpret_cast<dylib_command *>(pLoadCommand);
-            const char *szDyLib = reinterpret_cast<const char *>(pLoadCommand + BO(dlc->dylib.name.offset));
-            if (0 == strcmp(szDyLib, szDyLibPath)) {
-                if ((bWeakInject && (LC_LOAD_WEAK_DYLIB != uLoadType)) ||
-                    (!bWeakInject && (LC_LOAD_DYLIB != uLoadType))) {
-                    dlc->cmd = BO((uint32_t)(bWeakInject ? LC_LOAD_WEAK_DYLIB : LC_LOAD_DYLIB));
-                    ZLog::WarnV(">>> DyLib Load Type Changed! %s -> %s\n",
-                                (LC_LOAD_DYLIB == uLoadType) ? "LC_LOAD_DYLIB" : "LC_LOAD_WEAK_DYLIB",
-                                bWeakInject ? "LC_LOAD_WEAK_DYLIB" : "LC_LOAD_DYLIB");
+template <class L>
+bool ZArchO::RewriteLoadCommands(const vector<ZLoadCommandEdit> &arrEdits, bool &bChanged, bool bDryRun) {
+    typedef typename L::header_t header_t;
+
+    map<string, const ZLoadCommandEdit *> mapDylibEdits; // last edit of a path wins
+    map<string, const ZLoadCommandEdit *> mapRPathEdits;
+    for (size_t i = 0; i < arrEdits.size(); i++) {
+        const ZLoadCommandEdit &edit = arrEdits[i];
+        if (ZLoadCommandEdit::E_ADD_RPATH == edit.nType || ZLoadCommandEdit::E_REMOVE_RPATH == edit.nType) {
+            mapRPathEdits[edit.strPath] = &edit;
+        } else {
+            mapDylibEdits[edit.strPath] = &edit;
+        }
+    }
+
+    string strCommands;
+    uint32_t uCommands = 0;
+    bool bEdited = false;
+    set<string> setDylibs;
+    set<string> setRPaths;
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        const ZLoadCommand &lc = m_arrLoadCommands[i];
+        string strCommand(m_view.At<char>(lc.uOffset, lc.uSize), lc.uSize); // checked by Init
+
+        if ((LC_LOAD_DYLIB == lc.uCmd || LC_LOAD_WEAK_DYLIB == lc.uCmd) && lc.uSize >= sizeof(dylib_command)) {
+            map<string, const ZLoadCommandEdit *>::iterator it = mapDylibEdits.find(lc.strPath);
+            if (it != mapDylibEdits.end()) {
+                const ZLoadCommandEdit &edit = *it->second;
+                const dylib_command *dlc = m_view.At<dylib_command>(lc.uOffset);
+                if (ZLoadCommandEdit::E_REMOVE_DYLIB == edit.nType) {
+                    if (!bDryRun) {
+                        ZLog::PrintV(">>> Dylib Removed: %s\n", lc.strPath.c_str());
+                    }
+                    bEdited = true;
+                    continue;
+                } else if (ZLoadCommandEdit::E_RENAME_DYLIB == edit.nType) {
+                    strCommand = BuildPathCommand<L>(lc.uCmd, edit.strNewPath, dlc);
+                    if (!bDryRun) {
+                        ZLog::PrintV(">>> Dylib Path Changed: %s -> %s\n", lc.strPath.c_str(),
+                                     edit.strNewPath.c_str());
+                    }
+                    bEdited = true;
                 } else {
-                    ZLog::WarnV(">>> DyLib Is Already Existed! %s\n");
+                    uint32_t uCmd = (ZLoadCommandEdit::E_INJECT_WEAK_DYLIB == edit.nType) ? LC_LOAD_WEAK_DYLIB
+                                                                                         : LC_LOAD_DYLIB;
+                    if (uCmd != lc.uCmd) {
+                        reinterpret_cast<dylib_command *>(&strCommand[0])->cmd = L::BO(uCmd);
+                        bEdited = true;
+                    }
+                }
+            }
+            setDylibs.insert(lc.strPath);
+        } else if (LC_RPATH == lc.uCmd) {
+            map<string, const ZLoadCommandEdit *>::iterator it = mapRPathEdits.find(lc.strPath);
+            if (it != mapRPathEdits.end() && ZLoadCommandEdit::E_REMOVE_RPATH == it->second->nType) {
+                if (!bDryRun) {
+                    ZLog::PrintV(">>> RPath Removed: %s\n", lc.strPath.c_str());
                 }
-                return true;
+                bEdited = true;
+                continue;
             }
+            setRPaths.insert(lc.strPath);
         }
-        pLoadCommand += BO(plc->cmdsize);
+
+        strCommands += strCommand;
+        uCommands++;
     }
 
-    uint32_t uDylibPathLength = (uint32_t)strlen(szDyLibPath);
-    uint32_t uDylibPathPadding = (8 - uDylibPathLength % 8);
-    uint32_t uDyLibCommandSize = sizeof(dylib_command) + uDylibPathLength + uDylibPathPadding;
-    if (m_uLoadCommandsFreeSpace > 0 && m_uLoadCommandsFreeSpace < uDyLibCommandSize) // some bin doesn't have '__text'
-    {
-        ZLog::Error(">>> Can't Find Free Space Of LoadCommands For LC_LOAD_DYLIB Or LC_LOAD_WEAK_DYLIB!\n");
-        return false;
+    // new commands go after the existing ones, in the order they were requested
+    for (size_t i = 0; i < arrEdits.size(); i++) {
+        const ZLoadCommandEdit &edit = arrEdits[i];
+        if (ZLoadCommandEdit::E_INJECT_DYLIB == edit.nType || ZLoadCommandEdit::E_INJECT_WEAK_DYLIB == edit.nType) {
+            if (mapDylibEdits[edit.strPath] != &edit || setDylibs.count(edit.strPath) > 0) {
+                continue;
+            }
+            uint32_t uCmd = (ZLoadCommandEdit::E_INJECT_WEAK_DYLIB == edit.nType) ? LC_LOAD_WEAK_DYLIB : LC_LOAD_DYLIB;
+            strCommands += BuildPathCommand<L>(uCmd, edit.strPath, NULL);
+            setDylibs.insert(edit.strPath);
+        } else if (ZLoadCommandEdit::E_ADD_RPATH == edit.nType) {
+            if (mapRPathEdits[edit.strPath] != &edit || setRPaths.count(edit.strPath) > 0) {
+                continue;
+            }
+            strCommands += BuildPathCommand<L>(LC_RPATH, edit.strPath, NULL);
+            setRPaths.insert(edit.strPath);
+        } else {
+            continue;
+        }
+        if (!bDryRun) {
+            ZLog::PrintV(">>> Load Command Added: %s\n", edit.strPath.c_str());
+        }
+        uCommands++;
+        bEdited = true;
     }
 
-    // add
-    dylib_command *dlc = reinterpret_cast<dylib_command *>(m_pBase + m_uHeaderSize + BO(m_pHeader->sizeofcmds));
-    dlc->cmd = BO((uint32_t)(bWeakInject ? LC_LOAD_WEAK_DYLIB : LC_LOAD_DYLIB));
-    dlc->cmdsize = BO(uDyLibCommandSize);
-    dlc->dylib.name.offset = BO((uint32_t)sizeof(dylib_command));
-    dlc->dylib.timestamp = BO((uint32_t)2);
-    dlc->dylib.current_version = 0;
-    dlc->dylib.compatibility_version = 0;
+    if (!bEdited) {
+        return true;
+    }
 
-    string strDylibPath = szDyLibPath;
-    strDylibPath.append(uDylibPathPadding, 0);
+    header_t *pHeader = m_view.At<header_t>(0);
+    uint32_t uOldSizeOfCmds = L::BO(pHeader->sizeofcmds);
+    if (m_uLoadCommandsFreeSpace > 0 && strCommands.size() > uOldSizeOfCmds + m_uLoadCommandsFreeSpace) { // some bin doesn't have '__text'
+        ZLog::Error(">>> Can't Find Free Space Of LoadCommands!\n");
+        return false;
+    }
 
-    uint8_t *pDyLibPath = (uint8_t *)dlc + sizeof(dylib_command);
-    memcpy(pDyLibPath, strDylibPath.data(), uDylibPathLength + uDylibPathPadding);
+    uint8_t *pLoadCommands = m_view.At<uint8_t>(m_uHeaderSize, max((uint32_t)strCommands.size(), uOldSizeOfCmds));
+    if (NULL == pLoadCommands) {
+        ZLog::Error(">>> Can't Find Free Space Of LoadCommands!\n");
+        return false;
+    }
+    if (bDryRun) {
+        return true;
+    }
 
-    m_pHeader->ncmds = BO(BO(m_pHeader->ncmds) + 1);
-    m_pHeader->sizeofcmds = BO(BO(m_pHeader->sizeofcmds) + uDyLibCommandSize);
+    memcpy(pLoadCommands, strCommands.data(), strCommands.size());
+    if (strCommands.size() < uOldSizeOfCmds) {
+        memset(pLoadCommands + strCommands.size(), 0, uOldSizeOfCmds - strCommands.size());
+    }
+    pHeader->ncmds = L::BO(uCommands);
+    pHeader->sizeofcmds = L::BO((uint32_t)strCommands.size());
+    bChanged = true;
 
-    bCreate = true;
-    return true;
+    // command offsets moved, refresh the index and the cached segment pointers
+    return Init(m_pBase, m_uLength);
 }
 
-bool ZArchO::ChangeDylibPath(const char *oldPath, const char *newPath) {
-    if (NULL == m_pHeader) {
-        return false;
-    }
+template <class L>
+void ZArchO::ShiftFileOffsets(uint32_t uFrom, uint32_t uDelta) {
+    typedef typename L::segment_t segment_t;
+    typedef typename L::section_t section_t;
 
-    uint8_t *pLoadCommand = m_pBase + m_uHeaderSize;
-    bool pathChanged = false;
-    uint32_t oldPathLength = static_cast<uint32_t>(strlen(oldPath));
-    uint32_t newPathLength = static_cast<uint32_t>(strlen(newPath));
-    // Calculate padding for alignment - oldPathPadding is not used but kept for code clarity
-    [[maybe_unused]] uint32_t oldPathPadding = (8 - oldPathLength % 8) % 8;
-    uint32_t newPathPadding = (8 - newPathLength % 8) % 8;
-    [[maybe_unused]] uint32_t newLoadCommandSize = 0;
-
-    for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-        load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-        uint32_t uLoadType = BO(plc->cmd);
-
-        if (LC_LOAD_DYLIB == uLoadType || LC_LOAD_WEAK_DYLIB == uLoadType) {
-            dylib_command *dlc = reinterpret_cast<dylib_command *>(pLoadCommand);
-            const char *szDyLib = reinterpret_cast<const char *>(pLoadCommand + BO(dlc->dylib.name.offset));
-
-            if (strcmp(szDyLib, oldPath) == 0) {
-                uint32_t dylibPathOffset = sizeof(dylib_command);
-                uint32_t dylibPathSize = newPathLength + newPathPadding;
-                if (dylibPathOffset + dylibPathSize > BO(plc->cmdsize)) {
-                    ZLog::Error(">>> Insufficient space to update dylib path!\n");
-                    return false;
+    auto Shift = [&](uint32_t &uOffset) {
+        if (0 != uOffset && L::BO(uOffset) >= uFrom) {
+            uOffset = L::BO(L::BO(uOffset) - uDelta);
+        }
+    };
+
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        uint32_t uOffset = m_arrLoadCommands[i].uOffset;
+        switch (m_arrLoadCommands[i].uCmd) {
+            case L::uSegmentCmd: {
+                segment_t *seglc = m_view.At<segment_t>(uOffset);
+                if (0 != seglc->filesize && L::BO(seglc->fileoff) >= uFrom) {
+                    seglc->fileoff = L::BO(L::BO(seglc->fileoff) - uDelta);
+                }
+                section_t *sect = m_view.At<section_t>(uOffset + sizeof(segment_t), L::BO(seglc->nsects));
+                for (uint32_t j = 0; j < L::BO(seglc->nsects); j++) {
+                    Shift(sect[j].offset);
+                    Shift(sect[j].reloff);
                 }
+            } break;
+            case LC_SYMTAB: {
+                symtab_command *symlc = m_view.At<symtab_command>(uOffset);
+                Shift(symlc->symoff);
+                Shift(symlc->stroff);
+            } break;
+            case LC_DYSYMTAB: {
+                dysymtab_command *dysymlc = m_view.At<dysymtab_command>(uOffset);
+                Shift(dysymlc->tocoff);
+                Shift(dysymlc->modtaboff);
+                Shift(dysymlc->extrefsymoff);
+                Shift(dysymlc->indirectsymoff);
+                Shift(dysymlc->extreloff);
+                Shift(dysymlc->locreloff);
+            } break;
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                dyld_info_command *infolc = m_view.At<dyld_info_command>(uOffset);
+                Shift(infolc->rebase_off);
+                Shift(infolc->bind_off);
+                Shift(infolc->weak_bind_off);
+                Shift(infolc->lazy_bind_off);
+                Shift(infolc->export_off);
+            } break;
+            case LC_CODE_SIGNATURE:
+            case LC_SEGMENT_SPLIT_INFO:
+            case LC_FUNCTION_STARTS:
+            case LC_DATA_IN_CODE:
+            case LC_DYLIB_CODE_SIGN_DRS:
+            case LC_LINKER_OPTIMIZATION_HINT:
+            case LC_DYLD_EXPORTS_TRIE:
+            case LC_DYLD_CHAINED_FIXUPS: {
+                Shift(m_view.At<linkedit_data_command>(uOffset)->dataoff);
+            } break;
+            case LC_ENCRYPTION_INFO:
+            case LC_ENCRYPTION_INFO_64: {
+                Shift(m_view.At<encryption_info_command>(uOffset)->cryptoff);
+            } break;
+        }
+    }
+}
 
-                memcpy(pLoadCommand + dylibPathOffset, newPath, newPathLength);
-                memset(pLoadCommand + dylibPathOffset + newPathLength, 0, newPathPadding);
+template <class L>
+uint32_t ZArchO::StripBitcode() {
+    typedef typename L::segment_t segment_t;
+    typedef typename L::section_t section_t;
+
+    segment_t *pLLVMSegment = NULL;
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        if (L::uSegmentCmd == m_arrLoadCommands[i].uCmd) {
+            segment_t *seglc = m_view.At<segment_t>(m_arrLoadCommands[i].uOffset);
+            if (0 == strncmp("__LLVM", seglc->segname, sizeof(seglc->segname))) {
+                pLLVMSegment = seglc;
+            }
+        }
+    }
 
-                ZLog::PrintV(">>> Dylib Path Changed: %s -> %s\n", oldPath, newPath);
+    if (NULL == pLLVMSegment || 0 == pLLVMSegment->filesize) {
+        return 0;
+    }
 
-                pathChanged = true;
+    uint64_t uStart = L::BO(pLLVMSegment->fileoff);
+    uint64_t uSize = L::BO(pLLVMSegment->filesize);
+    uint64_t uEnd = uStart + uSize;
+    if (!m_view.Contains(uStart, uSize)) {
+        ZLog::Warn(">>> Invalid __LLVM Segment!\n");
+        return 0;
+    }
+
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) { // nothing else may live inside the bitcode range
+        if (L::uSegmentCmd == m_arrLoadCommands[i].uCmd) {
+            segment_t *seglc = m_view.At<segment_t>(m_arrLoadCommands[i].uOffset);
+            uint64_t uFileOff = L::BO(seglc->fileoff);
+            uint64_t uFileSize = L::BO(seglc->filesize);
+            if (seglc != pLLVMSegment && uFileSize > 0 && uFileOff < uEnd && uFileOff + uFileSize > uStart) {
+                ZLog::Warn(">>> __LLVM Segment Overlaps Another Segment!\n");
+                return 0;
             }
         }
-
-        pLoadCommand += BO(plc->cmdsize);
     }
 
-    if (!pathChanged) {
-        ZLog::PrintV(">>> Old Dylib Path Not Found: %s\n", oldPath);
+    // later segments keep their vmaddr, so their file offsets may only move by whole 16K pages
+    // to stay congruent with it. what is left of the bitcode below a page is zeroed in place.
+    uint32_t uShift = (uint32_t)(uSize & ~(uint64_t)0x3FFF);
+    if (0 == uShift) { // nothing would be saved, the slice is left as it is
+        ZLog::PrintV(">>> Bitcode Under One Page, Kept: %llu Bytes\n", (unsigned long long)uSize);
+        return 0;
+    }
+    memmove(m_pBase + uStart, m_pBase + uStart + uShift, m_uLength - uStart - uShift);
+    memset(m_pBase + uStart, 0, (size_t)(uSize - uShift));
+    memset(m_pBase + m_uLength - uShift, 0, uShift);
+    ShiftFileOffsets<L>((uint32_t)uEnd, uShift);
+
+    // the segment command stays as an empty placeholder, segment ordinals in the fixup and bind info
+    // must not change. its vm range is left as zero-fill memory.
+    pLLVMSegment->fileoff = 0;
+    pLLVMSegment->filesize = 0;
+    section_t *sect = reinterpret_cast<section_t *>(pLLVMSegment + 1);
+    for (uint32_t j = 0; j < L::BO(pLLVMSegment->nsects); j++) {
+        sect[j].offset = 0;
+        sect[j].size = 0;
     }
 
-    return pathChanged;
+    ZLog::PrintV(">>> Bitcode Stripped: %u Bytes\n", uShift);
+    return uShift;
 }
 
-void ZArchO::uninstallDylibs(const set<string> &dylibNames) {
-    uint8_t *pLoadCommand = m_pBase + m_uHeaderSize;
-    uint32_t old_load_command_size = m_pHeader->sizeofcmds;
-    uint8_t *new_load_command_data = (uint8_t *)malloc(old_load_command_size);
-    memset(new_load_command_data, 0, old_load_command_size);
-    uint32_t new_load_command_size = 0;
-    uint32_t clear_num = 0;
-    uint32_t clear_data_size = 0;
-    for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-        load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-        uint32_t load_command_size = BO(plc->cmdsize);
-        if (LC_LOAD_DYLIB == BO(plc->cmd) || LC_LOAD_WEAK_DYLIB == BO(plc->cmd)) {
-            dylib_command *dlc = reinterpret_cast<dylib_command *>(pLoadCommand);
-            const char *szDyLib = reinterpret_cast<const char *>(pLoadCommand + BO(dlc->dylib.name.offset));
-            string dylibName = szDyLib;
-            if (dylibNames.count(dylibName) > 0) {
-                ZLog::PrintV("\t\t\t%s\tclear\n", szDyLib);
-                clear_num++;
-                clear_data_size += load_command_size;
-                pLoadCommand += BO(plc->cmdsize);
-                continue;
+template <class L>
+uint32_t ZArchO::StripLocalSymbols() {
+    typedef typename L::segment_t segment_t;
+    typedef typename L::nlist_t nlist_t;
+
+    symtab_command *symlc = NULL;
+    dysymtab_command *dysymlc = NULL;
+    for (size_t i = 0; i < m_arrLoadCommands.size(); i++) {
+        if (LC_SYMTAB == m_arrLoadCommands[i].uCmd) {
+            symlc = m_view.At<symtab_command>(m_arrLoadCommands[i].uOffset);
+        } else if (LC_DYSYMTAB == m_arrLoadCommands[i].uCmd) {
+            dysymlc = m_view.At<dysymtab_command>(m_arrLoadCommands[i].uOffset);
+        }
+    }
+
+    if (NULL == symlc || NULL == dysymlc || 0 == L::BO(dysymlc->nlocalsym)) {
+        return 0;
+    }
+
+    // only linked images with the usual local, defined, undefined partition are handled.
+    // the legacy tables of object files refer to symbols by index and are left alone.
+    uint32_t uSymOff = L::BO(symlc->symoff);
+    uint32_t uSyms = L::BO(symlc->nsyms);
+    uint32_t uStrOff = L::BO(symlc->stroff);
+    uint32_t uStrSize = L::BO(symlc->strsize);
+    uint32_t uLocals = L::BO(dysymlc->nlocalsym);
+    if (0 != L::BO(dysymlc->ilocalsym) || uLocals != L::BO(dysymlc->iextdefsym) ||
+        uLocals + L::BO(dysymlc->nextdefsym) != L::BO(dysymlc->iundefsym) ||
+        L::BO(dysymlc->iundefsym) + L::BO(dysymlc->nundefsym) != uSyms || 0 != dysymlc->ntoc ||
+        0 != dysymlc->nmodtab || 0 != dysymlc->nextrefsyms || 0 != dysymlc->nextrel || 0 != dysymlc->nlocrel) {
+        ZLog::Warn(">>> Unsupported Symbol Table Layout, Symbols Not Stripped!\n");
+        return 0;
+    }
+
+    nlist_t *pSymbols = m_view.At<nlist_t>(uSymOff, uSyms);
+    uint32_t *pIndirects = m_view.At<uint32_t>(L::BO(dysymlc->indirectsymoff), L::BO(dysymlc->nindirectsyms));
+    uint32_t uIndirects = L::BO(dysymlc->nindirectsyms);
+    if (NULL == pSymbols || NULL == pIndirects || !m_view.Contains(uStrOff, uStrSize) ||
+        uSymOff + uSyms * sizeof(nlist_t) > uStrOff) {
+        ZLog::Warn(">>> Invalid Symbol Table!\n");
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < uIndirects; i++) {
+        uint32_t uIndex = L::BO(pIndirects[i]);
+        if (0 == (uIndex & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS)) && uIndex < uLocals) {
+            ZLog::Warn(">>> Indirect Symbol Refers To Local Symbol, Symbols Not Stripped!\n");
+            return 0;
+        }
+    }
+
+    // rebuild the kept symbols and a string table holding only their names, " \0" first like ld64
+    vector<nlist_t> arrSymbols(pSymbols + uLocals, pSymbols + uSyms);
+    string strStrings(" ", 2);
+    map<string, uint32_t> mapStrings;
+    for (size_t i = 0; i < arrSymbols.size(); i++) {
+        uint32_t uStrIndex = L::BO(arrSymbols[i].n_strx);
+        if (0 != uStrIndex && uStrIndex < uStrSize) {
+            string strName = m_view.String(uStrOff + uStrIndex, uStrOff + uStrSize);
+            map<string, uint32_t>::iterator it = mapStrings.find(strName);
+            if (it == mapStrings.end()) {
+                it = mapStrings.insert(make_pair(strName, (uint32_t)strStrings.size())).first;
+                strStrings.append(strName.c_str(), strName.size() + 1);
             }
-            ZLog::PrintV("\t\t\t%s\n", szDyLib);
+            arrSymbols[i].n_strx = L::BO(it->second);
+        }
+    }
+
+    // both tables shrink by whole 16-byte units, which keeps everything behind them aligned
+    uint32_t uSymSize = uSyms * sizeof(nlist_t);
+    uint32_t uSymShrink = (uint32_t)((uLocals * sizeof(nlist_t)) & ~0xF);
+    uint32_t uStrShrink = 0;
+    if (uStrSize > strStrings.size()) {
+        uStrShrink = (uint32_t)((uStrSize - strStrings.size()) & ~0xF);
+        strStrings.append(uStrSize - uStrShrink - strStrings.size(), 0);
+    } else { // nothing to gain, keep the original strings
+        strStrings.assign(m_view.At<char>(uStrOff, uStrSize), uStrSize);
+        copy(pSymbols + uLocals, pSymbols + uSyms, arrSymbols.begin());
+    }
+
+    for (uint32_t i = 0; i < uIndirects; i++) {
+        uint32_t uIndex = L::BO(pIndirects[i]);
+        if (0 == (uIndex & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS))) {
+            pIndirects[i] = L::BO(uIndex - uLocals);
         }
-        new_load_command_size += load_command_size;
-        memcpy(new_load_command_data, pLoadCommand, load_command_size);
-        new_load_command_data += load_command_size;
-        pLoadCommand += BO(plc->cmdsize);
-    }
-    pLoadCommand -= m_pHeader->sizeofcmds;
-
-    m_pHeader->ncmds -= clear_num;
-    m_pHeader->sizeofcmds -= clear_data_size;
-    new_load_command_data -= new_load_command_size;
-    memset(pLoadCommand, 0, old_load_command_size);
-    memcpy(pLoadCommand, new_load_command_data, new_load_command_size);
-    free(new_load_command_data);
+    }
+
+    // the string table lies behind the symbols, so its tail moves first
+    uint32_t uSymEnd = uSymOff + uSymSize;
+    uint32_t uStrEnd = uStrOff + uStrSize;
+    memcpy(m_pBase + uStrOff, strStrings.data(), strStrings.size());
+    memmove(m_pBase + uStrEnd - uStrShrink, m_pBase + uStrEnd, m_uLength - uStrEnd);
+    memset(pSymbols, 0, uSymSize - uSymShrink);
+    copy(arrSymbols.begin(), arrSymbols.end(), pSymbols);
+    memmove(m_pBase + uSymEnd - uSymShrink, m_pBase + uSymEnd, m_uLength - uStrShrink - uSymEnd);
+    memset(m_pBase + m_uLength - uSymShrink - uStrShrink, 0, uSymShrink + uStrShrink);
+
+    symlc->nsyms = L::BO((uint32_t)arrSymbols.size());
+    symlc->strsize = L::BO((uint32_t)strStrings.size());
+    dysymlc->nlocalsym = 0;
+    dysymlc->iextdefsym = 0;
+    dysymlc->iundefsym = dysymlc->nextdefsym;
+    ShiftFileOffsets<L>(uStrEnd, uStrShrink);
+    ShiftFileOffsets<L>(uSymEnd, uSymShrink);
+
+    // both tables lie in __LINKEDIT, which ends with the slice
+    segment_t *seglc = reinterpret_cast<segment_t *>(m_pLinkEditSegment);
+    seglc->filesize = L::BO(L::BO(seglc->filesize) - (uSymShrink + uStrShrink));
+
+    ZLog::PrintV(">>> Local Symbols Stripped: %u Symbols, %u Bytes\n", uLocals, uSymShrink + uStrShrink);
+    return uSymShrink + uStrShrink;
 }
 
-std::vector<std::string> ZArchO::ListDylibs() {
-    std::vector<std::string> dylibList;
-    uint8_t *pLoadCommand = m_pBase + m_uHeaderSize;
-
-    for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-        load_command *plc = reinterpret_cast<load_command *>(pLoadCommand);
-        if (LC_LOAD_DYLIB == BO(plc->cmd) || LC_LOAD_WEAK_DYLIB == BO(plc->cmd)) {
-            dylib_command *dlc = reinterpret_cast<dylib_command *>(pLoadCommand);
-            const char *szDyLib = reinterpret_cast<const char *>(pLoadCommand + BO(dlc->dylib.name.offset));
-            dylibList.push_back(std::string(szDyLib));
+bool ZArchO::Strip(uint32_t uFlags, uint32_t &uNewLength) {
+    uNewLength = m_uLength;
+    if (NULL == m_pHeader || m_bHeaderOnly || NULL == m_pLinkEditSegment) {
+        return false;
+    }
+
+    if (uFlags & E_STRIP_BITCODE) {
+        uint32_t uBitcode = (this->*m_pLayoutOps->pfnStripBitcode)();
+        if (uBitcode > 0 && !Init(m_pBase, m_uLength - uBitcode)) {
+            return false;
         }
-        pLoadCommand += BO(plc->cmdsize);
     }
 
-    return dylibList;
+    if (uFlags & E_STRIP_LOCAL_SYMBOLS) {
+        uint32_t uSymbols = (this->*m_pLayoutOps->pfnStripLocalSymbols)();
+        if (uSymbols > 0 && !Init(m_pBase, m_uLength - uSymbols)) {
+            return false;
+        }
+    }
+
+    uNewLength = m_uLength;
+    return true;
 }
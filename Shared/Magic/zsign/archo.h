@@ -9,8 +9,53 @@
 
 #pragma once
 #include "common/mach-o.h"
+#include "common/machoview.h"
 #include "openssl.h"
 #include <set>
+
+/**
+ * A load command as recorded by the load-command index of a slice
+ */
+struct ZLoadCommand {
+    /** Command type in host byte order */
+    uint32_t uCmd;
+
+    /** Command size in host byte order */
+    uint32_t uSize;
+
+    /** Offset of the command from the slice base */
+    uint32_t uOffset;
+
+    /** Path of dylib and rpath commands, empty for others */
+    string strPath;
+};
+
+/**
+ * One edit of a load-command transaction
+ */
+struct ZLoadCommandEdit {
+    enum eEditType {
+        E_INJECT_DYLIB,
+        E_INJECT_WEAK_DYLIB,
+        E_REMOVE_DYLIB,
+        E_RENAME_DYLIB,
+        E_ADD_RPATH,
+        E_REMOVE_RPATH,
+    };
+
+    int nType;
+    string strPath;
+    string strNewPath; // E_RENAME_DYLIB only
+};
+
+/**
+ * Payloads removed by ZArchO::Strip
+ */
+enum eStripFlags {
+    E_STRIP_BITCODE = 0x1,       // __LLVM bitcode segment
+    E_STRIP_LOCAL_SYMBOLS = 0x2, // non-external symbols and their names
+};
+
 /**
  * Class for manipulating Mach-O architecture files
  */
@@ -30,6 +75,18 @@ public:
      */
     bool Init(uint8_t *pBase, uint32_t uLength);
 
+    /**
+     * Initializes the object from a copy of the header and load commands only
+     *
+     * Section contents and the code signature are not read; their locations are
+     * recorded in m_uInfoPlistOffset/m_uInfoPlistSize and m_uSignDataSize instead.
+     *
+     * @param pHeader Pointer to the header and load commands
+     * @param uLength Length of the whole slice in bytes
+     * @return true if initialization succeeded, false otherwise
+     */
+    bool InitHeader(uint8_t *pHeader, uint32_t uLength);
+
 public:
     /**
      * Signs the Mach-O binary
@@ -39,17 +96,53 @@ public:
      * @param strBundleId Bundle identifier
      * @param strInfoPlistSHA1 SHA1 hash of the Info.plist file
      * @param strInfoPlistSHA256 SHA256 hash of the Info.plist file
-     * @param strCodeResourcesData Code resources data
+     * @param strCodeResourcesSHA1 SHA1 hash of the CodeResources file, empty if there is none
+     * @param strCodeResourcesSHA256 SHA256 hash of the CodeResources file, empty if there is none
      * @return true if signing succeeded, false otherwise
      */
     bool Sign(ZSignAsset *pSignAsset, bool bForce, const string &strBundleId, const string &strInfoPlistSHA1,
-              const string &strInfoPlistSHA256, const string &strCodeResourcesData);
+              const string &strInfoPlistSHA256, const string &strCodeResourcesSHA1,
+              const string &strCodeResourcesSHA256);
     
     /**
      * Prints information about the Mach-O binary
      */
     void PrintInfo() const;
+
+    /**
+     * Verifies the code signature against the slice contents
+     *
+     * Every CodeDirectory is checked: code slots against the pages, special slots against the
+     * given data and the blobs in the signature, and the CMS CDHashes against the CodeDirectories.
+     *
+     * @param strInfoPlistData Info.plist bound by the signature, empty for the embedded __info_plist
+     * @param strCodeResourcesData CodeResources bound by the signature, empty if none
+     * @param jvOutput Reference to the report, "arch", "valid", "signed", "cdhashes" and "errors"
+     * @return true if the signature is valid, false otherwise
+     */
+    bool Verify(const string &strInfoPlistData, const string &strCodeResourcesData, JValue &jvOutput) const;
+
+    /**
+     * Checks whether the existing signature is still what signing with pSignAsset would produce: signed with a
+     * CMS blob by the same identity and team, code limit equal to the current code length, Info.plist and
+     * CodeResources slots matching the given data, and the same requirements and entitlements
+     *
+     * @param pSignAsset Signing assets the slice would be signed with
+     * @param strBundleId Bundle identifier the slice would be signed with
+     * @param strInfoPlistData Info.plist data to check, the embedded __info_plist if empty
+     * @param strCodeResourcesData CodeResources data to check, the slot must be empty if this is empty
+     * @return true if the slice can be left as it is, false otherwise
+     */
+    bool IsSignedBy(ZSignAsset *pSignAsset, const string &strBundleId, const string &strInfoPlistData,
+                    const string &strCodeResourcesData);
     
+    /**
+     * Gets the architecture name of the slice, e.g. "arm64" or "arm64e"
+     *
+     * @return String representation of the architecture, "unknown" if not recognized
+     */
+    const char *GetArchName() const;
+
     /**
      * Checks if the binary is an executable
      *
@@ -68,12 +161,15 @@ public:
     bool InjectDyLib(bool bWeakInject, const char *szDyLibPath, bool &bCreate);
     
     /**
-     * Reallocates code signing space
+     * Reallocates code signing space by rewriting the load commands in place
+     *
+     * The slice itself isn't resized; the caller must grow it to the returned length
+     * and zero-fill the new tail before signing.
      *
-     * @param strNewFile Path to the new file
-     * @return The size of the reallocated space
+     * @param bDryRun Only compute the new length, the load commands are left as they are
+     * @return The new length of the slice, or 0 on failure
      */
-    uint32_t ReallocCodeSignSpace(const string &strNewFile);
+    uint32_t ReallocCodeSignSpace(bool bDryRun = false);
     
     /**
      * Uninstalls dylibs from the binary
@@ -98,6 +194,42 @@ public:
      */
     std::vector<std::string> ListDylibs();
 
+    /**
+     * Applies a list of load-command edits in one pass
+     *
+     * The load commands are rebuilt from the index into a scratch buffer and only written
+     * back if every edit fits, so a failed transaction leaves the slice untouched.
+     * Removing or renaming a path that isn't present is not an error.
+     *
+     * @param arrEdits Edits to apply
+     * @param bChanged Reference to a bool that will be set to true if the load commands changed
+     * @param bDryRun Only check that the edits fit, the slice and bChanged are left as they are
+     * @return true if all edits were applied, false otherwise
+     */
+    bool ApplyEdits(const vector<ZLoadCommandEdit> &arrEdits, bool &bChanged, bool bDryRun = false);
+
+    /**
+     * Finds a dylib or rpath command in the load-command index
+     *
+     * @param uCmd Command type, LC_LOAD_DYLIB also matches LC_LOAD_WEAK_DYLIB
+     * @param strPath Path to look for
+     * @return The indexed command, or NULL if not found
+     */
+    const ZLoadCommand *FindLoadCommand(uint32_t uCmd, const string &strPath) const;
+
+    /**
+     * Strips payloads that are never loaded at runtime, in place
+     *
+     * Everything behind a removed range is moved down and the offsets in the load commands
+     * are fixed up. The slice isn't resized; the caller must shrink it to the returned length.
+     * The existing code signature is stale afterwards, the slice must be signed with bForce.
+     *
+     * @param uFlags eStripFlags to apply
+     * @param uNewLength Reference to the new length of the slice
+     * @return true if stripping succeeded, false otherwise
+     */
+    bool Strip(uint32_t uFlags, uint32_t &uNewLength);
+
 private:
     /**
      * Byte-order swaps a value if needed
@@ -123,7 +255,92 @@ private:
      * @return String representation of the architecture
      */
     static const char *GetArch(int cpuType, int cpuSubType);
+
+    /**
+     * Specializations of the layout-dependent members for one ZMachOLayout, selected once by Init
+     */
+    struct ZLayoutOps;
+
+    /**
+     * Gets the specializations for a layout
+     *
+     * @return Table of member functions instantiated for L
+     */
+    template <class L>
+    static const ZLayoutOps *GetLayoutOps();
+
+    /**
+     * Walks the load commands and fills the load-command index and the cached segment pointers
+     *
+     * @return true if every command lies inside the slice, false otherwise
+     */
+    template <class L>
+    bool ParseLoadCommands();
+
+    /**
+     * Patches __LINKEDIT and LC_CODE_SIGNATURE for a slice grown to uNewLength
+     *
+     * @param uNewLength New length of the slice
+     */
+    template <class L>
+    void GrowCodeSignSpace(uint32_t uNewLength);
+
+    /**
+     * Rebuilds the load commands with a list of edits applied, see ApplyEdits
+     *
+     * @param arrEdits Edits to apply
+     * @param bChanged Reference to a bool that will be set to true if the load commands changed
+     * @param bDryRun Only check that the edits fit
+     * @return true if all edits were applied, false otherwise
+     */
+    template <class L>
+    bool RewriteLoadCommands(const vector<ZLoadCommandEdit> &arrEdits, bool &bChanged, bool bDryRun);
+
+    /**
+     * Builds a dylib or rpath load command in the slice byte order
+     *
+     * @param uCmd Command type
+     * @param strPath Path stored in the command
+     * @param pTemplate Existing dylib command to copy the versions from, may be NULL
+     * @return The encoded command
+     */
+    template <class L>
+    string BuildPathCommand(uint32_t uCmd, const string &strPath, const dylib_command *pTemplate) const;
+
+    /**
+     * Moves every file offset in the load commands at or past uFrom down by uDelta
+     *
+     * @param uFrom First offset to move
+     * @param uDelta Distance to move
+     */
+    template <class L>
+    void ShiftFileOffsets(uint32_t uFrom, uint32_t uDelta);
+
+    /**
+     * Removes the contents of the __LLVM segment, keeping its command as an empty placeholder
+     *
+     * @return Number of bytes removed from the slice
+     */
+    template <class L>
+    uint32_t StripBitcode();
+
+    /**
+     * Removes the local symbols and rebuilds the string table for the remaining ones
+     *
+     * @return Number of bytes removed from the slice
+     */
+    template <class L>
+    uint32_t StripLocalSymbols();
     
+    /**
+     * Builds the entitlements slots for the binary, an empty dictionary and no DER blob unless it's an executable
+     *
+     * @param pSignAsset Signing assets to use
+     * @param strEntitlementsSlot Reference to output entitlements slot
+     * @param strDerEntitlementsSlot Reference to output DER entitlements slot
+     */
+    void BuildEntitlementsSlots(ZSignAsset *pSignAsset, string &strEntitlementsSlot, string &strDerEntitlementsSlot);
+
     /**
      * Builds code signature for the binary
      *
@@ -187,4 +404,29 @@ public:
     
     /** Size of the Mach-O header */
     uint32_t m_uHeaderSize;
+
+    /** Whether only the header and load commands are available */
+    bool m_bHeaderOnly;
+
+    /** Offset of the embedded Info.plist section in the slice */
+    uint32_t m_uInfoPlistOffset;
+
+    /** Size of the embedded Info.plist section */
+    uint32_t m_uInfoPlistSize;
+
+    /** Size of the code signature data from LC_CODE_SIGNATURE */
+    uint32_t m_uSignDataSize;
+
+    /** Size of the __TEXT segment, used as the CodeDirectory exec segment limit */
+    uint64_t m_uExecSegLimit;
+
+    /** Load commands parsed once by Init, rebuilt after every edit */
+    vector<ZLoadCommand> m_arrLoadCommands;
+
+private:
+    /** Bounds-checked view of the slice, only the header and load commands when header-only */
+    ZMachOView m_view;
+
+    /** Specializations for the byte order and bitness of the slice */
+    const ZLayoutOps *m_pLayoutOps;
 };
@@ -13,13 +13,94 @@
 #include "bundle.h"
 #include "common/base64.h"
 #include "common/common.h"
+#include "common/fileio.h"
 #include "macho.h"
 #include "sys/stat.h"
 #include "sys/types.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// runs fn(0..sCount-1) on a small worker pool, for per-file work over a whole bundle
+static void ParallelFor(size_t sCount, const function<void(size_t)> &fn) {
+    uint32_t uThreads = thread::hardware_concurrency();
+    uThreads = (uThreads > 8) ? 8 : ((uThreads < 1) ? 1 : uThreads);
+    uThreads = (uThreads > sCount) ? (uint32_t)sCount : uThreads;
+
+    atomic<size_t> uNext(0);
+    vector<thread> arrWorkers;
+    for (uint32_t i = 0; i < uThreads; i++) {
+        arrWorkers.push_back(thread([&] {
+            for (size_t j = uNext++; j < sCount; j = uNext++) {
+                fn(j);
+            }
+        }));
+    }
+    for (size_t i = 0; i < arrWorkers.size(); i++) {
+        arrWorkers[i].join();
+    }
+}
+
+// hashes a batch like SHASumBase64File did one file at a time: a file that can't be read is logged
+// by SHASumFiles and gets the digests of no data, it doesn't fail the whole seal
+static void SHASumBase64FilesOrEmpty(const vector<string> &arrFiles, vector<string> &arrSHA1Base64,
+                                     vector<string> &arrSHA256Base64) {
+    if (SHASumBase64Files(arrFiles, arrSHA1Base64, arrSHA256Base64)) {
+        return;
+    }
+
+    string strEmptySHA1Base64;
+    string strEmptySHA256Base64;
+    SHASumBase64("", strEmptySHA1Base64, strEmptySHA256Base64);
+    for (size_t i = 0; i < arrFiles.size(); i++) {
+        if (arrSHA1Base64[i].empty() || arrSHA256Base64[i].empty()) {
+            arrSHA1Base64[i] = strEmptySHA1Base64;
+            arrSHA256Base64[i] = strEmptySHA256Base64;
+        }
+    }
+}
+
+// realpath of strPath, for a path that doesn't exist yet the realpath of its nearest existing parent
+// with the remaining components appended
+static string ResolvePath(const string &strPath) {
+    string strTrimmed = strPath;
+    while (strTrimmed.size() > 1 && '/' == strTrimmed[strTrimmed.size() - 1]) {
+        strTrimmed.erase(strTrimmed.size() - 1);
+    }
+
+    char szPath[PATH_MAX] = {0};
+    if (NULL != realpath(strTrimmed.c_str(), szPath)) {
+        return szPath;
+    }
+
+    size_t pos = strTrimmed.rfind('/');
+    string strParent = (string::npos == pos) ? "." : ((0 == pos) ? "/" : strTrimmed.substr(0, pos));
+    string strName = (string::npos == pos) ? strTrimmed : strTrimmed.substr(pos + 1);
+    string strResolved = ResolvePath(strParent);
+    if (strName.empty() || "." == strName) {
+        return strResolved;
+    }
+    if (".." == strName) {
+        pos = strResolved.rfind('/');
+        return (0 == pos || string::npos == pos) ? "/" : strResolved.substr(0, pos);
+    }
+    return ("/" == strResolved) ? ("/" + strName) : (strResolved + "/" + strName);
+}
+
+// true if the resolved paths are the same folder or one lies inside the other
+static bool IsPathOverlapped(const string &strPath1, const string &strPath2) {
+    const string &strShort = (strPath1.size() <= strPath2.size()) ? strPath1 : strPath2;
+    const string &strLong = (strPath1.size() <= strPath2.size()) ? strPath2 : strPath1;
+    if (0 != strLong.compare(0, strShort.size(), strShort)) {
+        return false;
+    }
+    return (strLong.size() == strShort.size() || "/" == strShort || '/' == strLong[strShort.size()]);
+}
 
 ZAppBundle::ZAppBundle() {
     m_pSignAsset = NULL;
     m_bForceSign = false;
+    m_bReuseSigned = false;
     m_bWeakInject = false;
 }
 
@@ -65,14 +146,24 @@ bool ZAppBundle::FindAppFolder(const string &strFolder, string &strAppFolder) {
 }
 
 bool ZAppBundle::GetSignFolderInfo(const string &strFolder, JValue &jvNode, bool bGetName) {
-    JValue jvInfo;
     string strInfoPlistData;
     string strInfoPlistPath = strFolder + "/Info.plist";
     ReadFile(strInfoPlistPath.c_str(), strInfoPlistData);
-    jvInfo.readPList(strInfoPlistData);
-    string strBundleId = jvInfo["CFBundleIdentifier"];
-    string strBundleExe = jvInfo["CFBundleExecutable"];
-    string strBundleVersion = jvInfo["CFBundleVersion"];
+
+    // shipped apps mostly carry a binary Info.plist, which is queried where it lies
+    JValue jvInfo;
+    PView pvInfo(strInfoPlistData.data(), strInfoPlistData.size());
+    if (!pvInfo.isDict()) {
+        jvInfo.readPListKeys(strInfoPlistData, {"CFBundleIdentifier", "CFBundleExecutable", "CFBundleVersion",
+                                                "CFBundleDisplayName", "CFBundleName"});
+    }
+    auto InfoString = [&](const char *szKey) -> string {
+        return pvInfo.isDict() ? pvInfo[szKey].asString() : jvInfo[szKey].asString();
+    };
+
+    string strBundleId = InfoString("CFBundleIdentifier");
+    string strBundleExe = InfoString("CFBundleExecutable");
+    string strBundleVersion = InfoString("CFBundleVersion");
     if (strBundleId.empty() || strBundleExe.empty()) {
         return false;
     }
@@ -88,9 +179,9 @@ bool ZAppBundle::GetSignFolderInfo(const string &strFolder, JValue &jvNode, bool
     jvNode["sha2"] = strInfoPlistSHA256Base64;
 
     if (bGetName) {
-        string strBundleName = jvInfo["CFBundleDisplayName"];
+        string strBundleName = InfoString("CFBundleDisplayName");
         if (strBundleName.empty()) {
-            strBundleName = jvInfo["CFBundleName"].asCString();
+            strBundleName = InfoString("CFBundleName");
         }
         jvNode["name"] = strBundleName;
     }
@@ -112,7 +203,7 @@ bool ZAppBundle::GetObjectsToSign(const string &strFolder, JValue &jvInfo) {
                         jvNode["path"] = strNode.substr(m_strAppFolder.size() + 1);
                         if (GetSignFolderInfo(strNode, jvNode)) {
                             if (GetObjectsToSign(strNode, jvNode)) {
-                                jvInfo["folders"].push_back(jvNode);
+                                jvInfo["folders"].push_back(std::move(jvNode));
                             }
                         }
                     } else {
@@ -163,17 +254,48 @@ bool ZAppBundle::GenerateCodeResources(const string &strFolder, JValue &jvCodeRe
     jvInfo.readPListFile(strInfoPlistPath.c_str());
     string strBundleExe = jvInfo["CFBundleExecutable"];
     setFiles.erase(strBundleExe);
-    setFiles.erase("_CodeSignature/CodeResources");
+    // the seal itself isn't sealed, whatever is left of a previous signature is replaced anyway
+    setFiles.erase(setFiles.lower_bound("_CodeSignature/"), setFiles.lower_bound("_CodeSignature0"));
+
+    JValue &jvFiles = jvCodeRes["files"];
+    JValue &jvFiles2 = jvCodeRes["files2"];
+    jvFiles = JValue(JValue::E_OBJECT);
+    jvFiles2 = JValue(JValue::E_OBJECT);
+
+    vector<string> arrKeys(setFiles.begin(), setFiles.end());
+    vector<string> arrFiles;
+    for (size_t i = 0; i < arrKeys.size(); i++) {
+        arrFiles.push_back(strFolder + "/" + arrKeys[i]);
+    }
 
-    jvCodeRes["files"] = JValue(JValue::E_OBJECT);
-    jvCodeRes["files2"] = JValue(JValue::E_OBJECT);
+    // plists SignFolder patched were hashed as they were written
+    vector<string> arrSHA1Base64(arrFiles.size());
+    vector<string> arrSHA256Base64(arrFiles.size());
+    vector<string> arrHashFiles;
+    vector<size_t> arrHashIndexes;
+    for (size_t i = 0; i < arrFiles.size(); i++) {
+        map<string, pair<string, string>>::const_iterator it = m_mapPatchedFiles.find(arrFiles[i]);
+        if (m_mapPatchedFiles.end() != it) {
+            arrSHA1Base64[i] = it->second.first;
+            arrSHA256Base64[i] = it->second.second;
+        } else {
+            arrHashFiles.push_back(arrFiles[i]);
+            arrHashIndexes.push_back(i);
+        }
+    }
 
-    for (set<string>::iterator it = setFiles.begin(); it != setFiles.end(); ++it) {
-        string strKey = *it;
-        string strFile = strFolder + "/" + strKey;
-        string strFileSHA1Base64;
-        string strFileSHA256Base64;
-        SHASumBase64File(strFile.c_str(), strFileSHA1Base64, strFileSHA256Base64);
+    vector<string> arrHashSHA1Base64;
+    vector<string> arrHashSHA256Base64;
+    SHASumBase64FilesOrEmpty(arrHashFiles, arrHashSHA1Base64, arrHashSHA256Base64);
+    for (size_t i = 0; i < arrHashIndexes.size(); i++) {
+        arrSHA1Base64[arrHashIndexes[i]] = arrHashSHA1Base64[i];
+        arrSHA256Base64[arrHashIndexes[i]] = arrHashSHA256Base64[i];
+    }
+
+    for (size_t i = 0; i < arrKeys.size(); i++) {
+        const string &strKey = arrKeys[i];
+        const string &strFileSHA1Base64 = arrSHA1Base64[i];
+        const string &strFileSHA256Base64 = arrSHA256Base64[i];
 
         bool bomit1 = false;
         bool bomit2 = false;
@@ -192,19 +314,21 @@ bool ZAppBundle::GenerateCodeResources(const string &strFolder, JValue &jvCodeRe
         }
 
         if (!bomit1) {
+            JValue &jvFile = jvFiles[strKey];
             if (string::npos != strKey.rfind(".lproj/")) {
-                jvCodeRes["files"][strKey]["hash"] = "data:" + strFileSHA1Base64;
-                jvCodeRes["files"][strKey]["optional"] = true;
+                jvFile["hash"] = "data:" + strFileSHA1Base64;
+                jvFile["optional"] = true;
             } else {
-                jvCodeRes["files"][strKey] = "data:" + strFileSHA1Base64;
+                jvFile = "data:" + strFileSHA1Base64;
             }
         }
 
         if (!bomit2) {
-            jvCodeRes["files2"][strKey]["hash"] = "data:" + strFileSHA1Base64;
-            jvCodeRes["files2"][strKey]["hash2"] = "data:" + strFileSHA256Base64;
+            JValue &jvFile2 = jvFiles2[strKey];
+            jvFile2["hash"] = "data:" + strFileSHA1Base64;
+            jvFile2["hash2"] = "data:" + strFileSHA256Base64;
             if (string::npos != strKey.rfind(".lproj/")) {
-                jvCodeRes["files2"][strKey]["optional"] = true;
+                jvFile2["optional"] = true;
             }
         }
     }
@@ -275,48 +399,53 @@ void ZAppBundle::GetNodeChangedFiles(JValue &jvNode, bool dontGenerateEmbeddedMo
 }
 
 bool ZAppBundle::SignNode(JValue &jvNode) {
+    // nested code whose signature is still valid for this identity is left untouched, a bundle only if
+    // everything nested in it was left untouched too
+    string strFolder = jvNode["path"];
+    bool bReuse = m_bReuseSigned && "/" != strFolder;
+
     if (jvNode.has("folders")) {
         for (size_t i = 0; i < jvNode["folders"].size(); i++) {
-            if (!SignNode(jvNode["folders"][i])) {
+            JValue &jvFolder = jvNode["folders"][i];
+            if (!SignNode(jvFolder)) {
                 return false;
             }
+            bReuse = bReuse && m_setReusedFiles.count(jvFolder["path"].asString() + "/" + jvFolder["exec"].asString());
         }
     }
 
     if (jvNode.has("files")) {
         for (size_t i = 0; i < jvNode["files"].size(); i++) {
             const char *szFile = jvNode["files"][i].asCString();
+            if (m_bReuseSigned) {
+                ZMachO machoSigned;
+                string strFile = m_strAppFolder + "/" + szFile;
+                if (machoSigned.InitReadOnly(strFile.c_str(), true) &&
+                    machoSigned.IsSignedBy(m_pSignAsset, "", "", "")) {
+                    ZLog::PrintV(">>> ReuseFile: \t%s\n", szFile);
+                    m_setReusedFiles.insert(szFile);
+                    continue;
+                }
+            }
+
+            bReuse = false;
             ZLog::PrintV(">>> SignFile: \t%s\n", szFile);
             ZMachO macho;
             if (!macho.InitV("%s/%s", m_strAppFolder.c_str(), szFile)) {
                 return false;
             }
-            if (!macho.Sign(m_pSignAsset, m_bForceSign, "", "", "", "")) {
+            if (!macho.Sign(m_pSignAsset, m_bForceSign, "", "", "", "", "")) {
                 return false;
             }
         }
     }
 
-    ZBase64 b64;
     string strInfoPlistSHA1;
     string strInfoPlistSHA256;
-    string strFolder = jvNode["path"];
     string strBundleId = jvNode["bid"];
     string strBundleExe = jvNode["exec"];
-
-    // Decode SHA1 hash
-    int outLen1 = 0;
-    const char* sha1Decoded = b64.Decode(jvNode["sha1"].asCString(), strlen(jvNode["sha1"].asCString()), &outLen1);
-    if (sha1Decoded != nullptr) {
-        strInfoPlistSHA1.assign(sha1Decoded, outLen1);
-    }
-
-    // Decode SHA256 hash
-    int outLen2 = 0;
-    const char* sha2Decoded = b64.Decode(jvNode["sha2"].asCString(), strlen(jvNode["sha2"].asCString()), &outLen2);
-    if (sha2Decoded != nullptr) {
-        strInfoPlistSHA256.assign(sha2Decoded, outLen2);
-    }
+    ZBase64::Decode(jvNode["sha1"].asString(), strInfoPlistSHA1);
+    ZBase64::Decode(jvNode["sha2"].asString(), strInfoPlistSHA256);
 
     if (strBundleId.empty() || strBundleExe.empty() || strInfoPlistSHA1.empty() || strInfoPlistSHA256.empty()) {
         ZLog::ErrorV(">>> Can't Get BundleID or BundleExecute or Info.plist SHASum in Info.plist! %s\n",
@@ -331,21 +460,9 @@ bool ZAppBundle::SignNode(JValue &jvNode) {
     }
 
     string strExePath = strBaseFolder + "/" + strBundleExe;
-    ZLog::PrintV(">>> SignFolder: %s, (%s)\n",
-                 ("/" == strFolder) ? basename((char *)m_strAppFolder.c_str()) : strFolder.c_str(),
-                 strBundleExe.c_str());
-
-    ZMachO macho;
-    if (!macho.Init(strExePath.c_str())) {
-        ZLog::ErrorV(">>> Can't Parse BundleExecute File! %s\n", strExePath.c_str());
-        return false;
-    }
-
-    RemoveFolderV("%s/_CodeSignature", strBaseFolder.c_str());
-    CreateFolderV("%s/_CodeSignature", strBaseFolder.c_str());
     string strCodeResFile = strBaseFolder + "/_CodeSignature/CodeResources";
 
-    JValue jvCodeRes;
+    JDocument jvCodeRes;
     if (!m_bForceSign) {
         jvCodeRes.readPListFile(strCodeResFile.c_str());
     }
@@ -356,42 +473,90 @@ bool ZAppBundle::SignNode(JValue &jvNode) {
             return false;
         }
     } else if (jvNode.has("changed")) { // use existsed
+        vector<string> arrRealFiles;
         for (size_t i = 0; i < jvNode["changed"].size(); i++) {
-            string strFile = jvNode["changed"][i].asCString();
-            string strRealFile = m_strAppFolder + "/" + strFile;
+            arrRealFiles.push_back(m_strAppFolder + "/" + jvNode["changed"][i].asString());
+        }
 
-            string strFileSHA1Base64;
-            string strFileSHA256Base64;
-            if (!SHASumBase64File(strRealFile.c_str(), strFileSHA1Base64, strFileSHA256Base64)) {
-                ZLog::ErrorV(">>> Can't Get Changed File SHASumBase64! %s", strFile.c_str());
-                return false;
-            }
+        vector<string> arrSHA1Base64;
+        vector<string> arrSHA256Base64;
+        SHASumBase64FilesOrEmpty(arrRealFiles, arrSHA1Base64, arrSHA256Base64);
+
+        JValue &jvFiles = jvCodeRes["files"];
+        JValue &jvFiles2 = jvCodeRes["files2"];
+        for (size_t i = 0; i < jvNode["changed"].size(); i++) {
+            string strFile = jvNode["changed"][i].asCString();
+            const string &strFileSHA1Base64 = arrSHA1Base64[i];
+            const string &strFileSHA256Base64 = arrSHA256Base64[i];
 
             string strKey = strFile;
             if ("/" != strFolder) {
                 strKey = strFile.substr(strFolder.size() + 1);
             }
-            jvCodeRes["files"][strKey] = "data:" + strFileSHA1Base64;
-            jvCodeRes["files2"][strKey]["hash"] = "data:" + strFileSHA1Base64;
-            jvCodeRes["files2"][strKey]["hash2"] = "data:" + strFileSHA256Base64;
+            jvFiles[strKey] = "data:" + strFileSHA1Base64;
+            JValue &jvFile2 = jvFiles2[strKey];
+            jvFile2["hash"] = "data:" + strFileSHA1Base64;
+            jvFile2["hash2"] = "data:" + strFileSHA256Base64;
 
             ZLog::DebugV("\t\tChanged File: %s, %s\n", strFileSHA1Base64.c_str(), strKey.c_str());
         }
     }
 
-    string strCodeResData;
-    jvCodeRes.writePList(strCodeResData);
-    if (!WriteFile(strCodeResFile.c_str(), strCodeResData)) {
+    if (bReuse) { // the seal must come out byte for byte as it is on disk
+        string strCodeResData;
+        jvCodeRes.writePList(strCodeResData);
+        string strOldCodeResData;
+        string strInfoPlistData;
+        ZMachO machoSigned;
+        if (ReadFile(strCodeResFile.c_str(), strOldCodeResData) && strOldCodeResData == strCodeResData &&
+            ReadFile(strInfoPlistData, "%s/Info.plist", strBaseFolder.c_str()) &&
+            machoSigned.InitReadOnly(strExePath.c_str(), true) &&
+            machoSigned.IsSignedBy(m_pSignAsset, strBundleId, strInfoPlistData, strCodeResData)) {
+            ZLog::PrintV(">>> ReuseFolder: %s, (%s)\n", strFolder.c_str(), strBundleExe.c_str());
+            m_setReusedFiles.insert(strFolder + "/" + strBundleExe);
+            return true;
+        }
+    }
+
+    ZLog::PrintV(">>> SignFolder: %s, (%s)\n",
+                 ("/" == strFolder) ? basename((char *)m_strAppFolder.c_str()) : strFolder.c_str(),
+                 strBundleExe.c_str());
+
+    ZMachO macho;
+    if (!macho.Init(strExePath.c_str())) {
+        ZLog::ErrorV(">>> Can't Parse BundleExecute File! %s\n", strExePath.c_str());
+        return false;
+    }
+
+    // the seal is streamed to disk and hashed on the way, it's never held in memory as a whole
+    string strCodeResSHA1;
+    string strCodeResSHA256;
+    RemoveFolderV("%s/_CodeSignature", strBaseFolder.c_str());
+    CreateFolderV("%s/_CodeSignature", strBaseFolder.c_str());
+    if (!jvCodeRes.writePListFile(strCodeResFile.c_str(), strCodeResSHA1, strCodeResSHA256)) {
         ZLog::ErrorV("\tWriting CodeResources Failed! %s\n", strCodeResFile.c_str());
         return false;
     }
 
     bool bForceSign = m_bForceSign;
-    if ("/" == strFolder && !m_strDyLibPath.empty()) { // inject dylib
-        macho.InjectDyLib(m_bWeakInject, m_strDyLibPath.c_str(), bForceSign);
+    if ("/" == strFolder) { // inject dylib and apply load command edits on the mapping that gets signed
+        vector<ZLoadCommandEdit> arrEdits = m_arrEdits;
+        if (!m_strDyLibPath.empty()) {
+            ZLoadCommandEdit edit;
+            edit.nType = m_bWeakInject ? ZLoadCommandEdit::E_INJECT_WEAK_DYLIB : ZLoadCommandEdit::E_INJECT_DYLIB;
+            edit.strPath = m_strDyLibPath;
+            arrEdits.push_back(edit);
+        }
+
+        bool bChanged = false;
+        if (!arrEdits.empty() && !macho.ApplyEdits(arrEdits, bChanged)) {
+            return false;
+        }
+        bForceSign = bForceSign || bChanged; // the header page changed, existing code slots are stale
     }
 
-    if (!macho.Sign(m_pSignAsset, bForceSign, strBundleId, strInfoPlistSHA1, strInfoPlistSHA256, strCodeResData)) {
+    if (!macho.Sign(m_pSignAsset, bForceSign, strBundleId, strInfoPlistSHA1, strInfoPlistSHA256, strCodeResSHA1,
+                    strCodeResSHA256)) {
         return false;
     }
 
@@ -420,13 +585,30 @@ void ZAppBundle::GetPlugIns(const string &strFolder, vector<string> &arrPlugIns)
     }
 }
 
+// the digests of the patched file are kept for GenerateCodeResources, which then doesn't read it again
+bool ZAppBundle::PatchPList(const string &strFile, const PPatch &patch, vector<string> &arrOld) {
+    string strSHA1;
+    string strSHA256;
+    if (!patch.Apply(strFile.c_str(), &arrOld, &strSHA1, &strSHA256)) {
+        return false;
+    }
+
+    m_mapPatchedFiles[strFile] = make_pair(ZBase64::Encode(strSHA1), ZBase64::Encode(strSHA256));
+    return true;
+}
+
 bool ZAppBundle::SignFolder(ZSignAsset *pSignAsset, const string &strFolder, const string &strBundleID,
                             const string &strBundleVersion, const string &strDisplayName, const string &strDyLibFile,
                             bool bForce, bool bWeakInject, bool bEnableCache,
-                            bool dontGenerateEmbeddedMobileProvision) {
-    m_bForceSign = bForce;
+                            bool dontGenerateEmbeddedMobileProvision, const vector<ZLoadCommandEdit> &arrEdits,
+                            const set<string> &setThinArchs, uint32_t uStripFlags, bool bReuseSigned) {
+    m_bForceSign = bForce || (0 != uStripFlags); // stripped binaries have no reusable code slots
+    m_bReuseSigned = bReuseSigned && (0 == uStripFlags);
+    m_setReusedFiles.clear();
+    m_mapPatchedFiles.clear();
     m_pSignAsset = pSignAsset;
     m_bWeakInject = bWeakInject;
+    m_arrEdits = arrEdits;
     if (NULL == m_pSignAsset) {
         return false;
     }
@@ -437,94 +619,88 @@ bool ZAppBundle::SignFolder(ZSignAsset *pSignAsset, const string &strFolder, con
     }
 
     if (!strBundleID.empty() || !strDisplayName.empty() || !strBundleVersion.empty()) { // modify bundle id
-        JValue jvInfoPlist;
-        if (jvInfoPlist.readPListPath("%s/Info.plist", m_strAppFolder.c_str())) {
-            m_bForceSign = true;
-            if (!strBundleID.empty()) {
-                string strOldBundleID = jvInfoPlist["CFBundleIdentifier"];
-                jvInfoPlist["CFBundleIdentifier"] = strBundleID;
-                ZLog::PrintV(">>> BundleId: \t%s -> %s\n", strOldBundleID.c_str(), strBundleID.c_str());
-
-                // modify plugins bundle id
-                vector<string> arrPlugIns;
-                GetPlugIns(m_strAppFolder, arrPlugIns);
-                for (size_t i = 0; i < arrPlugIns.size(); i++) {
-                    string &strPlugin = arrPlugIns[i];
-                    JValue jvPlugInInfoPlist;
-                    if (jvPlugInInfoPlist.readPListPath("%s/Info.plist", strPlugin.c_str())) {
-                        string strOldPlugInBundleID = jvPlugInInfoPlist["CFBundleIdentifier"];
-                        string strNewPlugInBundleID = strOldPlugInBundleID;
-                        StringReplace(strNewPlugInBundleID, strOldBundleID, strBundleID);
-                        jvPlugInInfoPlist["CFBundleIdentifier"] = strNewPlugInBundleID;
-                        ZLog::PrintV(">>> BundleId: \t%s -> %s, PlugIn\n", strOldPlugInBundleID.c_str(),
-                                     strNewPlugInBundleID.c_str());
-
-                        if (jvPlugInInfoPlist.has("WKCompanionAppBundleIdentifier")) {
-                            string strOldWKCBundleID = jvPlugInInfoPlist["WKCompanionAppBundleIdentifier"];
-                            string strNewWKCBundleID = strOldWKCBundleID;
-                            StringReplace(strNewWKCBundleID, strOldBundleID, strBundleID);
-                            jvPlugInInfoPlist["WKCompanionAppBundleIdentifier"] = strNewWKCBundleID;
-                            ZLog::PrintV(">>> BundleId: \t%s -> %s, PlugIn-WKCompanionAppBundleIdentifier\n",
-                                         strOldWKCBundleID.c_str(), strNewWKCBundleID.c_str());
-                        }
+        PPatch patch;
+        if (!strBundleID.empty()) {
+            patch.Set("CFBundleIdentifier", strBundleID);
+        }
+        if (!strDisplayName.empty()) {
+            patch.Set("CFBundleName", strDisplayName);
+            patch.Set("CFBundleDisplayName", strDisplayName);
+        }
+        if (!strBundleVersion.empty()) {
+            patch.Set("CFBundleVersion", strBundleVersion);
+            patch.Set("CFBundleShortVersionString", strBundleVersion);
+        }
 
-                        if (jvPlugInInfoPlist.has("NSExtension")) {
-                            if (jvPlugInInfoPlist["NSExtension"].has("NSExtensionAttributes")) {
-                                if (jvPlugInInfoPlist["NSExtension"]["NSExtensionAttributes"].has(
-                                        "WKAppBundleIdentifier")) {
-                                    string strOldWKBundleID = jvPlugInInfoPlist["NSExtension"]["NSExtensionAttributes"]
-                                                                               ["WKAppBundleIdentifier"];
-                                    string strNewWKBundleID = strOldWKBundleID;
-                                    StringReplace(strNewWKBundleID, strOldBundleID, strBundleID);
-                                    jvPlugInInfoPlist["NSExtension"]["NSExtensionAttributes"]["WKAppBundleIdentifier"] =
-                                        strNewWKBundleID;
-                                    ZLog::PrintV(">>> BundleId: \t%s -> %s, "
-                                                 "NSExtension-NSExtensionAttributes-WKAppBundleIdentifier\n",
-                                                 strOldWKBundleID.c_str(), strNewWKBundleID.c_str());
-                                }
-                            }
-                        }
+        vector<string> arrOld;
+        if (!PatchPList(m_strAppFolder + "/Info.plist", patch, arrOld)) {
+            ZLog::ErrorV(">>> Can't Find App's Info.plist! %s\n", strFolder.c_str());
+            return false;
+        }
+        m_bForceSign = true;
 
-                        jvPlugInInfoPlist.writePListPath("%s/Info.plist", strPlugin.c_str());
-                    }
+        size_t uOld = 0; // arrOld is in the order the edits were added
+        if (!strBundleID.empty()) {
+            const string &strOldBundleID = arrOld[uOld++];
+            ZLog::PrintV(">>> BundleId: \t%s -> %s\n", strOldBundleID.c_str(), strBundleID.c_str());
+
+            // modify plugins bundle id, each plug-in's Info.plist on its own
+            PPatch patchPlugIn;
+            patchPlugIn.Replace("CFBundleIdentifier", strOldBundleID, strBundleID);
+            patchPlugIn.Replace("WKCompanionAppBundleIdentifier", strOldBundleID, strBundleID);
+            patchPlugIn.Replace("NSExtension:NSExtensionAttributes:WKAppBundleIdentifier", strOldBundleID, strBundleID);
+
+            vector<string> arrPlugIns;
+            GetPlugIns(m_strAppFolder, arrPlugIns);
+            vector<vector<string>> arrPlugInOld(arrPlugIns.size());
+            vector<pair<string, string>> arrPlugInDigests(arrPlugIns.size());
+            vector<uint8_t> arrPatched(arrPlugIns.size(), 0);
+            ParallelFor(arrPlugIns.size(), [&](size_t i) {
+                string strSHA1;
+                string strSHA256;
+                if (patchPlugIn.Apply((arrPlugIns[i] + "/Info.plist").c_str(), &arrPlugInOld[i], &strSHA1,
+                                      &strSHA256)) {
+                    arrPlugInDigests[i] = make_pair(ZBase64::Encode(strSHA1), ZBase64::Encode(strSHA256));
+                    arrPatched[i] = 1;
                 }
-            }
+            });
 
-            if (!strDisplayName.empty()) {
-                string strOldDisplayName = jvInfoPlist["CFBundleDisplayName"];
-                jvInfoPlist["CFBundleName"] = strDisplayName;
-                jvInfoPlist["CFBundleDisplayName"] = strDisplayName;
-                ZLog::PrintV(">>> BundleName: %s -> %s\n", strOldDisplayName.c_str(), strDisplayName.c_str());
+            static const char *arrLabels[] = {"PlugIn", "PlugIn-WKCompanionAppBundleIdentifier",
+                                              "NSExtension-NSExtensionAttributes-WKAppBundleIdentifier"};
+            for (size_t i = 0; i < arrPlugIns.size(); i++) {
+                if (!arrPatched[i]) {
+                    continue;
+                }
+                m_mapPatchedFiles[arrPlugIns[i] + "/Info.plist"] = arrPlugInDigests[i];
+                for (size_t j = 0; j < arrPlugInOld[i].size(); j++) {
+                    const string &strOld = arrPlugInOld[i][j];
+                    if (0 == j || !strOld.empty()) {
+                        string strNew = strOld;
+                        StringReplace(strNew, strOldBundleID, strBundleID);
+                        ZLog::PrintV(">>> BundleId: \t%s -> %s, %s\n", strOld.c_str(), strNew.c_str(), arrLabels[j]);
+                    }
+                }
             }
+        }
 
-            if (!strBundleVersion.empty()) {
-                string strOldBundleVersion = jvInfoPlist["CFBundleVersion"];
-                jvInfoPlist["CFBundleVersion"] = strBundleVersion;
-                jvInfoPlist["CFBundleShortVersionString"] = strBundleVersion;
-                ZLog::PrintV(">>> BundleVersion: %s -> %s\n", strOldBundleVersion.c_str(), strBundleVersion.c_str());
-            }
+        if (!strDisplayName.empty()) {
+            ZLog::PrintV(">>> BundleName: %s -> %s\n", arrOld[uOld + 1].c_str(), strDisplayName.c_str());
+            uOld += 2;
+        }
 
-            jvInfoPlist.writePListPath("%s/Info.plist", m_strAppFolder.c_str());
-        } else {
-            ZLog::ErrorV(">>> Can't Find App's Info.plist! %s\n", strFolder.c_str());
-            return false;
+        if (!strBundleVersion.empty()) {
+            ZLog::PrintV(">>> BundleVersion: %s -> %s\n", arrOld[uOld].c_str(), strBundleVersion.c_str());
         }
     }
 
     if (!strDisplayName.empty()) {
         m_bForceSign = true;
-        JValue jvInfoPlistStrings;
-        if (jvInfoPlistStrings.readPListPath("%s/zh_CN.lproj/InfoPlist.strings", m_strAppFolder.c_str())) {
-            jvInfoPlistStrings["CFBundleName"] = strDisplayName;
-            jvInfoPlistStrings["CFBundleDisplayName"] = strDisplayName;
-            jvInfoPlistStrings.writePListPath("%s/zh_CN.lproj/InfoPlist.strings", m_strAppFolder.c_str());
-        }
-        jvInfoPlistStrings.clear();
-        if (jvInfoPlistStrings.readPListPath("%s/zh-Hans.lproj/InfoPlist.strings", m_strAppFolder.c_str())) {
-            jvInfoPlistStrings["CFBundleName"] = strDisplayName;
-            jvInfoPlistStrings["CFBundleDisplayName"] = strDisplayName;
-            jvInfoPlistStrings.writePListPath("%s/zh-Hans.lproj/InfoPlist.strings", m_strAppFolder.c_str());
-        }
+        PPatch patch;
+        patch.Set("CFBundleName", strDisplayName);
+        patch.Set("CFBundleDisplayName", strDisplayName);
+        vector<string> arrOld;
+        PatchPList(m_strAppFolder + "/zh_CN.lproj/InfoPlist.strings", patch, arrOld);
+        PatchPList(m_strAppFolder + "/zh-Hans.lproj/InfoPlist.strings", patch, arrOld);
     }
     if (dontGenerateEmbeddedMobileProvision) {
         if (!WriteFile(pSignAsset->m_strProvisionData, "%s/embedded.mobileprovision",
@@ -535,11 +711,10 @@ bool ZAppBundle::SignFolder(ZSignAsset *pSignAsset, const string &strFolder, con
     }
 
     if (!strDyLibFile.empty()) { // inject dylib
-        string strDyLibData;
-        ReadFile(strDyLibFile.c_str(), strDyLibData);
-        if (!strDyLibData.empty()) {
+        if (GetFileSize(strDyLibFile.c_str()) > 0) {
             string strFileName = basename((char *)strDyLibFile.c_str());
-            if (WriteFile(strDyLibData, "%s/%s", m_strAppFolder.c_str(), strFileName.c_str())) {
+            string strDstFile = m_strAppFolder + "/" + strFileName;
+            if (TransferFile(strDyLibFile.c_str(), strDstFile.c_str())) {
                 StringFormat(m_strDyLibPath, "@executable_path/%s", strFileName.c_str());
             }
         }
@@ -551,39 +726,457 @@ bool ZAppBundle::SignFolder(ZSignAsset *pSignAsset, const string &strFolder, con
         m_bForceSign = true;
     }
 
-    JValue jvRoot;
+    m_jvRoot.clear();
     if (m_bForceSign) {
-        jvRoot["path"] = "/";
-        jvRoot["root"] = m_strAppFolder;
-        if (!GetSignFolderInfo(m_strAppFolder, jvRoot, true)) {
+        m_jvRoot["path"] = "/";
+        m_jvRoot["root"] = m_strAppFolder;
+        if (!GetSignFolderInfo(m_strAppFolder, m_jvRoot, true)) {
             ZLog::ErrorV(">>> Can't Get BundleID, BundleVersion, or BundleExecute in Info.plist! %s\n",
                          m_strAppFolder.c_str());
             return false;
         }
-        if (!GetObjectsToSign(m_strAppFolder, jvRoot)) {
+        if (!GetObjectsToSign(m_strAppFolder, m_jvRoot)) {
             return false;
         }
-        GetNodeChangedFiles(jvRoot, dontGenerateEmbeddedMobileProvision);
+        GetNodeChangedFiles(m_jvRoot, dontGenerateEmbeddedMobileProvision);
     } else {
-        jvRoot.readPath("./.zsign_cache/%s.json", strCacheName.c_str());
+        m_jvRoot.readPath("./.zsign_cache/%s.json", strCacheName.c_str());
     }
 
     ZLog::PrintV(">>> Signing: \t%s ...\n", m_strAppFolder.c_str());
-    ZLog::PrintV(">>> AppName: \t%s\n", jvRoot["name"].asCString());
-    ZLog::PrintV(">>> BundleId: \t%s\n", jvRoot["bid"].asCString());
-    ZLog::PrintV(">>> BundleVer: \t%s\n", jvRoot["bver"].asCString());
+    ZLog::PrintV(">>> AppName: \t%s\n", m_jvRoot["name"].asCString());
+    ZLog::PrintV(">>> BundleId: \t%s\n", m_jvRoot["bid"].asCString());
+    ZLog::PrintV(">>> BundleVer: \t%s\n", m_jvRoot["bver"].asCString());
     ZLog::PrintV(">>> TeamId: \t%s\n", m_pSignAsset->m_strTeamId.c_str());
     ZLog::PrintV(">>> SubjectCN: \t%s\n", m_pSignAsset->m_strSubjectCN.c_str());
     ZLog::PrintV(">>> ReadCache: \t%s\n", m_bForceSign ? "NO" : "YES");
     ZLog::PrintV(">>> Exclude MobileProvision: \t%s\n", dontGenerateEmbeddedMobileProvision ? "NO" : "YES");
 
-    if (SignNode(jvRoot)) {
+    if (!setThinArchs.empty() && !ThinFolder(setThinArchs)) {
+        return false;
+    }
+
+    if (0 != uStripFlags && !StripFolder(uStripFlags)) {
+        return false;
+    }
+
+    if (SignNode(m_jvRoot)) {
         if (bEnableCache) {
             CreateFolder("./.zsign_cache");
-            jvRoot.styleWritePath("./.zsign_cache/%s.json", strCacheName.c_str());
+            m_jvRoot.styleWritePath("./.zsign_cache/%s.json", strCacheName.c_str());
         }
         return true;
     }
 
     return false;
 }
+
+bool ZAppBundle::SignFolderMulti(const vector<ZSignAsset *> &arrSignAssets, const string &strFolder,
+                                 const vector<string> &arrOutputFolders, const string &strBundleID,
+                                 const string &strBundleVersion, const string &strDisplayName,
+                                 const string &strDyLibFile, bool bWeakInject,
+                                 bool dontGenerateEmbeddedMobileProvision) {
+    if (arrSignAssets.empty() || arrSignAssets.size() != arrOutputFolders.size()) {
+        ZLog::Error(">>> SignAssets And OutputFolders Mismatch!\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < arrSignAssets.size(); i++) {
+        if (NULL == arrSignAssets[i]) {
+            return false;
+        }
+    }
+
+    // every output is removed and copied into, so none may be the input, hold it, lie inside it, or
+    // overlap another output
+    string strRealFolder = ResolvePath(strFolder);
+    vector<string> arrRealOutputFolders;
+    for (size_t i = 0; i < arrOutputFolders.size(); i++) {
+        string strRealOutputFolder = ResolvePath(arrOutputFolders[i]);
+        if (IsPathOverlapped(strRealOutputFolder, strRealFolder)) {
+            ZLog::ErrorV(">>> OutputFolder Overlaps The Input Folder! %s\n", arrOutputFolders[i].c_str());
+            return false;
+        }
+        for (size_t j = 0; j < arrRealOutputFolders.size(); j++) {
+            if (IsPathOverlapped(strRealOutputFolder, arrRealOutputFolders[j])) {
+                ZLog::ErrorV(">>> OutputFolder Overlaps Another! %s, %s\n", arrOutputFolders[i].c_str(),
+                             arrOutputFolders[j].c_str());
+                return false;
+            }
+        }
+        arrRealOutputFolders.push_back(strRealOutputFolder);
+    }
+
+    // the first identity does the full scan, resource hashing and code page hashing.
+    RemoveFolder(arrOutputFolders[0].c_str());
+    if (!CopyFolder(strFolder.c_str(), arrOutputFolders[0].c_str())) {
+        ZLog::ErrorV(">>> Can't Copy Folder! %s -> %s\n", strFolder.c_str(), arrOutputFolders[0].c_str());
+        return false;
+    }
+
+    if (!SignFolder(arrSignAssets[0], arrOutputFolders[0], strBundleID, strBundleVersion, strDisplayName,
+                    strDyLibFile, true, bWeakInject, false, dontGenerateEmbeddedMobileProvision)) {
+        return false;
+    }
+
+    // the others are cloned from the first signed output, so the existing CodeResources and code slots
+    // stay valid and only the changed files, requirements, entitlements and CMS are rebuilt.
+    string strSignedFolder = arrOutputFolders[0];
+    for (size_t i = 1; i < arrSignAssets.size(); i++) {
+        const string &strOutputFolder = arrOutputFolders[i];
+        RemoveFolder(strOutputFolder.c_str());
+        if (!CopyFolder(strSignedFolder.c_str(), strOutputFolder.c_str())) {
+            ZLog::ErrorV(">>> Can't Copy Folder! %s -> %s\n", strSignedFolder.c_str(), strOutputFolder.c_str());
+            return false;
+        }
+
+        if (!FindAppFolder(strOutputFolder, m_strAppFolder)) {
+            ZLog::ErrorV(">>> Can't Find App Folder! %s\n", strOutputFolder.c_str());
+            return false;
+        }
+
+        m_pSignAsset = arrSignAssets[i];
+        m_bForceSign = false;
+        m_strDyLibPath.clear();
+        m_arrEdits.clear();
+        m_jvRoot["root"] = m_strAppFolder;
+
+        if (dontGenerateEmbeddedMobileProvision) {
+            if (!WriteFile(m_pSignAsset->m_strProvisionData, "%s/embedded.mobileprovision", m_strAppFolder.c_str())) {
+                ZLog::ErrorV(">>> Can't Write embedded.mobileprovision!\n");
+                return false;
+            }
+        }
+
+        ZLog::PrintV(">>> Signing: \t%s ...\n", m_strAppFolder.c_str());
+        ZLog::PrintV(">>> TeamId: \t%s\n", m_pSignAsset->m_strTeamId.c_str());
+        ZLog::PrintV(">>> SubjectCN: \t%s\n", m_pSignAsset->m_strSubjectCN.c_str());
+
+        if (!SignNode(m_jvRoot)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ZAppBundle::GetMachOFiles(JValue &jvNode, vector<string> &arrFiles) {
+    if (jvNode.has("files")) {
+        for (size_t i = 0; i < jvNode["files"].size(); i++) {
+            arrFiles.push_back(jvNode["files"][i]);
+        }
+    }
+
+    if (jvNode.has("folders")) {
+        for (size_t i = 0; i < jvNode["folders"].size(); i++) {
+            JValue &jvSubNode = jvNode["folders"][i];
+            GetMachOFiles(jvSubNode, arrFiles);
+            arrFiles.push_back(jvSubNode["path"].asString() + "/" + jvSubNode["exec"].asString());
+        }
+    }
+}
+
+bool ZAppBundle::ScanDylibs(const string &strFolder, const string &strMatch, vector<ZDylibScanResult> &arrResults) {
+    return ProcessDylibs(strFolder, strMatch, "", false, arrResults);
+}
+
+bool ZAppBundle::RewriteDylibs(const string &strFolder, const string &strMatch, const string &strReplace,
+                               vector<ZDylibScanResult> &arrResults) {
+    if (strMatch.empty() || strReplace.empty()) {
+        return false;
+    }
+    return ProcessDylibs(strFolder, strMatch, strReplace, true, arrResults);
+}
+
+bool ZAppBundle::ProcessDylibs(const string &strFolder, const string &strMatch, const string &strReplace,
+                               bool bRewrite, vector<ZDylibScanResult> &arrResults) {
+    arrResults.clear();
+    if (!FindAppFolder(strFolder, m_strAppFolder)) {
+        ZLog::ErrorV(">>> Can't Find App Folder! %s\n", strFolder.c_str());
+        return false;
+    }
+
+    // same executables, frameworks, plugins and dylibs the signer would visit
+    JValue jvRoot;
+    jvRoot["path"] = "/";
+    if (!GetSignFolderInfo(m_strAppFolder, jvRoot) || !GetObjectsToSign(m_strAppFolder, jvRoot)) {
+        ZLog::ErrorV(">>> Can't Get BundleExecute in Info.plist! %s\n", m_strAppFolder.c_str());
+        return false;
+    }
+
+    vector<string> arrFiles;
+    GetMachOFiles(jvRoot, arrFiles);
+    arrFiles.push_back(jvRoot["exec"]);
+
+    arrResults.resize(arrFiles.size());
+    for (size_t i = 0; i < arrFiles.size(); i++) {
+        arrResults[i].strFile = arrFiles[i];
+        arrResults[i].bChanged = false;
+        arrResults[i].bSuccess = false;
+    }
+
+    // a reference matches on the whole path or on a leading path component,
+    // so "@rpath/Foo.framework" matches "@rpath/Foo.framework/Foo" but not "@rpath/Foo.frameworks"
+    auto IsMatch = [&strMatch](const string &strDylib) {
+        return strMatch.empty() || strDylib == strMatch ||
+               (0 == strDylib.compare(0, strMatch.size(), strMatch) && '/' == strDylib[strMatch.size()]);
+    };
+
+    auto ProcessFile = [&](ZDylibScanResult &result) {
+        string strFile = m_strAppFolder + "/" + result.strFile;
+
+        // the header-only parse is enough to decide, only files that need a rewrite get mapped writable
+        ZMachO macho;
+        if (!macho.InitReadOnly(strFile.c_str())) {
+            return;
+        }
+        set<string> setDylibs;
+        vector<string> arrDylibs = macho.ListDylibs();
+        for (size_t i = 0; i < arrDylibs.size(); i++) {
+            if (IsMatch(arrDylibs[i]) && setDylibs.insert(arrDylibs[i]).second) {
+                result.arrDylibs.push_back(arrDylibs[i]);
+            }
+        }
+        macho.Free();
+
+        if (!bRewrite || result.arrDylibs.empty()) {
+            result.bSuccess = true;
+            return;
+        }
+
+        vector<ZLoadCommandEdit> arrEdits;
+        for (size_t i = 0; i < result.arrDylibs.size(); i++) {
+            ZLoadCommandEdit edit;
+            edit.nType = ZLoadCommandEdit::E_RENAME_DYLIB;
+            edit.strPath = result.arrDylibs[i];
+            edit.strNewPath = strReplace + result.arrDylibs[i].substr(strMatch.size());
+            arrEdits.push_back(edit);
+        }
+
+        if (macho.Init(strFile.c_str())) {
+            result.bSuccess = macho.ApplyEdits(arrEdits, result.bChanged);
+            macho.Free();
+        }
+    };
+
+    ParallelFor(arrResults.size(), [&](size_t i) { ProcessFile(arrResults[i]); });
+
+    bool bRet = true;
+    for (size_t i = 0; i < arrResults.size(); i++) {
+        if (!arrResults[i].bSuccess) {
+            ZLog::ErrorV(">>> Can't Process Dylib References! %s\n", arrResults[i].strFile.c_str());
+            bRet = false;
+        }
+    }
+    return bRet;
+}
+
+bool ZAppBundle::ThinFolder(const set<string> &setArchs) {
+    vector<string> arrFiles;
+    GetMachOFiles(m_jvRoot, arrFiles);
+    arrFiles.push_back(m_jvRoot["exec"]);
+
+    // a watch app or simulator-only dylib may have none of the archs, only the main executable must
+    vector<uint8_t> arrSuccess(arrFiles.size(), 0);
+    ParallelFor(arrFiles.size(), [&](size_t i) {
+        ZMachO macho;
+        bool bChanged = false;
+        if (macho.InitV("%s/%s", m_strAppFolder.c_str(), arrFiles[i].c_str())) {
+            arrSuccess[i] = macho.Thin(setArchs, bChanged, i + 1 < arrFiles.size()) ? 1 : 0;
+            macho.Free();
+        }
+    });
+
+    for (size_t i = 0; i < arrFiles.size(); i++) {
+        if (!arrSuccess[i]) {
+            ZLog::ErrorV(">>> Can't Thin File! %s\n", arrFiles[i].c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ZAppBundle::StripFolder(uint32_t uFlags) {
+    vector<string> arrFiles;
+    GetMachOFiles(m_jvRoot, arrFiles);
+    arrFiles.push_back(m_jvRoot["exec"]);
+
+    m_arrStripResults.resize(arrFiles.size());
+    ParallelFor(arrFiles.size(), [&](size_t i) {
+        ZStripResult &result = m_arrStripResults[i];
+        result.strFile = arrFiles[i];
+        result.uSavedBytes = 0;
+        result.bSuccess = false;
+
+        ZMachO macho;
+        if (macho.InitV("%s/%s", m_strAppFolder.c_str(), arrFiles[i].c_str())) {
+            result.bSuccess = macho.Strip(uFlags, result.uSavedBytes);
+            macho.Free();
+        }
+    });
+
+    uint64_t uSavedBytes = 0;
+    for (size_t i = 0; i < m_arrStripResults.size(); i++) {
+        if (!m_arrStripResults[i].bSuccess) {
+            ZLog::ErrorV(">>> Can't Strip File! %s\n", m_arrStripResults[i].strFile.c_str());
+            return false;
+        }
+        uSavedBytes += m_arrStripResults[i].uSavedBytes;
+    }
+    ZLog::PrintV(">>> Stripped: \t%llu Bytes In %lu Files\n", (unsigned long long)uSavedBytes, m_arrStripResults.size());
+    return true;
+}
+
+void ZAppBundle::GetBundleFolders(JValue &jvNode, vector<JValue *> &arrNodes) {
+    arrNodes.push_back(&jvNode);
+    if (jvNode.has("folders")) {
+        for (size_t i = 0; i < jvNode["folders"].size(); i++) {
+            GetBundleFolders(jvNode["folders"][i], arrNodes);
+        }
+    }
+}
+
+bool ZAppBundle::VerifyFolder(const string &strFolder, JValue &jvReport) {
+    jvReport.clear();
+    jvReport["valid"] = false;
+    if (!FindAppFolder(strFolder, m_strAppFolder)) {
+        ZLog::ErrorV(">>> Can't Find App Folder! %s\n", strFolder.c_str());
+        return false;
+    }
+
+    JValue jvRoot;
+    jvRoot["path"] = "/";
+    if (!GetSignFolderInfo(m_strAppFolder, jvRoot) || !GetObjectsToSign(m_strAppFolder, jvRoot)) {
+        ZLog::ErrorV(">>> Can't Get BundleExecute in Info.plist! %s\n", m_strAppFolder.c_str());
+        return false;
+    }
+
+    vector<JValue *> arrNodes;
+    GetBundleFolders(jvRoot, arrNodes);
+
+    // a bundle executable binds its Info.plist and CodeResources, nested dylibs bind neither
+    vector<string> arrFiles;
+    vector<string> arrBundleFolders;
+    vector<int> arrFileBundles;
+    for (size_t i = 0; i < arrNodes.size(); i++) {
+        JValue &jvNode = *arrNodes[i];
+        string strPath = jvNode["path"];
+        string strBaseFolder = ("/" == strPath) ? m_strAppFolder : (m_strAppFolder + "/" + strPath);
+        arrBundleFolders.push_back(strBaseFolder);
+
+        if (jvNode.has("files")) {
+            for (size_t j = 0; j < jvNode["files"].size(); j++) {
+                arrFiles.push_back(jvNode["files"][j]);
+                arrFileBundles.push_back(-1);
+            }
+        }
+        arrFiles.push_back(("/" == strPath) ? jvNode["exec"].asString() : (strPath + "/" + jvNode["exec"].asString()));
+        arrFileBundles.push_back((int)i);
+    }
+
+    vector<JValue> arrFileReports(arrFiles.size());
+    ParallelFor(arrFiles.size(), [&](size_t i) {
+        JValue &jvFile = arrFileReports[i];
+        jvFile["file"] = arrFiles[i];
+        jvFile["valid"] = false;
+
+        string strInfoPlistData;
+        string strCodeResourcesData;
+        if (arrFileBundles[i] >= 0) {
+            const string &strBaseFolder = arrBundleFolders[arrFileBundles[i]];
+            ReadFile(strInfoPlistData, "%s/Info.plist", strBaseFolder.c_str());
+            ReadFile(strCodeResourcesData, "%s/_CodeSignature/CodeResources", strBaseFolder.c_str());
+        }
+
+        ZMachO macho;
+        if (!macho.InitReadOnly((m_strAppFolder + "/" + arrFiles[i]).c_str(), true)) {
+            jvFile["errors"].push_back("invalid Mach-O file");
+            return;
+        }
+        jvFile["valid"] = macho.Verify(strInfoPlistData, strCodeResourcesData, jvFile);
+        macho.Free();
+    });
+
+    vector<JValue> arrResReports(arrBundleFolders.size());
+    auto AddResourceError = [&](int nBundle, const string &strKey, const char *szError) {
+        JValue jvError;
+        jvError["file"] = strKey;
+        jvError["error"] = szError;
+        arrResReports[nBundle]["errors"].push_back(std::move(jvError));
+    };
+
+    // every files2 digest of every bundle is rehashed in one batch
+    vector<string> arrResFiles;
+    vector<string> arrResKeys;
+    vector<string> arrResHashes;
+    vector<int> arrResBundles;
+    for (size_t i = 0; i < arrBundleFolders.size(); i++) {
+        JValue &jvRes = arrResReports[i];
+        jvRes["bundle"] = (*arrNodes[i])["path"];
+        jvRes["checked"] = 0;
+        jvRes["errors"] = JValue(JValue::E_ARRAY);
+
+        JDocument jvCodeRes;
+        jvCodeRes.readPListPath("%s/_CodeSignature/CodeResources", arrBundleFolders[i].c_str());
+        JValue &jvFiles2 = jvCodeRes["files2"];
+        vector<string> arrKeys;
+        jvFiles2.keys(arrKeys);
+        for (size_t j = 0; j < arrKeys.size(); j++) {
+            JValue &jvEntry = jvFiles2[arrKeys[j]];
+            string strHash = jvEntry.has("hash2") ? jvEntry["hash2"].asData() : jvEntry["hash"].asData();
+            if (strHash.empty()) { // symlinks and nested code sealed by cdhash
+                continue;
+            }
+
+            string strFile = arrBundleFolders[i] + "/" + arrKeys[j];
+            jvRes["checked"] = jvRes["checked"].asInt() + 1;
+            if (!IsFileExists(strFile.c_str())) {
+                if (!jvEntry["optional"].asBool()) {
+                    AddResourceError((int)i, arrKeys[j], "missing");
+                }
+                continue;
+            }
+            arrResFiles.push_back(strFile);
+            arrResKeys.push_back(arrKeys[j]);
+            arrResHashes.push_back(strHash);
+            arrResBundles.push_back((int)i);
+        }
+    }
+
+    vector<string> arrSHA1;
+    vector<string> arrSHA256;
+    SHASumFiles(arrResFiles, arrSHA1, arrSHA256);
+    for (size_t i = 0; i < arrResFiles.size(); i++) {
+        const string &strSHASum = (32 == arrResHashes[i].size()) ? arrSHA256[i] : arrSHA1[i];
+        if (strSHASum.empty()) {
+            AddResourceError(arrResBundles[i], arrResKeys[i], "unreadable");
+        } else if (strSHASum != arrResHashes[i]) {
+            AddResourceError(arrResBundles[i], arrResKeys[i], "modified");
+        }
+    }
+
+    bool bValid = true;
+    jvReport["files"] = JValue(JValue::E_ARRAY);
+    for (size_t i = 0; i < arrFileReports.size(); i++) {
+        if (!arrFileReports[i]["valid"].asBool()) {
+            ZLog::ErrorV(">>> Invalid Code Signature! %s\n", arrFiles[i].c_str());
+            bValid = false;
+        }
+        jvReport["files"].push_back(std::move(arrFileReports[i]));
+    }
+
+    jvReport["resources"] = JValue(JValue::E_ARRAY);
+    for (size_t i = 0; i < arrResReports.size(); i++) {
+        JValue &jvRes = arrResReports[i];
+        jvRes["valid"] = (0 == jvRes["errors"].size());
+        if (!jvRes["valid"].asBool()) {
+            ZLog::ErrorV(">>> Invalid Sealed Resources! %s\n", arrBundleFolders[i].c_str());
+            bValid = false;
+        }
+        jvReport["resources"].push_back(std::move(jvRes));
+    }
+
+    jvReport["valid"] = bValid;
+    ZLog::PrintV(">>> Verified: \t%lu Files, %lu Resources\n", arrFiles.size(), arrResFiles.size());
+    return bValid;
+}
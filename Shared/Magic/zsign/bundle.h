@@ -11,10 +11,24 @@
  */
 
 #pragma once
+#include "archo.h"
 #include "common/common.h"
 #include "common/json.h"
 #include "openssl.h"
 
+struct ZDylibScanResult {
+    string strFile;           // relative to the app folder
+    vector<string> arrDylibs; // matching references, before any rewrite
+    bool bChanged;
+    bool bSuccess;
+};
+
+struct ZStripResult {
+    string strFile;       // relative to the app folder
+    uint64_t uSavedBytes; // file size before stripping minus after
+    bool bSuccess;
+};
+
 class ZAppBundle {
 public:
     ZAppBundle();
@@ -22,13 +36,31 @@ public:
 public:
     bool SignFolder(ZSignAsset *pSignAsset, const string &strFolder, const string &strBundleID,
                     const string &strBundleVersion, const string &strDisplayName, const string &strDyLibFile,
-                    bool bForce, bool bWeakInject, bool bEnableCache, bool dontGenerateEmbeddedMobileProvision);
+                    bool bForce, bool bWeakInject, bool bEnableCache, bool dontGenerateEmbeddedMobileProvision,
+                    const vector<ZLoadCommandEdit> &arrEdits = vector<ZLoadCommandEdit>(),
+                    const set<string> &setThinArchs = set<string>(), uint32_t uStripFlags = 0,
+                    bool bReuseSigned = false);
+    bool SignFolderMulti(const vector<ZSignAsset *> &arrSignAssets, const string &strFolder,
+                         const vector<string> &arrOutputFolders, const string &strBundleID,
+                         const string &strBundleVersion, const string &strDisplayName, const string &strDyLibFile,
+                         bool bWeakInject, bool dontGenerateEmbeddedMobileProvision);
+    bool ScanDylibs(const string &strFolder, const string &strMatch, vector<ZDylibScanResult> &arrResults);
+    bool RewriteDylibs(const string &strFolder, const string &strMatch, const string &strReplace,
+                       vector<ZDylibScanResult> &arrResults);
+    bool VerifyFolder(const string &strFolder, JValue &jvReport);
 
 private:
     bool SignNode(JValue &jvNode);
     void GetNodeChangedFiles(JValue &jvNode, bool dontGenerateEmbeddedMobileProvision);
     void GetChangedFiles(JValue &jvNode, vector<string> &arrChangedFiles);
     void GetPlugIns(const string &strFolder, vector<string> &arrPlugIns);
+    void GetMachOFiles(JValue &jvNode, vector<string> &arrFiles);
+    void GetBundleFolders(JValue &jvNode, vector<JValue *> &arrNodes);
+    bool ThinFolder(const set<string> &setArchs);
+    bool StripFolder(uint32_t uFlags);
+    bool ProcessDylibs(const string &strFolder, const string &strMatch, const string &strReplace, bool bRewrite,
+                       vector<ZDylibScanResult> &arrResults);
+    bool PatchPList(const string &strFile, const PPatch &patch, vector<string> &arrOld);
 
 private:
     bool FindAppFolder(const string &strFolder, string &strAppFolder);
@@ -41,10 +73,16 @@ private:
 
 private:
     bool m_bForceSign;
+    bool m_bReuseSigned;
     bool m_bWeakInject;
     string m_strDyLibPath;
+    vector<ZLoadCommandEdit> m_arrEdits;
     ZSignAsset *m_pSignAsset;
+    JValue m_jvRoot;
+    map<string, pair<string, string>> m_mapPatchedFiles; // base64 SHA-1 and SHA-256 of plists SignFolder patched
 
 public:
     string m_strAppFolder;
+    vector<ZStripResult> m_arrStripResults; // filled by SignFolder when stripping
+    set<string> m_setReusedFiles;           // nested code left as it was, relative to the app folder
 };
@@ -8,158 +8,265 @@
  */
 
 #include "base64.h"
-#include <string.h>
 
-#define B0(a) (a & 0xFF)
-#define B1(a) (a >> 8 & 0xFF)
-#define B2(a) (a >> 16 & 0xFF)
-#define B3(a) (a >> 24 & 0xFF)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
-ZBase64::ZBase64(void) {}
+static const char s_szEncode[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-ZBase64::~ZBase64(void) {
-    if (!m_arrEnc.empty()) {
-        for (size_t i = 0; i < m_arrEnc.size(); i++) {
-            delete[] m_arrEnc[i];
+// value of each character, 0xFE for '=' and 0xFF for everything outside the alphabet
+static const uint8_t s_szDecode[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFE, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+// sextets of 16 characters, a lane is 0xFF where the character isn't in the alphabet
+static uint8x16_t DecodeNEON(uint8x16_t vChars) {
+    uint8x16_t vUpper = vsubq_u8(vChars, vdupq_n_u8('A'));
+    uint8x16_t vLower = vsubq_u8(vChars, vdupq_n_u8('a'));
+    uint8x16_t vDigit = vsubq_u8(vChars, vdupq_n_u8('0'));
+    uint8x16_t vValue = vdupq_n_u8(0xFF);
+    vValue = vbslq_u8(vcltq_u8(vUpper, vdupq_n_u8(26)), vUpper, vValue);
+    vValue = vbslq_u8(vcltq_u8(vLower, vdupq_n_u8(26)), vaddq_u8(vLower, vdupq_n_u8(26)), vValue);
+    vValue = vbslq_u8(vcltq_u8(vDigit, vdupq_n_u8(10)), vaddq_u8(vDigit, vdupq_n_u8(52)), vValue);
+    vValue = vbslq_u8(vceqq_u8(vChars, vdupq_n_u8('+')), vdupq_n_u8(62), vValue);
+    vValue = vbslq_u8(vceqq_u8(vChars, vdupq_n_u8('/')), vdupq_n_u8(63), vValue);
+    return vValue;
+}
+#endif
+
+// Decodes whole groups of four from p as long as none of their characters has to be skipped, which is all of
+// them in a digest and all but the line breaks in a <data> block. Stops in front of the first group that has.
+static void DecodeBlocks(const uint8_t *&p, const uint8_t *pend, uint8_t *&q) {
+#if defined(__AVX2__)
+    // 32 characters at a time, validated and mapped with nibble lookups, then packed to 24 bytes
+    const __m256i vLutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                            0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i vLutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i vLutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+                                              -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i vNibble = _mm256_set1_epi8(0x0F);
+    const __m256i vSlash = _mm256_set1_epi8('/');
+    const __m256i vPack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+                                           10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    while (pend - p >= 32) {
+        __m256i vChars = _mm256_loadu_si256((const __m256i *)p);
+        __m256i vHi = _mm256_and_si256(_mm256_srli_epi32(vChars, 4), vNibble);
+        __m256i vLo = _mm256_and_si256(vChars, vNibble);
+        if (!_mm256_testz_si256(_mm256_shuffle_epi8(vLutLo, vLo), _mm256_shuffle_epi8(vLutHi, vHi))) {
+            break;
         }
-        m_arrEnc.clear();
+
+        __m256i vRoll = _mm256_shuffle_epi8(vLutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(vChars, vSlash), vHi));
+        __m256i vValue = _mm256_add_epi8(vChars, vRoll);
+        vValue = _mm256_maddubs_epi16(vValue, _mm256_set1_epi32(0x01400140));
+        vValue = _mm256_madd_epi16(vValue, _mm256_set1_epi32(0x00011000));
+        vValue = _mm256_shuffle_epi8(vValue, vPack);
+        vValue = _mm256_permutevar8x32_epi32(vValue, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm_storeu_si128((__m128i *)q, _mm256_castsi256_si128(vValue));
+        _mm_storel_epi64((__m128i *)(q + 16), _mm256_extracti128_si256(vValue, 1));
+        p += 32;
+        q += 24;
     }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    // 64 characters at a time, split into the four positions of each group by the load
+    while (pend - p >= 64) {
+        uint8x16x4_t vChars = vld4q_u8(p);
+        uint8x16_t v0 = DecodeNEON(vChars.val[0]);
+        uint8x16_t v1 = DecodeNEON(vChars.val[1]);
+        uint8x16_t v2 = DecodeNEON(vChars.val[2]);
+        uint8x16_t v3 = DecodeNEON(vChars.val[3]);
+        if (vmaxvq_u8(vorrq_u8(vorrq_u8(v0, v1), vorrq_u8(v2, v3))) > 63) {
+            break;
+        }
 
-    if (!m_arrDec.empty()) {
-        for (size_t i = 0; i < m_arrDec.size(); i++) {
-            delete[] m_arrDec[i];
+        uint8x16x3_t vBytes;
+        vBytes.val[0] = vorrq_u8(vshlq_n_u8(v0, 2), vshrq_n_u8(v1, 4));
+        vBytes.val[1] = vorrq_u8(vshlq_n_u8(v1, 4), vshrq_n_u8(v2, 2));
+        vBytes.val[2] = vorrq_u8(vshlq_n_u8(v2, 6), v3);
+        vst3q_u8(q, vBytes);
+        p += 64;
+        q += 48;
+    }
+#endif
+
+    while (pend - p >= 4) {
+        uint8_t c0 = s_szDecode[p[0]];
+        uint8_t c1 = s_szDecode[p[1]];
+        uint8_t c2 = s_szDecode[p[2]];
+        uint8_t c3 = s_szDecode[p[3]];
+        if (0 != ((c0 | c1 | c2 | c3) & 0x80)) {
+            break;
         }
-        m_arrDec.clear();
+
+        q[0] = (uint8_t)(c0 << 2 | c1 >> 4);
+        q[1] = (uint8_t)(c1 << 4 | c2 >> 2);
+        q[2] = (uint8_t)(c2 << 6 | c3);
+        p += 4;
+        q += 3;
     }
 }
 
-unsigned char ZBase64::s_ca_table_enc[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+size_t ZBase64::Encode(const void *pData, size_t uDataLen, char *szOut) {
+    const uint8_t *p = (const uint8_t *)pData;
+    const uint8_t *pend = p + uDataLen;
+    char *q = szOut;
 
-// Implementation of encoding functions
-char* ZBase64::Encode(const char* pData, int nDataLen) {
-    if (nullptr == pData || nDataLen <= 0) {
-        return nullptr;
+#if defined(__AVX2__)
+    // 24 bytes at a time, 12 in each lane, spread to one group of three per 32-bit word and cut into sextets
+    // with multiplies, then moved into the alphabet by an offset looked up per range
+    const __m256i vSpread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4,
+                                             7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i vShift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    while (pend - p >= 28) {
+        __m256i vBytes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                                 _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+        vBytes = _mm256_shuffle_epi8(vBytes, vSpread);
+        __m256i vHi = _mm256_mulhi_epu16(_mm256_and_si256(vBytes, _mm256_set1_epi32(0x0FC0FC00)),
+                                         _mm256_set1_epi32(0x04000040));
+        __m256i vLo = _mm256_mullo_epi16(_mm256_and_si256(vBytes, _mm256_set1_epi32(0x003F03F0)),
+                                         _mm256_set1_epi32(0x01000010));
+        __m256i vValue = _mm256_or_si256(vHi, vLo);
+        __m256i vRange = _mm256_subs_epu8(vValue, _mm256_set1_epi8(51));
+        vRange = _mm256_or_si256(vRange, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), vValue),
+                                                          _mm256_set1_epi8(13)));
+        vValue = _mm256_add_epi8(vValue, _mm256_shuffle_epi8(vShift, vRange));
+        _mm256_storeu_si256((__m256i *)q, vValue);
+        p += 24;
+        q += 32;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    // 48 bytes at a time, split into the three positions of each group by the load
+    uint8x16x4_t vTable = vld1q_u8_x4((const uint8_t *)s_szEncode);
+    uint8x16_t vMask = vdupq_n_u8(0x3F);
+    while (pend - p >= 48) {
+        uint8x16x3_t vBytes = vld3q_u8(p);
+        uint8x16x4_t vChars;
+        vChars.val[0] = vqtbl4q_u8(vTable, vshrq_n_u8(vBytes.val[0], 2));
+        vChars.val[1] =
+            vqtbl4q_u8(vTable, vandq_u8(vorrq_u8(vshlq_n_u8(vBytes.val[0], 4), vshrq_n_u8(vBytes.val[1], 4)), vMask));
+        vChars.val[2] =
+            vqtbl4q_u8(vTable, vandq_u8(vorrq_u8(vshlq_n_u8(vBytes.val[1], 2), vshrq_n_u8(vBytes.val[2], 6)), vMask));
+        vChars.val[3] = vqtbl4q_u8(vTable, vandq_u8(vBytes.val[2], vMask));
+        vst4q_u8((uint8_t *)q, vChars);
+        p += 48;
+        q += 64;
     }
-    
-    int nEncodedLen = (nDataLen + 2) / 3 * 4;
-    char* pEncoded = new char[nEncodedLen + 1];
-    m_arrEnc.push_back(pEncoded);
-    
-    int nRemain = nDataLen % 3;
-    int nLoopTime = nDataLen / 3;
-    
-    const unsigned char* p = (const unsigned char*)pData;
-    char* q = pEncoded;
-    
-    for (int i = 0; i < nLoopTime; i++) {
-        q[0] = s_ca_table_enc[p[0] >> 2];
-        q[1] = s_ca_table_enc[((p[0] & 0x03) << 4) | (p[1] >> 4)];
-        q[2] = s_ca_table_enc[((p[1] & 0x0f) << 2) | (p[2] >> 6)];
-        q[3] = s_ca_table_enc[p[2] & 0x3f];
-        
+#endif
+
+    while (pend - p >= 3) {
+        q[0] = s_szEncode[p[0] >> 2];
+        q[1] = s_szEncode[(p[0] & 0x03) << 4 | p[1] >> 4];
+        q[2] = s_szEncode[(p[1] & 0x0F) << 2 | p[2] >> 6];
+        q[3] = s_szEncode[p[2] & 0x3F];
         p += 3;
         q += 4;
     }
-    
-    if (0 < nRemain) {
-        q[0] = s_ca_table_enc[p[0] >> 2];
-        if (1 == nRemain) {
-            q[1] = s_ca_table_enc[(p[0] & 0x03) << 4];
-            q[2] = '=';
-            q[3] = '=';
-        } else {
-            q[1] = s_ca_table_enc[((p[0] & 0x03) << 4) | (p[1] >> 4)];
-            q[2] = s_ca_table_enc[(p[1] & 0x0f) << 2];
-            q[3] = '=';
-        }
+
+    if (pend - p == 1) {
+        q[0] = s_szEncode[p[0] >> 2];
+        q[1] = s_szEncode[(p[0] & 0x03) << 4];
+        q[2] = '=';
+        q[3] = '=';
+        q += 4;
+    } else if (pend - p == 2) {
+        q[0] = s_szEncode[p[0] >> 2];
+        q[1] = s_szEncode[(p[0] & 0x03) << 4 | p[1] >> 4];
+        q[2] = s_szEncode[(p[1] & 0x0F) << 2];
+        q[3] = '=';
         q += 4;
     }
-    
-    *q = '\0';
-    return pEncoded;
+    return (size_t)(q - szOut);
 }
 
-char* ZBase64::Encode(const string& strData) {
-    return Encode(strData.c_str(), (int)strData.size());
+void ZBase64::Encode(const void *pData, size_t uDataLen, string &strOut) {
+    size_t uOffset = strOut.size();
+    strOut.resize(uOffset + EncodedLength(uDataLen));
+    Encode(pData, uDataLen, &strOut[0] + uOffset);
 }
 
-// Implementation of decoding functions
-const char* ZBase64::Decode(const char* pData, int nDataLen, int* pOutDataLen) {
-    if (nullptr == pData || nDataLen <= 0) {
-        return nullptr;
-    }
-    
-    // Skip whitespace and get actual length
-    int nRealLen = 0;
-    for (int i = 0; i < nDataLen; i++) {
-        if (!isspace((unsigned char)pData[i])) {
-            nRealLen++;
-        }
-    }
-    
-    // Length check
-    if (0 != (nRealLen % 4)) {
-        return nullptr;
-    }
-    
-    int nPadding = 0;
-    if (nRealLen > 0) {
-        if ('=' == pData[nDataLen - 1]) nPadding++;
-        if ('=' == pData[nDataLen - 2]) nPadding++;
-    }
-    
-    *pOutDataLen = nRealLen / 4 * 3 - nPadding;
-    char* pDecoded = new char[*pOutDataLen + 1];
-    m_arrDec.push_back(pDecoded);
-    
-    static unsigned char s_ca_table_dec[256] = {0};
-    static bool s_b_init = false;
-    if (!s_b_init) {
-        memset(s_ca_table_dec, 0xff, sizeof(s_ca_table_dec));
-        for (int i = 0; i < 64; i++) {
-            s_ca_table_dec[s_ca_table_enc[i]] = i;
-        }
-        s_b_init = true;
-    }
-    
-    const unsigned char* p = (const unsigned char*)pData;
-    unsigned char* q = (unsigned char*)pDecoded;
-    int j = 0;
-    
-    for (int i = 0; i < nDataLen; i++) {
-        if (isspace(p[i])) {
-            continue;
+string ZBase64::Encode(const string &strData) {
+    string strOut;
+    Encode(strData.data(), strData.size(), strOut);
+    return strOut;
+}
+
+bool ZBase64::Decode(const char *szData, size_t uDataLen, void *pOut, size_t &uOutLen) {
+    const uint8_t *p = (const uint8_t *)szData;
+    const uint8_t *pend = p + uDataLen;
+    uint8_t *q = (uint8_t *)pOut;
+    uint32_t uGroup = 0;
+    int nSextets = 0;
+    while (p < pend) {
+        if (0 == nSextets) {
+            DecodeBlocks(p, pend, q);
+            if (p >= pend) {
+                break;
+            }
         }
-        
-        unsigned char c = s_ca_table_dec[p[i]];
-        if (0xff == c) {
+
+        uint8_t c = s_szDecode[*p++];
+        if (0xFE == c) {
+            break;
+        } else if (0xFF == c) {
             continue;
         }
-        
-        switch (j % 4) {
-            case 0:
-                q[0] = c << 2;
-                break;
-            case 1:
-                q[0] |= c >> 4;
-                q[1] = c << 4;
-                break;
-            case 2:
-                q[1] |= c >> 2;
-                q[2] = c << 6;
-                break;
-            case 3:
-                q[2] |= c;
-                q += 3;
-                break;
+
+        uGroup = uGroup << 6 | c;
+        if (4 == ++nSextets) {
+            q[0] = (uint8_t)(uGroup >> 16);
+            q[1] = (uint8_t)(uGroup >> 8);
+            q[2] = (uint8_t)uGroup;
+            q += 3;
+            uGroup = 0;
+            nSextets = 0;
         }
-        j++;
     }
-    
-    pDecoded[*pOutDataLen] = '\0';
-    return pDecoded;
+
+    // an unpadded or '='-cut group, two characters give a byte and three give two
+    if (2 == nSextets) {
+        *q++ = (uint8_t)(uGroup >> 4);
+    } else if (3 == nSextets) {
+        *q++ = (uint8_t)(uGroup >> 10);
+        *q++ = (uint8_t)(uGroup >> 2);
+    }
+    uOutLen = (size_t)(q - (uint8_t *)pOut);
+    return (1 != nSextets);
+}
+
+bool ZBase64::Decode(const char *szData, size_t uDataLen, string &strOut) {
+    size_t uOffset = strOut.size();
+    size_t uOutLen = 0;
+    strOut.resize(uOffset + DecodedLength(uDataLen));
+    bool bRet = Decode(szData, uDataLen, &strOut[0] + uOffset, uOutLen);
+    strOut.resize(uOffset + uOutLen);
+    return bRet;
 }
 
-const char* ZBase64::Decode(const string& strData, int* pOutDataLen) {
-    return Decode(strData.c_str(), (int)strData.size(), pOutDataLen);
+bool ZBase64::Decode(const string &strData, string &strOut) {
+    return Decode(strData.data(), strData.size(), strOut);
 }
@@ -9,22 +9,27 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
-#include <vector>
 using namespace std;
 
+// Base64 without state: the output goes to a buffer of the caller or is appended to a string, nothing is
+// allocated per call. Whole vector blocks are coded at once with AVX2 or NEON, the rest byte by byte.
 class ZBase64 {
 public:
-    ZBase64(void);
-    ~ZBase64(void);
+    // characters the encoding of uDataLen bytes takes, and the most bytes uDataLen characters decode to
+    static size_t EncodedLength(size_t uDataLen) { return (uDataLen + 2) / 3 * 4; }
+    static size_t DecodedLength(size_t uDataLen) { return (uDataLen + 3) / 4 * 3; }
 
-    char *Encode(const char *pData, int nDataLen);
-    char *Encode(const string &strData);
-    const char *Decode(const char *pData, int nDataLen, int *pOutDataLen);
-    const char *Decode(const string &strData, int *pOutDataLen);
+    // writes EncodedLength(uDataLen) characters to szOut, without a NUL, and returns their count
+    static size_t Encode(const void *pData, size_t uDataLen, char *szOut);
+    static void Encode(const void *pData, size_t uDataLen, string &strOut);
+    static string Encode(const string &strData);
 
-private:
-    vector<char *> m_arrEnc;
-    vector<char *> m_arrDec;
-    static unsigned char s_ca_table_enc[];
+    // Whitespace and other bytes outside the alphabet are skipped, '=' ends the data. pOut takes at most
+    // DecodedLength(uDataLen) bytes and may be szData itself. False if a lone character is left at the end.
+    static bool Decode(const char *szData, size_t uDataLen, void *pOut, size_t &uOutLen);
+    static bool Decode(const char *szData, size_t uDataLen, string &strOut);
+    static bool Decode(const string &strData, string &strOut);
 };
@@ -13,9 +13,11 @@
 #include "common.h"
 #include "Utils.hpp"
 #include "base64.h"
+#include "fileio.h"
 #include <cinttypes>
 #include <fstream>
 #include <inttypes.h>
+#include <mutex>
 #include <openssl/sha.h>
 #include <sys/stat.h>
 
@@ -210,6 +212,66 @@ bool RemoveFolderV(const char *szFormatPath, ...) {
     return RemoveFolder(szFolder);
 }
 
+bool CopyFile(const char *szSrcFile, const char *szDstFile) {
+    struct stat st;
+    if (0 != lstat(szSrcFile, &st)) {
+        return false;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        char szLink[PATH_MAX] = {0};
+        ssize_t nLen = readlink(szSrcFile, szLink, PATH_MAX - 1);
+        if (nLen < 0) {
+            return false;
+        }
+        szLink[nLen] = 0;
+        RemoveFile(szDstFile);
+        return (0 == symlink(szLink, szDstFile));
+    }
+
+    return TransferFile(szSrcFile, szDstFile);
+}
+
+bool CopyFolder(const char *szSrcFolder, const char *szDstFolder) {
+    if (!IsFolder(szSrcFolder)) {
+        return CopyFile(szSrcFolder, szDstFolder);
+    }
+
+    CreateFolder(szDstFolder);
+    if (!IsFolder(szDstFolder)) {
+        ZLog::ErrorV("CopyFolder: Can't Create Folder! %s\n", szDstFolder);
+        return false;
+    }
+
+    DIR *dir = opendir(szSrcFolder);
+    if (NULL == dir) {
+        return false;
+    }
+
+    bool bRet = true;
+    dirent *ptr = readdir(dir);
+    while (NULL != ptr && bRet) {
+        if (0 != strcmp(ptr->d_name, ".") && 0 != strcmp(ptr->d_name, "..")) {
+            string strSrcNode = szSrcFolder;
+            strSrcNode += "/";
+            strSrcNode += ptr->d_name;
+            string strDstNode = szDstFolder;
+            strDstNode += "/";
+            strDstNode += ptr->d_name;
+
+            struct stat st;
+            if (0 == lstat(strSrcNode.c_str(), &st) && S_ISDIR(st.st_mode)) {
+                bRet = CopyFolder(strSrcNode.c_str(), strDstNode.c_str());
+            } else {
+                bRet = CopyFile(strSrcNode.c_str(), strDstNode.c_str());
+            }
+        }
+        ptr = readdir(dir);
+    }
+    closedir(dir);
+    return bRet;
+}
+
 bool RemoveFile(const char *szFile) { return (0 == remove(szFile)); }
 
 bool RemoveFileV(const char *szFormatPath, ...) {
@@ -490,35 +552,54 @@ bool SHASum(const string &strData, string &strSHA1, string &strSHA256) {
 }
 
 bool SHASumFile(const char *szFile, string &strSHA1, string &strSHA256) {
+    strSHA1.clear();
+    strSHA256.clear();
+    if (!IsFileExists(szFile)) {
+        return false;
+    }
+
+    int64_t nFileSize = GetFileSize(szFile);
+    uint64_t uStreamThreshold = GetSHASumStreamThreshold();
+    if (uStreamThreshold > 0 && (uint64_t)nFileSize >= uStreamThreshold) {
+        return SHASumFileStream(szFile, strSHA1, strSHA256);
+    }
+
     size_t sSize = 0;
-    uint8_t *pBase = (uint8_t *)MapFile(szFile, 0, 0, &sSize, true);
+    uint8_t *pBase = NULL;
+    if (nFileSize > 0) { // mmap can't map an empty file
+        pBase = (uint8_t *)MapFile(szFile, 0, 0, &sSize, true);
+        if (NULL == pBase) {
+            return false;
+        }
+    }
 
     SHASum(E_SHASUM_TYPE_1, pBase, sSize, strSHA1);
     SHASum(E_SHASUM_TYPE_256, pBase, sSize, strSHA256);
 
     if (NULL != pBase && sSize > 0) {
         munmap(pBase, sSize);
+        AddSHASumMappedBytes(sSize);
     }
     return (!strSHA1.empty() && !strSHA256.empty());
 }
 
 bool SHASumBase64(const string &strData, string &strSHA1Base64, string &strSHA256Base64) {
-    ZBase64 b64;
     string strSHA1;
     string strSHA256;
     SHASum(strData, strSHA1, strSHA256);
-    strSHA1Base64 = b64.Encode(strSHA1);
-    strSHA256Base64 = b64.Encode(strSHA256);
+    strSHA1Base64 = ZBase64::Encode(strSHA1);
+    strSHA256Base64 = ZBase64::Encode(strSHA256);
     return (!strSHA1Base64.empty() && !strSHA256Base64.empty());
 }
 
 bool SHASumBase64File(const char *szFile, string &strSHA1Base64, string &strSHA256Base64) {
-    ZBase64 b64;
     string strSHA1;
     string strSHA256;
-    SHASumFile(szFile, strSHA1, strSHA256);
-    strSHA1Base64 = b64.Encode(strSHA1);
-    strSHA256Base64 = b64.Encode(strSHA256);
+    if (!SHASumFile(szFile, strSHA1, strSHA256)) {
+        return false;
+    }
+    strSHA1Base64 = ZBase64::Encode(strSHA1);
+    strSHA256Base64 = ZBase64::Encode(strSHA256);
     return (!strSHA1Base64.empty() && !strSHA256Base64.empty());
 }
 
@@ -574,11 +655,19 @@ uint64_t ZTimer::PrintResult(bool bSuccess, const char *szFormatArgs, ...) {
     return Reset();
 }
 
-int ZLog::g_nLogLevel = ZLog::E_INFO;
+atomic<int> ZLog::g_nLogLevel(ZLog::E_INFO);
+static thread_local int g_nThreadLogLevel = -1;
+static mutex g_mutexLogFile;
 
 void ZLog::SetLogLever(int nLogLevel) { g_nLogLevel = nLogLevel; }
 
+// overrides the process log level for the calling thread only, -1 restores it
+void ZLog::SetThreadLogLevel(int nLogLevel) { g_nThreadLogLevel = nLogLevel; }
+
+int ZLog::GetLogLevel() { return (g_nThreadLogLevel >= 0) ? g_nThreadLogLevel : g_nLogLevel.load(); }
+
 void ZLog::writeToLogFile(const std::string &message) {
+    lock_guard<mutex> lock(g_mutexLogFile);
     const char *documentsPath = getDocumentsDirectory();
     std::string logFilePath = std::string(documentsPath) + "/logs.txt";
 
@@ -592,14 +681,14 @@ void ZLog::writeToLogFile(const std::string &message) {
 }
 
 void ZLog::Print(int nLevel, const char *szLog) {
-    if (g_nLogLevel >= nLevel) {
+    if (GetLogLevel() >= nLevel) {
         write(STDOUT_FILENO, szLog, strlen(szLog));
         writeToLogFile(szLog);
     }
 }
 
 void ZLog::PrintV(int nLevel, const char *szFormatArgs, ...) {
-    if (g_nLogLevel >= nLevel) {
+    if (GetLogLevel() >= nLevel) {
         PARSEVALIST(szFormatArgs, szLog)
         write(STDOUT_FILENO, szLog, strlen(szLog));
         writeToLogFile(szLog);
@@ -665,14 +754,14 @@ bool ZLog::WarnV(const char *szFormatArgs, ...) {
 }
 
 void ZLog::Print(const char *szLog) {
-    if (g_nLogLevel >= E_INFO) {
+    if (GetLogLevel() >= E_INFO) {
         write(STDOUT_FILENO, szLog, strlen(szLog));
         writeToLogFile(szLog);
     }
 }
 
 void ZLog::PrintV(const char *szFormatArgs, ...) {
-    if (g_nLogLevel >= E_INFO) {
+    if (GetLogLevel() >= E_INFO) {
         PARSEVALIST(szFormatArgs, szLog)
         write(STDOUT_FILENO, szLog, strlen(szLog));
         writeToLogFile(szLog);
@@ -680,18 +769,18 @@ void ZLog::PrintV(const char *szFormatArgs, ...) {
 }
 
 void ZLog::Debug(const char *szLog) {
-    if (g_nLogLevel >= E_DEBUG) {
+    if (GetLogLevel() >= E_DEBUG) {
         write(STDOUT_FILENO, szLog, strlen(szLog));
         writeToLogFile(szLog);
     }
 }
 
 void ZLog::DebugV(const char *szFormatArgs, ...) {
-    if (g_nLogLevel >= E_DEBUG) {
+    if (GetLogLevel() >= E_DEBUG) {
         PARSEVALIST(szFormatArgs, szLog)
         write(STDOUT_FILENO, szLog, strlen(szLog));
         writeToLogFile(szLog);
     }
 }
 
-bool ZLog::IsDebug() { return (E_DEBUG == g_nLogLevel); }
+bool ZLog::IsDebug() { return (E_DEBUG == GetLogLevel()); }
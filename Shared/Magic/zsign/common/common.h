@@ -31,6 +31,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <iostream>
 #include <map>
 #include <set>
@@ -67,6 +68,8 @@ bool RemoveFile(const char *szFile);
 bool RemoveFileV(const char *szFormatPath, ...);
 bool RemoveFolder(const char *szFolder);
 bool RemoveFolderV(const char *szFormatPath, ...);
+bool CopyFile(const char *szSrcFile, const char *szDstFile);
+bool CopyFolder(const char *szSrcFolder, const char *szDstFolder);
 bool IsFileExists(const char *szFile);
 bool IsFileExistsV(const char *szFormatPath, ...);
 int64_t GetFileSize(int fd);
@@ -155,8 +158,10 @@ public:
     static void Print(int nLevel, const char *szLog);
     static void PrintV(int nLevel, const char *szFormatArgs, ...);
     static void SetLogLever(int nLogLevel);
+    static void SetThreadLogLevel(int nLogLevel);
 
 private:
-    static int g_nLogLevel;
+    static int GetLogLevel();
+    static atomic<int> g_nLogLevel;
     static void writeToLogFile(const std::string &message);
 };
@@ -0,0 +1,680 @@
+/*
+ * Proprietary Software License Version 1.0
+ *
+ * Copyright (C) 2025 BDG
+ *
+ * Backdoor App Signer is proprietary software. You may not use, modify, or distribute it except as expressly permitted
+ * under the terms of the Proprietary Software License.
+ */
+
+/*
+ */
+
+#include "fileio.h"
+#include "base64.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <openssl/evp.h>
+#include <thread>
+
+#if defined(__APPLE__)
+#include <copyfile.h>
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+// options may be changed while other jobs are hashing, each job snapshots them once
+static atomic<uint32_t> g_uHashQueueDepth(32);
+static atomic<uint32_t> g_uHashBufferSize(128 * 1024);
+static atomic<uint32_t> g_uHashThreads(0);
+static atomic<uint64_t> g_uStreamThreshold(64 * 1024 * 1024);
+static atomic<uint32_t> g_uStreamWindowSize(4 * 1024 * 1024);
+
+static atomic<uint64_t> g_uBatchFiles(0);
+static atomic<uint64_t> g_uBatchBytes(0);
+static atomic<uint64_t> g_uMappedFiles(0);
+static atomic<uint64_t> g_uMappedBytes(0);
+static atomic<uint64_t> g_uStreamFiles(0);
+static atomic<uint64_t> g_uStreamBytes(0);
+
+void SetSHASumFilesOptions(uint32_t uQueueDepth, uint32_t uBufferSize, uint32_t uThreads) {
+    g_uHashQueueDepth = (uQueueDepth > 0) ? uQueueDepth : 32;
+    g_uHashBufferSize = (uBufferSize >= 4096) ? uBufferSize : 4096;
+    g_uHashThreads = uThreads;
+}
+
+class ZHashPipeline {
+public:
+    ZHashPipeline(const vector<string> &arrFiles, vector<string> &arrSHA1, vector<string> &arrSHA256)
+        : m_arrFiles(arrFiles), m_arrSHA1(arrSHA1), m_arrSHA256(arrSHA256) {
+        m_bDone = false;
+        m_uBufferSize = g_uHashBufferSize;
+    }
+
+public:
+    bool Run() {
+        size_t sCount = m_arrFiles.size();
+        m_arrSHA1.assign(sCount, string());
+        m_arrSHA256.assign(sCount, string());
+        if (0 == sCount) {
+            return true;
+        }
+
+        // order by device and inode, so reads walk the disk layout instead of the name order
+        vector<ZFileNode> arrNodes(sCount);
+        for (size_t i = 0; i < sCount; i++) {
+            ZFileNode &node = arrNodes[i];
+            node.uIndex = i;
+            node.uDev = 0;
+            node.uIno = 0;
+            node.sSize = 0;
+            struct stat st;
+            if (0 == stat(m_arrFiles[i].c_str(), &st)) {
+                node.uDev = (uint64_t)st.st_dev;
+                node.uIno = (uint64_t)st.st_ino;
+                node.sSize = (size_t)st.st_size;
+            }
+        }
+        sort(arrNodes.begin(), arrNodes.end(), [](const ZFileNode &a, const ZFileNode &b) {
+            return (a.uDev != b.uDev) ? (a.uDev < b.uDev) : (a.uIno < b.uIno);
+        });
+
+        uint32_t uThreads = g_uHashThreads;
+        if (0 == uThreads) {
+            uThreads = thread::hardware_concurrency();
+            uThreads = (uThreads > 8) ? 8 : ((uThreads < 1) ? 1 : uThreads);
+        }
+
+        m_arrBuffers.resize(g_uHashQueueDepth);
+        for (size_t i = 0; i < m_arrBuffers.size(); i++) {
+            m_arrBuffers[i].resize(m_uBufferSize);
+            m_arrFreeBuffers.push_back(&m_arrBuffers[i][0]);
+        }
+
+        vector<thread> arrWorkers;
+        for (uint32_t i = 0; i < uThreads; i++) {
+            arrWorkers.push_back(thread(&ZHashPipeline::Worker, this));
+        }
+
+        for (size_t i = 0; i < arrNodes.size(); i++) {
+            ZFileNode &node = arrNodes[i];
+            ZHashJob job;
+            job.uIndex = node.uIndex;
+            job.pBuffer = NULL;
+            job.sLength = 0;
+            job.bLarge = (node.sSize > m_uBufferSize);
+            if (!job.bLarge && node.sSize > 0) {
+                job.pBuffer = AcquireBuffer();
+                if (!ReadSmallFile(m_arrFiles[node.uIndex].c_str(), job.pBuffer, job.sLength, job.bLarge)) {
+                    ReleaseBuffer(job.pBuffer);
+                    continue;
+                }
+                if (job.bLarge) { // grown since stat
+                    ReleaseBuffer(job.pBuffer);
+                    job.pBuffer = NULL;
+                }
+            } else if (!job.bLarge && !IsFileExists(m_arrFiles[node.uIndex].c_str())) {
+                continue;
+            }
+            PushJob(job);
+        }
+
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_bDone = true;
+        }
+        m_cvJobs.notify_all();
+        for (size_t i = 0; i < arrWorkers.size(); i++) {
+            arrWorkers[i].join();
+        }
+
+        bool bRet = true;
+        for (size_t i = 0; i < sCount; i++) {
+            if (m_arrSHA1[i].empty() || m_arrSHA256[i].empty()) {
+                ZLog::WarnV(">>> Can't Get File SHASum! %s\n", m_arrFiles[i].c_str());
+                bRet = false;
+            }
+        }
+        return bRet;
+    }
+
+private:
+    struct ZFileNode {
+        size_t uIndex;
+        uint64_t uDev;
+        uint64_t uIno;
+        size_t sSize;
+    };
+
+    struct ZHashJob {
+        size_t uIndex;
+        char *pBuffer;
+        size_t sLength;
+        bool bLarge;
+    };
+
+    bool ReadSmallFile(const char *szFile, char *pBuffer, size_t &sLength, bool &bLarge) {
+        int fd = open(szFile, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        sLength = 0;
+        bool bRet = true;
+        while (sLength < m_uBufferSize) {
+            ssize_t nread = pread(fd, pBuffer + sLength, m_uBufferSize - sLength, sLength);
+            if (nread < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                bRet = false;
+                break;
+            }
+            if (0 == nread) {
+                break;
+            }
+            sLength += nread;
+        }
+
+        if (bRet && sLength == m_uBufferSize) {
+            char c = 0;
+            bLarge = (pread(fd, &c, 1, sLength) > 0);
+        }
+        close(fd);
+        return bRet;
+    }
+
+    char *AcquireBuffer() {
+        unique_lock<mutex> lock(m_mutex);
+        m_cvBuffers.wait(lock, [this] { return !m_arrFreeBuffers.empty(); });
+        char *pBuffer = m_arrFreeBuffers.back();
+        m_arrFreeBuffers.pop_back();
+        return pBuffer;
+    }
+
+    void ReleaseBuffer(char *pBuffer) {
+        if (NULL == pBuffer) {
+            return;
+        }
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_arrFreeBuffers.push_back(pBuffer);
+        }
+        m_cvBuffers.notify_one();
+    }
+
+    void PushJob(const ZHashJob &job) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_arrJobs.push_back(job);
+        }
+        m_cvJobs.notify_one();
+    }
+
+    void Worker() {
+        while (true) {
+            ZHashJob job;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_cvJobs.wait(lock, [this] { return !m_arrJobs.empty() || m_bDone; });
+                if (m_arrJobs.empty()) {
+                    break;
+                }
+                job = m_arrJobs.front();
+                m_arrJobs.pop_front();
+            }
+
+            string strSHA1;
+            string strSHA256;
+            if (!job.bLarge) {
+                g_uBatchFiles++;
+                g_uBatchBytes += job.sLength;
+            }
+            if (job.bLarge) {
+                SHASumFile(m_arrFiles[job.uIndex].c_str(), strSHA1, strSHA256);
+            } else {
+                SHASum(E_SHASUM_TYPE_1, (uint8_t *)job.pBuffer, job.sLength, strSHA1);
+                SHASum(E_SHASUM_TYPE_256, (uint8_t *)job.pBuffer, job.sLength, strSHA256);
+                ReleaseBuffer(job.pBuffer);
+            }
+
+            // every job owns a distinct index, so the result slots need no lock
+            m_arrSHA1[job.uIndex] = strSHA1;
+            m_arrSHA256[job.uIndex] = strSHA256;
+        }
+    }
+
+private:
+    const vector<string> &m_arrFiles;
+    vector<string> &m_arrSHA1;
+    vector<string> &m_arrSHA256;
+
+    mutex m_mutex;
+    condition_variable m_cvJobs;
+    condition_variable m_cvBuffers;
+    deque<ZHashJob> m_arrJobs;
+    vector<vector<char>> m_arrBuffers;
+    vector<char *> m_arrFreeBuffers;
+    uint32_t m_uBufferSize;
+    bool m_bDone;
+};
+
+bool SHASumFiles(const vector<string> &arrFiles, vector<string> &arrSHA1, vector<string> &arrSHA256) {
+    ZHashPipeline pipeline(arrFiles, arrSHA1, arrSHA256);
+    return pipeline.Run();
+}
+
+bool SHASumBase64Files(const vector<string> &arrFiles, vector<string> &arrSHA1Base64,
+                       vector<string> &arrSHA256Base64) {
+    vector<string> arrSHA1;
+    vector<string> arrSHA256;
+    bool bRet = SHASumFiles(arrFiles, arrSHA1, arrSHA256);
+
+    arrSHA1Base64.assign(arrFiles.size(), string());
+    arrSHA256Base64.assign(arrFiles.size(), string());
+    for (size_t i = 0; i < arrFiles.size(); i++) {
+        if (!arrSHA1[i].empty() && !arrSHA256[i].empty()) {
+            arrSHA1Base64[i] = ZBase64::Encode(arrSHA1[i]);
+            arrSHA256Base64[i] = ZBase64::Encode(arrSHA256[i]);
+        }
+    }
+    return bRet;
+}
+
+void SetSHASumStreamOptions(uint64_t uThreshold, uint32_t uWindowSize) {
+    g_uStreamThreshold = uThreshold;
+    if (uWindowSize > 0) {
+        g_uStreamWindowSize = (uWindowSize >= 65536) ? ByteAlign(uWindowSize - 1, 4096) : 65536;
+    }
+}
+
+uint64_t GetSHASumStreamThreshold() { return g_uStreamThreshold; }
+
+void GetSHASumStats(ZSHASumStats &stats) {
+    stats.uBatchFiles = g_uBatchFiles;
+    stats.uBatchBytes = g_uBatchBytes;
+    stats.uMappedFiles = g_uMappedFiles;
+    stats.uMappedBytes = g_uMappedBytes;
+    stats.uStreamFiles = g_uStreamFiles;
+    stats.uStreamBytes = g_uStreamBytes;
+}
+
+void ResetSHASumStats() {
+    g_uBatchFiles = 0;
+    g_uBatchBytes = 0;
+    g_uMappedFiles = 0;
+    g_uMappedBytes = 0;
+    g_uStreamFiles = 0;
+    g_uStreamBytes = 0;
+}
+
+void AddSHASumMappedBytes(uint64_t uBytes) {
+    g_uMappedFiles++;
+    g_uMappedBytes += uBytes;
+}
+
+class ZStreamReader {
+public:
+    ZStreamReader(int fd, uint32_t uWindowSize) {
+        m_fd = fd;
+        m_uWindowSize = uWindowSize;
+        m_bStop = false;
+        for (int i = 0; i < 2; i++) {
+            m_arrBuffers[i].resize(uWindowSize);
+            m_arrLengths[i] = 0;
+            m_arrFull[i] = false;
+        }
+    }
+
+public:
+    void Run() {
+        off_t offset = 0;
+        for (int i = 0;; i = 1 - i) {
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_cv.wait(lock, [this, i] { return !m_arrFull[i] || m_bStop; });
+                if (m_bStop) {
+                    return;
+                }
+            }
+
+            ssize_t nLength = ReadWindow(&m_arrBuffers[i][0], offset);
+            offset += (nLength > 0) ? nLength : 0;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_arrLengths[i] = nLength;
+                m_arrFull[i] = true;
+            }
+            m_cv.notify_all();
+            if (nLength <= 0) {
+                return;
+            }
+        }
+    }
+
+    // waits for window i and returns its length, 0 at the end of file, -1 on error
+    ssize_t Acquire(int i, const char *&pData) {
+        unique_lock<mutex> lock(m_mutex);
+        m_cv.wait(lock, [this, i] { return m_arrFull[i]; });
+        pData = &m_arrBuffers[i][0];
+        return m_arrLengths[i];
+    }
+
+    void Release(int i) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_arrFull[i] = false;
+        }
+        m_cv.notify_all();
+    }
+
+    void Stop() {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_bStop = true;
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    ssize_t ReadWindow(char *pBuffer, off_t offset) {
+        size_t sLength = 0;
+        while (sLength < m_uWindowSize) {
+            ssize_t nread = pread(m_fd, pBuffer + sLength, m_uWindowSize - sLength, offset + sLength);
+            if (nread < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                return -1;
+            }
+            if (0 == nread) {
+                break;
+            }
+            sLength += nread;
+        }
+        return (ssize_t)sLength;
+    }
+
+private:
+    int m_fd;
+    uint32_t m_uWindowSize;
+    bool m_bStop;
+    mutex m_mutex;
+    condition_variable m_cv;
+    vector<char> m_arrBuffers[2];
+    ssize_t m_arrLengths[2];
+    bool m_arrFull[2];
+};
+
+bool SHASumFileStream(const char *szFile, string &strSHA1, string &strSHA256) {
+    strSHA1.clear();
+    strSHA256.clear();
+
+    int fd = open(szFile, O_RDONLY);
+    if (fd < 0) {
+        ZLog::ErrorV("SHASumFileStream: Failed in open! %s, %s\n", szFile, strerror(errno));
+        return false;
+    }
+
+#if defined(__APPLE__)
+    fcntl(fd, F_NOCACHE, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    EVP_MD_CTX *ctx1 = EVP_MD_CTX_new();
+    EVP_MD_CTX *ctx256 = EVP_MD_CTX_new();
+    bool bRet = (NULL != ctx1 && NULL != ctx256);
+    if (bRet) {
+        bRet = (1 == EVP_DigestInit_ex(ctx1, EVP_sha1(), NULL)) && (1 == EVP_DigestInit_ex(ctx256, EVP_sha256(), NULL));
+    }
+
+    if (bRet) {
+        ZStreamReader reader(fd, g_uStreamWindowSize);
+        thread th(&ZStreamReader::Run, &reader);
+
+        off_t offset = 0;
+        for (int i = 0;; i = 1 - i) {
+            const char *pData = NULL;
+            ssize_t nLength = reader.Acquire(i, pData);
+            if (nLength <= 0) {
+                bRet = (0 == nLength);
+                break;
+            }
+
+            EVP_DigestUpdate(ctx1, pData, nLength);
+            EVP_DigestUpdate(ctx256, pData, nLength);
+#if !defined(__APPLE__) && defined(POSIX_FADV_DONTNEED)
+            posix_fadvise(fd, offset, nLength, POSIX_FADV_DONTNEED);
+#endif
+            offset += nLength;
+            g_uStreamBytes += nLength;
+            reader.Release(i);
+        }
+
+        reader.Stop();
+        th.join();
+    }
+
+    if (bRet) {
+        uint8_t hash1[EVP_MAX_MD_SIZE];
+        uint8_t hash256[EVP_MAX_MD_SIZE];
+        unsigned int uHash1Length = 0;
+        unsigned int uHash256Length = 0;
+        EVP_DigestFinal_ex(ctx1, hash1, &uHash1Length);
+        EVP_DigestFinal_ex(ctx256, hash256, &uHash256Length);
+        strSHA1.append((const char *)hash1, uHash1Length);
+        strSHA256.append((const char *)hash256, uHash256Length);
+        g_uStreamFiles++;
+    } else {
+        ZLog::ErrorV("SHASumFileStream: Failed in read! %s, %s\n", szFile, strerror(errno));
+    }
+
+    EVP_MD_CTX_free(ctx1);
+    EVP_MD_CTX_free(ctx256);
+    close(fd);
+    return bRet;
+}
+
+static off_t GetFileEnd(int fd) {
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        return -1;
+    }
+    return st.st_size;
+}
+
+static bool WriteAt(int fd, const char *pData, size_t sLength, off_t offset) {
+    while (sLength > 0) {
+        ssize_t nwrite = pwrite(fd, pData, sLength, offset);
+        if (nwrite < 0 && EINTR == errno) {
+            continue;
+        }
+        if (nwrite <= 0) {
+            return false;
+        }
+        pData += nwrite;
+        sLength -= nwrite;
+        offset += nwrite;
+    }
+    return true;
+}
+
+bool ReadFileRange(int fd, void *pBuffer, size_t sLength, off_t offset) {
+    char *pData = (char *)pBuffer;
+    while (sLength > 0) {
+        ssize_t nread = pread(fd, pData, sLength, offset);
+        if (nread < 0 && EINTR == errno) {
+            continue;
+        }
+        if (nread <= 0) {
+            return false;
+        }
+        pData += nread;
+        sLength -= nread;
+        offset += nread;
+    }
+    return true;
+}
+
+bool TransferData(int fdDst, const char *pData, size_t sLength) {
+    off_t offset = GetFileEnd(fdDst);
+    if (offset < 0) {
+        return false;
+    }
+    return WriteAt(fdDst, pData, sLength, offset);
+}
+
+bool TransferRange(int fdSrc, off_t offset, size_t sLength, int fdDst) {
+    off_t offDst = GetFileEnd(fdDst);
+    if (offset < 0 || offDst < 0) {
+        return false;
+    }
+
+#if defined(__linux__)
+    while (sLength > 0) {
+        ssize_t ncopy = copy_file_range(fdSrc, &offset, fdDst, &offDst, sLength, 0);
+        if (ncopy < 0 && EINTR == errno) {
+            continue;
+        }
+        if (ncopy <= 0) {
+            break;
+        }
+        sLength -= ncopy;
+    }
+
+    if (sLength > 0 && offDst == lseek(fdDst, offDst, SEEK_SET)) { // e.g. EXDEV on older kernels
+        while (sLength > 0) {
+            ssize_t nsend = sendfile(fdDst, fdSrc, &offset, sLength);
+            if (nsend < 0 && EINTR == errno) {
+                continue;
+            }
+            if (nsend <= 0) {
+                break;
+            }
+            sLength -= nsend;
+            offDst += nsend;
+        }
+    }
+#endif
+
+    char buf[65536];
+    while (sLength > 0) {
+        ssize_t nread = pread(fdSrc, buf, (sLength < sizeof(buf)) ? sLength : sizeof(buf), offset);
+        if (nread < 0 && EINTR == errno) {
+            continue;
+        }
+        if (nread <= 0 || !WriteAt(fdDst, buf, nread, offDst)) {
+            ZLog::ErrorV("TransferRange: Failed in read/write! %s\n", strerror(errno));
+            return false;
+        }
+        offset += nread;
+        offDst += nread;
+        sLength -= nread;
+    }
+    return true;
+}
+
+bool TransferZeros(int fdDst, size_t sLength) {
+    off_t offset = GetFileEnd(fdDst);
+    if (offset < 0) {
+        return false;
+    }
+
+    if (0 == ftruncate(fdDst, offset + sLength)) { // sparse, reads back as zeros
+        return true;
+    }
+
+    char buf[4096] = {0};
+    while (sLength > 0) {
+        size_t sWrite = (sLength < sizeof(buf)) ? sLength : sizeof(buf);
+        if (!WriteAt(fdDst, buf, sWrite, offset)) {
+            ZLog::ErrorV("TransferZeros: Failed in write! %s\n", strerror(errno));
+            return false;
+        }
+        offset += sWrite;
+        sLength -= sWrite;
+    }
+    return true;
+}
+
+bool MoveFileRange(int fd, off_t offSrc, off_t offDst, size_t sLength) {
+    if (offSrc == offDst || 0 == sLength) {
+        return true;
+    }
+
+    // walk from the end when moving up, so an overlapping source is read before it's overwritten
+    vector<char> buf(1024 * 1024);
+    size_t sDone = 0;
+    while (sDone < sLength) {
+        size_t sChunk = min(buf.size(), sLength - sDone);
+        off_t offChunk = (offDst > offSrc) ? (off_t)(sLength - sDone - sChunk) : (off_t)sDone;
+        if (!ReadFileRange(fd, &buf[0], sChunk, offSrc + offChunk) ||
+            !WriteAt(fd, &buf[0], sChunk, offDst + offChunk)) {
+            ZLog::ErrorV("MoveFileRange: Failed in read/write! %s\n", strerror(errno));
+            return false;
+        }
+        sDone += sChunk;
+    }
+    return true;
+}
+
+bool ZeroFileRange(int fd, off_t offset, size_t sLength) {
+    char buf[65536] = {0};
+    while (sLength > 0) {
+        size_t sWrite = (sLength < sizeof(buf)) ? sLength : sizeof(buf);
+        if (!WriteAt(fd, buf, sWrite, offset)) {
+            ZLog::ErrorV("ZeroFileRange: Failed in write! %s\n", strerror(errno));
+            return false;
+        }
+        offset += sWrite;
+        sLength -= sWrite;
+    }
+    return true;
+}
+
+bool TransferFile(const char *szSrcFile, const char *szDstFile) {
+#if defined(__APPLE__)
+    RemoveFile(szDstFile);
+    if (0 == clonefile(szSrcFile, szDstFile, CLONE_NOFOLLOW)) { // copy-on-write on APFS
+        return true;
+    }
+#endif
+
+    int fdSrc = open(szSrcFile, O_RDONLY);
+    if (fdSrc < 0) {
+        ZLog::ErrorV("TransferFile: Failed in open! %s, %s\n", szSrcFile, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (0 != fstat(fdSrc, &st)) {
+        ZLog::ErrorV("TransferFile: Failed in fstat! %s, %s\n", szSrcFile, strerror(errno));
+        close(fdSrc);
+        return false;
+    }
+
+    int fdDst = open(szDstFile, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if (fdDst < 0) {
+        ZLog::ErrorV("TransferFile: Failed in open! %s, %s\n", szDstFile, strerror(errno));
+        close(fdSrc);
+        return false;
+    }
+
+#if defined(__APPLE__)
+    bool bRet = (0 == fcopyfile(fdSrc, fdDst, NULL, COPYFILE_DATA));
+    if (!bRet && 0 == ftruncate(fdDst, 0)) {
+        bRet = TransferRange(fdSrc, 0, st.st_size, fdDst);
+    }
+#else
+    bool bRet = TransferRange(fdSrc, 0, st.st_size, fdDst);
+#endif
+
+    close(fdSrc);
+    close(fdDst);
+    return bRet;
+}
@@ -0,0 +1,60 @@
+/*
+ * Proprietary Software License Version 1.0
+ *
+ * Copyright (C) 2025 BDG
+ *
+ * Backdoor App Signer is proprietary software. You may not use, modify, or distribute it except as expressly permitted
+ * under the terms of the Proprietary Software License.
+ */
+
+/*
+ */
+
+#pragma once
+#include "common.h"
+
+// Batched hashing of many small files. Reads are issued in inode order into a fixed pool of
+// reusable buffers (the queue depth), while worker threads hash the completed buffers.
+// Files larger than a pool buffer are hashed by the workers with SHASumFile.
+// The result vectors are resized to arrFiles.size(); a failed file leaves empty entries.
+bool SHASumFiles(const vector<string> &arrFiles, vector<string> &arrSHA1, vector<string> &arrSHA256);
+bool SHASumBase64Files(const vector<string> &arrFiles, vector<string> &arrSHA1Base64,
+                       vector<string> &arrSHA256Base64);
+void SetSHASumFilesOptions(uint32_t uQueueDepth, uint32_t uBufferSize, uint32_t uThreads);
+
+// Streaming hashing for large files. The file is read in fixed windows with one window of read-ahead
+// on a helper thread, and each window is dropped from the page cache once hashed (F_NOCACHE on Darwin,
+// posix_fadvise(DONTNEED) elsewhere), so multi-GB assets don't evict the working set of other jobs.
+// SHASumFile switches to this mode for files of at least the configured threshold (0 disables it).
+// The window is at least 64K, 0 keeps the current one.
+bool SHASumFileStream(const char *szFile, string &strSHA1, string &strSHA256);
+void SetSHASumStreamOptions(uint64_t uThreshold, uint32_t uWindowSize);
+uint64_t GetSHASumStreamThreshold();
+
+struct ZSHASumStats {
+    uint64_t uBatchFiles;
+    uint64_t uBatchBytes;
+    uint64_t uMappedFiles;
+    uint64_t uMappedBytes;
+    uint64_t uStreamFiles;
+    uint64_t uStreamBytes;
+};
+
+void GetSHASumStats(ZSHASumStats &stats);
+void ResetSHASumStats();
+void AddSHASumMappedBytes(uint64_t uBytes);
+
+// File transfer helpers that keep bulk data out of user space where the platform allows it.
+// Ranges go through copy_file_range/sendfile on Linux, whole files are cloned (clonefile/fcopyfile)
+// on Darwin, and zero padding is appended sparsely by extending the file. Everything falls back
+// to buffered pread/pwrite. Appends always go to the current end of fdDst.
+bool ReadFileRange(int fd, void *pBuffer, size_t sLength, off_t offset);
+bool TransferData(int fdDst, const char *pData, size_t sLength);
+bool TransferRange(int fdSrc, off_t offset, size_t sLength, int fdDst);
+bool TransferZeros(int fdDst, size_t sLength);
+bool TransferFile(const char *szSrcFile, const char *szDstFile);
+
+// In-place range helpers for rewriting a file without a temp copy. MoveFileRange has memmove
+// semantics within fd, so a range can be shifted towards the end over its own tail.
+bool MoveFileRange(int fd, off_t offSrc, off_t offDst, size_t sLength);
+bool ZeroFileRange(int fd, off_t offset, size_t sLength);
@@ -11,6 +11,8 @@
 #include "json.h"
 #include "base64.h"
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
 #include <stdarg.h>
@@ -19,6 +21,16 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #ifndef WIN32
 #define _atoi64(val) strtoll(val, NULL, 10)
@@ -27,30 +39,373 @@
                 const JValue JValue::null;
 const string JValue::nullData;
 
-JValue::JValue(TYPE type) : m_eType(type) { m_Value.vFloat = 0; }
+JArena::JArena(const JValue *pOwner)
+    : m_pCur(NULL), m_pEnd(NULL), m_sBlockSize(4096), m_sUsed(0), m_sAtoms(0), m_pOwner(pOwner) {}
+
+JArena::~JArena() { Reset(); }
+
+void *JArena::Alloc(size_t size, size_t align) {
+    uintptr_t cur = ((uintptr_t)m_pCur + align - 1) & ~(uintptr_t)(align - 1);
+    if (NULL == m_pCur || cur + size > (uintptr_t)m_pEnd) {
+        if (size + align > m_sBlockSize / 4) { // large ones get a block of their own, the current one keeps filling
+            char *pBlock = (char *)malloc(size + align);
+            if (NULL == pBlock) {
+                return NULL;
+            }
+            m_arrBlocks.push_back(pBlock);
+            m_sUsed += size;
+            return (void *)(((uintptr_t)pBlock + align - 1) & ~(uintptr_t)(align - 1));
+        }
+
+        char *pBlock = (char *)malloc(m_sBlockSize);
+        if (NULL == pBlock) {
+            return NULL;
+        }
+        m_arrBlocks.push_back(pBlock);
+        m_pCur = pBlock;
+        m_pEnd = pBlock + m_sBlockSize;
+        m_sBlockSize = min(m_sBlockSize * 2, (size_t)1024 * 1024); // small documents stay small
+        cur = ((uintptr_t)m_pCur + align - 1) & ~(uintptr_t)(align - 1);
+    }
+
+    m_pCur = (char *)(cur + size);
+    m_sUsed += size;
+    return (void *)cur;
+}
+
+char *JArena::NewString(const char *str, size_t len) {
+    char *pstr = (char *)Alloc(len + 1, 1);
+    if (NULL != pstr) {
+        memcpy(pstr, str, len);
+        pstr[len] = 0;
+    }
+    return pstr;
+}
+
+const char *JArena::Intern(const char *str, size_t len, uint32_t hash) {
+    if (2 * (m_sAtoms + 1) > m_arrAtoms.size()) { // keep the load under a half
+        vector<Atom> arrAtoms(max((size_t)64, m_arrAtoms.size() * 2));
+        for (size_t i = 0; i < m_arrAtoms.size(); i++) {
+            if (NULL != m_arrAtoms[i].pStr) {
+                size_t j = m_arrAtoms[i].uHash & (arrAtoms.size() - 1);
+                while (NULL != arrAtoms[j].pStr) {
+                    j = (j + 1) & (arrAtoms.size() - 1);
+                }
+                arrAtoms[j] = m_arrAtoms[i];
+            }
+        }
+        m_arrAtoms.swap(arrAtoms);
+    }
+
+    size_t i = hash & (m_arrAtoms.size() - 1);
+    for (; NULL != m_arrAtoms[i].pStr; i = (i + 1) & (m_arrAtoms.size() - 1)) {
+        const Atom &atom = m_arrAtoms[i];
+        if (atom.uHash == hash && atom.uLen == len && 0 == memcmp(atom.pStr, str, len)) {
+            return atom.pStr;
+        }
+    }
+
+    Atom &atom = m_arrAtoms[i];
+    atom.pStr = NewString(str, len);
+    atom.uLen = (uint32_t)len;
+    atom.uHash = hash;
+    m_sAtoms++;
+    return atom.pStr;
+}
+
+void JArena::Reset() {
+    for (size_t i = 0; i < m_arrBlocks.size(); i++) {
+        free(m_arrBlocks[i]);
+    }
+    m_arrBlocks.clear();
+    m_arrAtoms.clear();
+    m_sAtoms = 0;
+    m_pCur = NULL;
+    m_pEnd = NULL;
+    m_sBlockSize = 4096;
+    m_sUsed = 0;
+}
+
+size_t JArena::Used() const { return m_sUsed; }
+
+static uint32_t KeyHash(const char *key, size_t len) { // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// same order as std::string, which objects used to be keyed by
+static bool KeyLess(const char *key1, size_t len1, const char *key2, size_t len2) {
+    int ret = memcmp(key1, key2, min(len1, len2));
+    return (ret < 0 || (0 == ret && len1 < len2));
+}
+
+struct JValue::JSlot {
+    const char *pKey;
+    JValue *pValue;
+    uint32_t uKeyLen;
+    uint32_t uHash;
+};
+
+// Members of an object, as a flat array of slots. Small objects keep the slots in key order and scan them by
+// hash; larger ones append and look up through an open-addressed index of slot numbers, and are sorted only
+// when their keys are listed (and didn't arrive in order). Values are allocated one by one, so references to
+// them stay valid while the object grows, as they did with std::map.
+class JValue::JObject {
+public:
+    static JObject *Create(JArena *pArena) {
+        if (NULL != pArena) {
+            return ::new (pArena->Alloc(sizeof(JObject), alignof(JObject))) JObject(pArena);
+        }
+        return new JObject(NULL);
+    }
+
+    // objects of a document are left to the arena
+    static void Destroy(JObject *pObject) {
+        if (NULL == pObject->m_pArena) {
+            delete pObject;
+        }
+    }
+
+    size_t Size() const { return m_uSize; }
+    const JSlot &Slot(size_t i) const { return m_pSlots[i]; }
+
+    JValue *Find(const char *key, size_t len, uint32_t hash) const {
+        if (NULL != m_pIndex) {
+            for (uint32_t i = hash & (m_uIndexSize - 1); 0 != m_pIndex[i]; i = (i + 1) & (m_uIndexSize - 1)) {
+                const JSlot &slot = m_pSlots[m_pIndex[i] - 1];
+                if (slot.uHash == hash && slot.uKeyLen == len && 0 == memcmp(slot.pKey, key, len)) {
+                    return slot.pValue;
+                }
+            }
+            return NULL;
+        }
+
+        for (uint32_t i = 0; i < m_uSize; i++) {
+            const JSlot &slot = m_pSlots[i];
+            if (slot.uHash == hash && slot.uKeyLen == len && 0 == memcmp(slot.pKey, key, len)) {
+                return slot.pValue;
+            }
+        }
+        return NULL;
+    }
+
+    // the key must not be in the object yet
+    JValue *Insert(const char *key, size_t len, uint32_t hash) {
+        if (m_uSize == m_uCapacity) {
+            Reserve(max((uint32_t)4, m_uCapacity * 2));
+        }
+
+        uint32_t uPos = m_uSize;
+        if (m_uSize > 0 && KeyLess(key, len, m_pSlots[m_uSize - 1].pKey, m_pSlots[m_uSize - 1].uKeyLen)) {
+            if (NULL == m_pIndex) { // small, keep it sorted
+                while (uPos > 0 && KeyLess(key, len, m_pSlots[uPos - 1].pKey, m_pSlots[uPos - 1].uKeyLen)) {
+                    uPos--;
+                }
+                memmove(m_pSlots + uPos + 1, m_pSlots + uPos, (m_uSize - uPos) * sizeof(JSlot));
+            } else {
+                m_bSorted = false;
+            }
+        }
+
+        JSlot &slot = m_pSlots[uPos];
+        slot.uKeyLen = (uint32_t)len;
+        slot.uHash = hash;
+        if (NULL != m_pArena) {
+            slot.pKey = m_pArena->Intern(key, len, hash);
+            slot.pValue = ::new (m_pArena->Alloc(sizeof(JValue), alignof(JValue))) JValue();
+            slot.pValue->m_pArena = m_pArena;
+        } else { // the key is stored right after the value it belongs to
+            char *pNode = (char *)::operator new(sizeof(JValue) + len + 1);
+            slot.pValue = ::new ((void *)pNode) JValue();
+            slot.pKey = pNode + sizeof(JValue);
+            memcpy(pNode + sizeof(JValue), key, len);
+            pNode[sizeof(JValue) + len] = 0;
+        }
+        m_uSize++;
+
+        if (NULL != m_pIndex && 2 * m_uSize <= m_uIndexSize) {
+            AddIndex(uPos);
+        } else if (NULL != m_pIndex || m_uSize > 16) {
+            BuildIndex();
+        }
+        return slot.pValue;
+    }
+
+    bool Erase(const char *key, size_t len, uint32_t hash) {
+        for (uint32_t i = 0; i < m_uSize; i++) {
+            JSlot &slot = m_pSlots[i];
+            if (slot.uHash == hash && slot.uKeyLen == len && 0 == memcmp(slot.pKey, key, len)) {
+                FreeSlot(slot);
+                memmove(m_pSlots + i, m_pSlots + i + 1, (m_uSize - i - 1) * sizeof(JSlot));
+                m_uSize--;
+                if (NULL != m_pIndex) {
+                    BuildIndex();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // slots in key order
+    void Sorted(vector<const JSlot *> &arrSlots) const {
+        arrSlots.resize(m_uSize);
+        for (uint32_t i = 0; i < m_uSize; i++) {
+            arrSlots[i] = &m_pSlots[i];
+        }
+        if (!m_bSorted) {
+            sort(arrSlots.begin(), arrSlots.end(), [](const JSlot *pSlot1, const JSlot *pSlot2) {
+                return KeyLess(pSlot1->pKey, pSlot1->uKeyLen, pSlot2->pKey, pSlot2->uKeyLen);
+            });
+        }
+    }
+
+    void Reserve(uint32_t uCapacity) {
+        if (uCapacity <= m_uCapacity) {
+            return;
+        }
+        JSlot *pSlots = (JSlot *)Alloc(uCapacity * sizeof(JSlot));
+        if (m_uSize > 0) {
+            memcpy(pSlots, m_pSlots, m_uSize * sizeof(JSlot));
+        }
+        Dealloc(m_pSlots);
+        m_pSlots = pSlots;
+        m_uCapacity = uCapacity;
+    }
+
+private:
+    JObject(JArena *pArena)
+        : m_pArena(pArena), m_pSlots(NULL), m_uSize(0), m_uCapacity(0), m_pIndex(NULL), m_uIndexSize(0),
+          m_bSorted(true) {}
+
+    ~JObject() {
+        for (uint32_t i = 0; i < m_uSize; i++) {
+            FreeSlot(m_pSlots[i]);
+        }
+        Dealloc(m_pSlots);
+        Dealloc(m_pIndex);
+    }
+
+    void *Alloc(size_t size) {
+        void *p = (NULL != m_pArena) ? m_pArena->Alloc(size, alignof(JSlot)) : malloc(size);
+        if (NULL == p) {
+            throw bad_alloc();
+        }
+        return p;
+    }
+
+    void Dealloc(void *p) {
+        if (NULL == m_pArena) {
+            free(p);
+        }
+    }
+
+    void FreeSlot(JSlot &slot) {
+        slot.pValue->~JValue();
+        if (NULL == m_pArena) {
+            ::operator delete((void *)slot.pValue);
+        }
+    }
+
+    void AddIndex(uint32_t uPos) {
+        uint32_t i = m_pSlots[uPos].uHash & (m_uIndexSize - 1);
+        while (0 != m_pIndex[i]) {
+            i = (i + 1) & (m_uIndexSize - 1);
+        }
+        m_pIndex[i] = uPos + 1;
+    }
+
+    void BuildIndex() {
+        uint32_t uIndexSize = 64;
+        while (uIndexSize < 2 * m_uSize) {
+            uIndexSize *= 2;
+        }
+        if (uIndexSize != m_uIndexSize) {
+            Dealloc(m_pIndex);
+            m_pIndex = (uint32_t *)Alloc(uIndexSize * sizeof(uint32_t));
+            m_uIndexSize = uIndexSize;
+        }
+        memset(m_pIndex, 0, m_uIndexSize * sizeof(uint32_t));
+        for (uint32_t i = 0; i < m_uSize; i++) {
+            AddIndex(i);
+        }
+    }
+
+private:
+    JArena *m_pArena;
+    JSlot *m_pSlots;
+    uint32_t m_uSize;
+    uint32_t m_uCapacity;
+    uint32_t *m_pIndex; // slot number + 1, 0 for an empty bucket
+    uint32_t m_uIndexSize;
+    bool m_bSorted;
+};
+
+// containers of a node come from its arena, or from the heap if it has none
+template <class T>
+static T *NewHolder(JArena *pArena) {
+    JAllocator<T> alloc(pArena);
+    return ::new ((void *)alloc.allocate(1)) T(typename T::allocator_type(pArena));
+}
+
+template <class T>
+static void DeleteHolder(T *p) {
+    p->~T();
+    ::operator delete(p);
+}
+
+JValue::JValue(TYPE type) : m_eType(type), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { m_Value.vFloat = 0; }
+
+JValue::JValue(int val) : m_eType(E_INT), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { m_Value.vInt64 = val; }
+
+JValue::JValue(int64_t val) : m_eType(E_INT), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { m_Value.vInt64 = val; }
 
-JValue::JValue(int val) : m_eType(E_INT) { m_Value.vInt64 = val; }
+JValue::JValue(bool val) : m_eType(E_BOOL), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { m_Value.vBool = val; }
 
-JValue::JValue(int64_t val) : m_eType(E_INT) { m_Value.vInt64 = val; }
+JValue::JValue(double val) : m_eType(E_FLOAT), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { m_Value.vFloat = val; }
 
-JValue::JValue(bool val) : m_eType(E_BOOL) { m_Value.vBool = val; }
+JValue::JValue(const char *val) : m_eType(E_NULL), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { SetString(val); }
 
-JValue::JValue(double val) : m_eType(E_FLOAT) { m_Value.vFloat = val; }
+JValue::JValue(const string &val) : m_eType(E_NULL), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { SetString(val.c_str()); }
 
-JValue::JValue(const char *val) : m_eType(E_STRING) { m_Value.vString = NewString(val); }
+JValue::JValue(const JValue &other) : m_pArena(NULL) { CopyValue(other); }
 
-JValue::JValue(const string &val) : m_eType(E_STRING) { m_Value.vString = NewString(val.c_str()); }
+// A value that isn't part of a document can't hold on to one, so document values are copied. Running out of
+// memory in that copy terminates, as it would anywhere else.
+JValue::JValue(JValue &&other) noexcept : m_pArena(NULL) {
+    if (NULL == other.m_pArena) {
+        MoveValue(other);
+    } else {
+        CopyValue(other);
+    }
+}
 
-JValue::JValue(const JValue &other) { CopyValue(other); }
+// Used by JArray to construct its elements, which belong to the arena of the array
+JValue::JValue(const JValue &other, JArena *pArena) : m_pArena(pArena) { CopyValue(other); }
 
-JValue::JValue(const char *val, size_t len) : m_eType(E_DATA) {
-    m_Value.vData = new string();
-    m_Value.vData->append(val, len);
+JValue::JValue(JValue &&other, JArena *pArena) noexcept : m_pArena(pArena) {
+    if (other.m_pArena == pArena) {
+        MoveValue(other);
+    } else {
+        CopyValue(other);
+    }
 }
 
+JValue::JValue(const char *val, size_t len) : m_eType(E_NULL), m_uInline(0), m_bBinaryPList(false), m_pArena(NULL) { SetData(val, len); }
+
 JValue::~JValue() { Free(); }
 
-void JValue::clear() { Free(); }
+// on the root of a JDocument this also drops the arena, so a document cleared and refilled doesn't keep
+// growing, whether it's reached as a JDocument or a JValue&
+void JValue::clear() {
+    Free();
+    if (NULL != m_pArena && m_pArena->IsOwner(this)) {
+        m_pArena->Reset();
+    }
+}
 
 bool JValue::isInt() const { return (E_INT == m_eType); }
 
@@ -90,7 +445,7 @@ bool JValue::isEmpty() const {
             return (0 == m_Value.vDate);
             break;
         case E_DATA:
-            return (NULL == m_Value.vData) ? true : m_Value.vData->empty();
+            return (0 == size());
             break;
     }
     return true;
@@ -108,32 +463,90 @@ JValue::operator string() const { return asCString(); }
 
 JValue::operator bool() const { return asBool(); }
 
-char *JValue::NewString(const char *cstr) {
-    char *str = NULL;
+// short strings live in the value itself, longer ones in the arena or on the heap. the value must be freed.
+void JValue::SetString(const char *cstr) {
+    m_eType = E_STRING;
+    m_uInline = 0;
+    m_Value.vString = NULL;
     if (NULL != cstr) {
-        size_t len = (strlen(cstr) + 1) * sizeof(char);
-        str = (char *)malloc(len);
-        memcpy(str, cstr, len);
+        size_t len = strlen(cstr);
+        if (len < sizeof(m_Value.vInline)) {
+            memcpy(m_Value.vInline, cstr, len + 1);
+            m_uInline = (uint8_t)(len + 1);
+        } else if (NULL != m_pArena) {
+            m_Value.vString = m_pArena->NewString(cstr, len);
+        } else {
+            m_Value.vString = (char *)malloc(len + 1);
+            memcpy(m_Value.vString, cstr, len + 1);
+        }
+    }
+}
+
+void JValue::SetData(const char *data, size_t len) {
+    m_eType = E_DATA;
+    m_uInline = 0;
+    if (len <= sizeof(m_Value.vInline)) { // fits a SHA-1
+        if (len > 0) {
+            memcpy(m_Value.vInline, data, len);
+        }
+        m_uInline = (uint8_t)(len + 1);
+    } else {
+        m_Value.vData = NewHolder<JString>(m_pArena);
+        m_Value.vData->assign(data, len);
     }
-    return str;
 }
 
+// takes over the tree of src, which must live in the same arena (or on the heap, as this value does)
+void JValue::MoveValue(JValue &src) {
+    m_eType = src.m_eType;
+    m_uInline = src.m_uInline;
+    m_bBinaryPList = src.m_bBinaryPList;
+    m_Value = src.m_Value;
+    src.m_eType = E_NULL;
+    src.m_uInline = 0;
+    src.m_Value.vFloat = 0;
+}
+
+// deep copy into this node's arena (or the heap), element by element so every child ends up in it too
 void JValue::CopyValue(const JValue &src) {
     m_eType = src.m_eType;
+    m_uInline = src.m_uInline;
+    m_bBinaryPList = src.m_bBinaryPList;
+    if (0 != m_uInline) {
+        m_Value = src.m_Value;
+        return;
+    }
+
     switch (m_eType) {
-        case E_ARRAY:
-            m_Value.vArray = (NULL == src.m_Value.vArray) ? NULL : new vector<JValue>(*(src.m_Value.vArray));
-            break;
-        case E_OBJECT:
-            m_Value.vObject = (NULL == src.m_Value.vObject) ? NULL : new map<string, JValue>(*(src.m_Value.vObject));
-            break;
+        case E_ARRAY: {
+            m_Value.vArray = NULL;
+            if (NULL != src.m_Value.vArray) {
+                m_Value.vArray = NewHolder<JArray>(m_pArena);
+                m_Value.vArray->reserve(src.m_Value.vArray->size());
+                for (size_t i = 0; i < src.m_Value.vArray->size(); i++) {
+                    m_Value.vArray->push_back(null);
+                    m_Value.vArray->back().CopyValue((*src.m_Value.vArray)[i]);
+                }
+            }
+        } break;
+        case E_OBJECT: {
+            m_Value.vObject = NULL;
+            if (NULL != src.m_Value.vObject) {
+                const JObject *pSrc = src.m_Value.vObject;
+                m_Value.vObject = JObject::Create(m_pArena);
+                m_Value.vObject->Reserve((uint32_t)pSrc->Size());
+                for (size_t i = 0; i < pSrc->Size(); i++) {
+                    const JSlot &slot = pSrc->Slot(i);
+                    m_Value.vObject->Insert(slot.pKey, slot.uKeyLen, slot.uHash)->CopyValue(*slot.pValue);
+                }
+            }
+        } break;
         case E_STRING:
-            m_Value.vString = (NULL == src.m_Value.vString) ? NULL : NewString(src.m_Value.vString);
+            SetString(src.m_Value.vString);
             break;
         case E_DATA: {
             if (NULL != src.m_Value.vData) {
-                m_Value.vData = new string();
-                *m_Value.vData = *src.m_Value.vData;
+                SetData(src.m_Value.vData->data(), src.m_Value.vData->size());
             } else {
                 m_Value.vData = NULL;
             }
@@ -145,6 +558,14 @@ void JValue::CopyValue(const JValue &src) {
 }
 
 void JValue::Free() {
+    if (NULL != m_pArena) { // the arena owns everything below this node
+        m_Value.vFloat = 0;
+        m_eType = E_NULL;
+        m_uInline = 0;
+        m_bBinaryPList = false;
+        return;
+    }
+
     switch (m_eType) {
         case E_INT: {
             m_Value.vInt64 = 0;
@@ -156,20 +577,20 @@ void JValue::Free() {
             m_Value.vFloat = 0.0;
         } break;
         case E_STRING: {
-            if (NULL != m_Value.vString) {
+            if (0 == m_uInline && NULL != m_Value.vString) {
                 free(m_Value.vString);
-                m_Value.vString = NULL;
             }
+            m_Value.vString = NULL;
         } break;
         case E_ARRAY: {
             if (NULL != m_Value.vArray) {
-                delete m_Value.vArray;
+                DeleteHolder(m_Value.vArray);
                 m_Value.vArray = NULL;
             }
         } break;
         case E_OBJECT: {
             if (NULL != m_Value.vObject) {
-                delete m_Value.vObject;
+                JObject::Destroy(m_Value.vObject);
                 m_Value.vObject = NULL;
             }
         } break;
@@ -177,15 +598,17 @@ void JValue::Free() {
             m_Value.vDate = 0;
         } break;
         case E_DATA: {
-            if (NULL != m_Value.vData) {
-                delete m_Value.vData;
-                m_Value.vData = NULL;
+            if (0 == m_uInline && NULL != m_Value.vData) {
+                DeleteHolder(m_Value.vData);
             }
+            m_Value.vData = NULL;
         } break;
         default:
             break;
     }
     m_eType = E_NULL;
+    m_uInline = 0;
+    m_bBinaryPList = false;
 }
 
 JValue &JValue::operator=(const JValue &other) {
@@ -196,6 +619,35 @@ JValue &JValue::operator=(const JValue &other) {
     return (*this);
 }
 
+JValue &JValue::operator=(JValue &&other) noexcept {
+    if (this != &other) {
+        if (other.m_pArena == m_pArena) { // other may be part of this tree, detach it first
+            JValue temp;
+            temp.m_pArena = m_pArena;
+            temp.MoveValue(other);
+            Free();
+            MoveValue(temp);
+        } else {
+            Free();
+            CopyValue(other);
+        }
+    }
+    return (*this);
+}
+
+void JValue::swap(JValue &other) {
+    if (other.m_pArena == m_pArena) {
+        std::swap(m_eType, other.m_eType);
+        std::swap(m_uInline, other.m_uInline);
+        std::swap(m_bBinaryPList, other.m_bBinaryPList);
+        std::swap(m_Value, other.m_Value);
+    } else if (this != &other) {
+        JValue temp(std::move(other));
+        other = std::move(*this);
+        (*this) = std::move(temp);
+    }
+}
+
 JValue &JValue::operator=(int val) {
     Free();
     m_eType = E_INT;
@@ -226,15 +678,13 @@ JValue &JValue::operator=(int64_t val) {
 
 JValue &JValue::operator=(const char *val) {
     Free();
-    m_eType = E_STRING;
-    m_Value.vString = NewString(val);
+    SetString(val);
     return (*this);
 }
 
 JValue &JValue::operator=(const string &val) {
     Free();
-    m_eType = E_STRING;
-    m_Value.vString = NewString(val.c_str());
+    SetString(val.c_str());
     return (*this);
 }
 
@@ -297,16 +747,16 @@ bool JValue::asBool() const {
             return (NULL == m_Value.vArray) ? false : (m_Value.vArray->size() > 0);
             break;
         case E_OBJECT:
-            return (NULL == m_Value.vObject) ? false : (m_Value.vObject->size() > 0);
+            return (NULL == m_Value.vObject) ? false : (m_Value.vObject->Size() > 0);
             break;
         case E_STRING:
-            return (NULL == m_Value.vString) ? false : (strlen(m_Value.vString) > 0);
+            return (strlen(asCString()) > 0);
             break;
         case E_DATE:
             return (m_Value.vDate > 0);
             break;
         case E_DATA:
-            return (NULL == m_Value.vData) ? false : (m_Value.vData->size() > 0);
+            return (size() > 0);
             break;
         default:
             break;
@@ -336,7 +786,7 @@ string JValue::asString() const {
             return "object";
             break;
         case E_STRING:
-            return (NULL == m_Value.vString) ? "" : m_Value.vString;
+            return asCString();
             break;
         case E_DATE:
             return "date";
@@ -351,8 +801,12 @@ string JValue::asString() const {
 }
 
 const char *JValue::asCString() const {
-    if (E_STRING == m_eType && NULL != m_Value.vString) {
-        return m_Value.vString;
+    if (E_STRING == m_eType) {
+        if (0 != m_uInline) {
+            return m_Value.vInline;
+        } else if (NULL != m_Value.vString) {
+            return m_Value.vString;
+        }
     }
     return "";
 }
@@ -363,9 +817,12 @@ size_t JValue::size() const {
             return (NULL == m_Value.vArray) ? 0 : m_Value.vArray->size();
             break;
         case E_OBJECT:
-            return (NULL == m_Value.vObject) ? 0 : m_Value.vObject->size();
+            return (NULL == m_Value.vObject) ? 0 : m_Value.vObject->Size();
             break;
         case E_DATA:
+            if (0 != m_uInline) {
+                return m_uInline - 1;
+            }
             return (NULL == m_Value.vData) ? 0 : m_Value.vData->size();
             break;
         default:
@@ -386,7 +843,7 @@ JValue &JValue::operator[](size_t index) {
     if (E_ARRAY != m_eType || NULL == m_Value.vArray) {
         Free();
         m_eType = E_ARRAY;
-        m_Value.vArray = new vector<JValue>();
+        m_Value.vArray = NewHolder<JArray>(m_pArena);
     }
 
     size_t sum = m_Value.vArray->size();
@@ -414,26 +871,27 @@ JValue &JValue::operator[](const string &key) { return (*this)[key.c_str()]; }
 const JValue &JValue::operator[](const string &key) const { return (*this)[key.c_str()]; }
 
 JValue &JValue::operator[](const char *key) {
-    map<string, JValue>::iterator it;
+    size_t len = strlen(key);
+    uint32_t hash = KeyHash(key, len);
     if (E_OBJECT != m_eType || NULL == m_Value.vObject) {
         Free();
         m_eType = E_OBJECT;
-        m_Value.vObject = new map<string, JValue>();
+        m_Value.vObject = JObject::Create(m_pArena);
     } else {
-        it = m_Value.vObject->find(key);
-        if (it != m_Value.vObject->end()) {
-            return it->second;
+        JValue *pValue = m_Value.vObject->Find(key, len, hash);
+        if (NULL != pValue) {
+            return *pValue;
         }
     }
-    it = m_Value.vObject->insert(m_Value.vObject->end(), make_pair(key, null));
-    return it->second;
+    return *m_Value.vObject->Insert(key, len, hash);
 }
 
 const JValue &JValue::operator[](const char *key) const {
     if (E_OBJECT == m_eType && NULL != m_Value.vObject) {
-        map<string, JValue>::const_iterator it = m_Value.vObject->find(key);
-        if (it != m_Value.vObject->end()) {
-            return it->second;
+        size_t len = strlen(key);
+        JValue *pValue = m_Value.vObject->Find(key, len, KeyHash(key, len));
+        if (NULL != pValue) {
+            return *pValue;
         }
     }
     return null;
@@ -441,9 +899,8 @@ const JValue &JValue::operator[](const char *key) const {
 
 bool JValue::has(const char *key) const {
     if (E_OBJECT == m_eType && NULL != m_Value.vObject) {
-        if (m_Value.vObject->end() != m_Value.vObject->find(key)) {
-            return true;
-        }
+        size_t len = strlen(key);
+        return (NULL != m_Value.vObject->Find(key, len, KeyHash(key, len)));
     }
 
     return false;
@@ -486,21 +943,19 @@ bool JValue::remove(size_t index) {
 
 bool JValue::remove(const char *key) {
     if (E_OBJECT == m_eType && NULL != m_Value.vObject) {
-        if (m_Value.vObject->end() != m_Value.vObject->find(key)) {
-            m_Value.vObject->erase(key);
-            return !has(key);
-        }
+        size_t len = strlen(key);
+        return m_Value.vObject->Erase(key, len, KeyHash(key, len));
     }
     return false;
 }
 
 bool JValue::keys(vector<string> &arrKeys) const {
     if (E_OBJECT == m_eType && NULL != m_Value.vObject) {
-        arrKeys.reserve(m_Value.vObject->size());
-        map<string, JValue>::iterator itbeg = m_Value.vObject->begin();
-        map<string, JValue>::iterator itend = m_Value.vObject->end();
-        for (; itbeg != itend; itbeg++) {
-            arrKeys.push_back((itbeg->first).c_str());
+        vector<const JSlot *> arrSlots;
+        m_Value.vObject->Sorted(arrSlots);
+        arrKeys.reserve(arrKeys.size() + arrSlots.size());
+        for (size_t i = 0; i < arrSlots.size(); i++) {
+            arrKeys.push_back(string(arrSlots[i]->pKey, arrSlots[i]->uKeyLen));
         }
         return true;
     }
@@ -538,7 +993,9 @@ JValue &JValue::front() {
         }
     } else if (E_OBJECT == m_eType) {
         if (size() > 0) {
-            return m_Value.vObject->begin()->second;
+            vector<const JSlot *> arrSlots;
+            m_Value.vObject->Sorted(arrSlots);
+            return *arrSlots.front()->pValue;
         }
     }
     return (*this);
@@ -551,7 +1008,9 @@ JValue &JValue::back() {
         }
     } else if (E_OBJECT == m_eType) {
         if (size() > 0) {
-            return m_Value.vObject->rbegin()->second;
+            vector<const JSlot *> arrSlots;
+            m_Value.vObject->Sorted(arrSlots);
+            return *arrSlots.back()->pValue;
         }
     }
     return (*this);
@@ -605,6 +1064,14 @@ bool JValue::push_back(const JValue &jval) {
     return false;
 }
 
+bool JValue::push_back(JValue &&jval) {
+    if (E_ARRAY == m_eType || E_NULL == m_eType) {
+        (*this)[size()] = std::move(jval);
+        return true;
+    }
+    return false;
+}
+
 bool JValue::push_back(const char *val, size_t len) { return push_back(JValue(val, len)); }
 
 std::string JValue::styleWrite() const {
@@ -627,15 +1094,12 @@ void JValue::assignDate(time_t val) {
 
 void JValue::assignData(const char *val, size_t size) {
     Free();
-    m_eType = E_DATA;
-    m_Value.vData = new string();
-    m_Value.vData->append(val, size);
+    SetData(val, size);
 }
 
 void JValue::assignDateString(time_t val) {
     Free();
-    m_eType = E_STRING;
-    m_Value.vString = NewString(JWriter::d2s(val).c_str());
+    SetString(JWriter::d2s(val).c_str());
 }
 
 time_t JValue::asDate() const {
@@ -646,7 +1110,7 @@ time_t JValue::asDate() const {
         case E_STRING: {
             if (isDateString()) {
                 tm ft = {0};
-                sscanf(m_Value.vString + 5, "%04d-%02d-%02dT%02d:%02d:%02dZ", &ft.tm_year, &ft.tm_mon, &ft.tm_mday,
+                sscanf(asCString() + 5, "%04d-%02d-%02dT%02d:%02d:%02dZ", &ft.tm_year, &ft.tm_mon, &ft.tm_mday,
                        &ft.tm_hour, &ft.tm_min, &ft.tm_sec);
                 ft.tm_mon -= 1;
                 ft.tm_year -= 1900;
@@ -662,15 +1126,15 @@ time_t JValue::asDate() const {
 string JValue::asData() const {
     switch (m_eType) {
         case E_DATA:
-            return (NULL == m_Value.vData) ? nullData : *m_Value.vData;
+            if (0 != m_uInline) {
+                return string(m_Value.vInline, m_uInline - 1);
+            }
+            return (NULL == m_Value.vData) ? nullData : string(m_Value.vData->data(), m_Value.vData->size());
             break;
         case E_STRING: {
             if (isDataString()) {
-                ZBase64 b64;
-                int nDataLen = 0;
-                const char *pdata = b64.Decode(m_Value.vString + 5, 0, &nDataLen);
                 string strdata;
-                strdata.append(pdata, nDataLen);
+                ZBase64::Decode(asCString() + 5, strlen(asCString() + 5), strdata);
                 return strdata;
             }
         } break;
@@ -687,11 +1151,10 @@ bool JValue::isDate() const { return (E_DATE == m_eType); }
 
 bool JValue::isDataString() const {
     if (E_STRING == m_eType) {
-        if (NULL != m_Value.vString) {
-            if (strlen(m_Value.vString) >= 5) {
-                if (0 == memcmp(m_Value.vString, "data:", 5)) {
-                    return true;
-                }
+        const char *str = asCString();
+        if (strlen(str) >= 5) {
+            if (0 == memcmp(str, "data:", 5)) {
+                return true;
             }
         }
     }
@@ -701,13 +1164,12 @@ bool JValue::isDataString() const {
 
 bool JValue::isDateString() const {
     if (E_STRING == m_eType) {
-        if (NULL != m_Value.vString) {
-            if (25 == strlen(m_Value.vString)) {
-                if (0 == memcmp(m_Value.vString, "date:", 5)) {
-                    const char *pdate = m_Value.vString + 5;
-                    if ('T' == pdate[10] && 'Z' == pdate[19]) {
-                        return true;
-                    }
+        const char *str = asCString();
+        if (25 == strlen(str)) {
+            if (0 == memcmp(str, "date:", 5)) {
+                const char *pdate = str + 5;
+                if ('T' == pdate[10] && 'Z' == pdate[19]) {
+                    return true;
                 }
             }
         }
@@ -737,9 +1199,36 @@ bool JValue::readPList(const char *pdoc, size_t len /*= 0*/, string *pstrerr /*=
         }
     }
 
+    m_bBinaryPList = (bret && 0 == memcmp(pdoc, "bplist00", 8));
+    return bret;
+}
+
+bool JValue::readPListKeys(const string &strdoc, const vector<string> &arrKeyPaths, string *pstrerr /*= NULL*/) {
+    return readPListKeys(strdoc.data(), strdoc.size(), arrKeyPaths, pstrerr);
+}
+
+bool JValue::readPListKeys(const char *pdoc, size_t len, const vector<string> &arrKeyPaths,
+                           string *pstrerr /*= NULL*/) {
+    if (NULL == pdoc) {
+        return false;
+    }
+
+    PReader reader;
+    bool bret = reader.parse(pdoc, len, *this, arrKeyPaths);
+    if (!bret) {
+        if (NULL != pstrerr) {
+            reader.error(*pstrerr);
+        }
+    }
+
+    m_bBinaryPList = (bret && 0 == memcmp(pdoc, "bplist00", 8));
     return bret;
 }
 
+bool JValue::isBinaryPList() const { return m_bBinaryPList; }
+
+void JValue::setBinaryPList(bool bBinary) { m_bBinaryPList = bBinary; }
+
 bool JValue::readFile(const char *file, string *pstrerr /*= NULL*/) {
     if (NULL != file) {
         FILE *fp = fopen(file, "rb");
@@ -822,9 +1311,28 @@ bool JValue::writeFile(const char *file) {
 }
 
 bool JValue::writePListFile(const char *file) {
-    string strdata;
-    writePList(strdata);
-    return WriteDataToFile(file, strdata.data(), strdata.size());
+    int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    JSink sink(fd);
+    bool bRet = m_bBinaryPList ? PWriter::BinaryWrite(*this, sink) : PWriter::FastWrite(*this, sink);
+    return (0 == close(fd)) && bRet;
+}
+
+// also hashes the plist as it's written, which is what a code signature seals
+bool JValue::writePListFile(const char *file, string &strSHA1, string &strSHA256) {
+    int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    JSink sink(fd);
+    sink.EnableSHASum();
+    bool bRet = (m_bBinaryPList ? PWriter::BinaryWrite(*this, sink) : PWriter::FastWrite(*this, sink)) &&
+                sink.Finish(&strSHA1, &strSHA256);
+    return (0 == close(fd)) && bRet;
 }
 
 bool JValue::styleWriteFile(const char *file) {
@@ -885,15 +1393,24 @@ bool JValue::styleWritePath(const char *path, ...) {
 
 string JValue::writePList() const {
     string strDoc;
-    return writePList(strDoc);
+    writePList(strDoc); // binary plists have NULs, c_str() won't do
+    return strDoc;
 }
 
 const char *JValue::writePList(string &strDoc) const {
     strDoc.clear();
-    PWriter::FastWrite((*this), strDoc);
+    if (m_bBinaryPList) {
+        PWriter::BinaryWrite((*this), strDoc);
+    } else {
+        PWriter::FastWrite((*this), strDoc);
+    }
     return strDoc.c_str();
 }
 
+JDocument::JDocument() : m_arena(this) { m_pArena = &m_arena; }
+
+JDocument::~JDocument() { Free(); }
+
 // Class Reader
 // //////////////////////////////////////////////////////////////////
 bool JReader::parse(const char *pdoc, JValue &root) {
@@ -1355,8 +1872,7 @@ void JWriter::FastWriteValue(const JValue &jval, string &strDoc) {
         case JValue::E_DATA: {
             strDoc += "\"data:";
             const string &strData = jval.asData();
-            ZBase64 b64;
-            strDoc += b64.Encode(strData.data(), (int)strData.size());
+            ZBase64::Encode(strData.data(), strData.size(), strDoc);
             strDoc += "\"";
         } break;
     }
@@ -1421,8 +1937,7 @@ void JWriter::StyleWriteValue(const JValue &jval) {
             string strDoc;
             strDoc += "\"data:";
             const string &strData = jval.asData();
-            ZBase64 b64;
-            strDoc += b64.Encode(strData.data(), (int)strData.size());
+            ZBase64::Encode(strData.data(), strData.size(), strDoc);
             strDoc += "\"";
             PushValue(strDoc);
         } break;
@@ -1606,6 +2121,70 @@ std::string JWriter::vstring2s(const char *pstr) { return string("\\\"") + pstr
      (((x) & 0x00000000FF000000ull) << 8) | (((x) & 0x0000000000FF0000ull) << 24) |                                    \
      (((x) & 0x000000000000FF00ull) << 40) | (((x) & 0x00000000000000FFull) << 56))
 
+//////////////////////////////////////////////////////////////////////////
+// First byte in [pcur, pend) that is one of c1..c4 (bMatch) or none of them (!bMatch), pend if there is none.
+// XML plists are mostly long runs of base64 and paths between short tags, so this is where the reader
+// spends its time. Whole vector blocks are compared at once, the tail byte by byte.
+static const char *ScanBytes(const char *pcur, const char *pend, bool bMatch, char c1, char c2, char c3, char c4) {
+#if defined(__AVX2__)
+    const __m256i v1 = _mm256_set1_epi8(c1), v2 = _mm256_set1_epi8(c2);
+    const __m256i v3 = _mm256_set1_epi8(c3), v4 = _mm256_set1_epi8(c4);
+    for (; pend - pcur >= 32; pcur += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)pcur);
+        __m256i eq = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, v1), _mm256_cmpeq_epi8(v, v2)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, v3), _mm256_cmpeq_epi8(v, v4)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+        if (!bMatch) {
+            mask = ~mask;
+        }
+        if (0 != mask) {
+            return pcur + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2);
+    const __m128i v3 = _mm_set1_epi8(c3), v4 = _mm_set1_epi8(c4);
+    for (; pend - pcur >= 16; pcur += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)pcur);
+        __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, v1), _mm_cmpeq_epi8(v, v2)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, v3), _mm_cmpeq_epi8(v, v4)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        if (!bMatch) {
+            mask ^= 0xFFFF;
+        }
+        if (0 != mask) {
+            return pcur + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t v1 = vdupq_n_u8((uint8_t)c1), v2 = vdupq_n_u8((uint8_t)c2);
+    const uint8x16_t v3 = vdupq_n_u8((uint8_t)c3), v4 = vdupq_n_u8((uint8_t)c4);
+    for (; pend - pcur >= 16; pcur += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)pcur);
+        uint8x16_t eq = vorrq_u8(vorrq_u8(vceqq_u8(v, v1), vceqq_u8(v, v2)), vorrq_u8(vceqq_u8(v, v3), vceqq_u8(v, v4)));
+        if (!bMatch) {
+            eq = vmvnq_u8(eq);
+        }
+        // no movemask on NEON, narrowing leaves 4 bits per byte instead
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (0 != mask) {
+            return pcur + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+#endif
+    for (; pcur < pend; pcur++) {
+        char c = *pcur;
+        if (bMatch == (c == c1 || c == c2 || c == c3 || c == c4)) {
+            break;
+        }
+    }
+    return pcur;
+}
+
+static bool IsLabel(const char *pname, size_t len, const char *szName) {
+    return (strlen(szName) == len && 0 == memcmp(pname, szName, len));
+}
+
 //////////////////////////////////////////////////////////////////////////
 PReader::PReader() {
     // xml
@@ -1620,6 +2199,30 @@ PReader::PReader() {
     m_uOffsetSize = 0;
     m_pOffsetTable = 0;
     m_uDictParamSize = 0;
+
+    m_uWanted = 0;
+}
+
+const PReader::KeyPath *PReader::KeyPath::find(const char *szKey, size_t uKeyLen) const {
+    for (const KeyPath &child : arrChildren) {
+        if (child.strKey.size() == uKeyLen && 0 == memcmp(child.strKey.data(), szKey, uKeyLen)) {
+            return &child;
+        }
+    }
+    return NULL;
+}
+
+size_t PReader::KeyPath::finish() {
+    if (bWhole) {
+        arrChildren.clear();
+        uLeaves = 1;
+    } else {
+        uLeaves = 0;
+        for (KeyPath &child : arrChildren) {
+            uLeaves += child.finish();
+        }
+    }
+    return uLeaves;
 }
 
 bool PReader::parse(const char *pdoc, size_t len, JValue &root) {
@@ -1647,26 +2250,86 @@ bool PReader::parse(const char *pdoc, size_t len, JValue &root) {
     }
 }
 
-bool PReader::readValue(JValue &pval, Token &token) {
-    switch (token.type) {
-        case Token::E_True:
-            pval = true;
-            break;
-        case Token::E_False:
-            pval = false;
-            break;
-        case Token::E_Null:
-            pval = JValue();
-            break;
-        case Token::E_Integer:
-            return decodeNumber(token, pval);
-            break;
-        case Token::E_Real:
-            return decodeDouble(token, pval);
-            break;
-        case Token::E_ArrayNull:
-            pval = JValue(JValue::E_ARRAY);
-            break;
+bool PReader::parse(const char *pdoc, size_t len, JValue &root, const vector<string> &arrKeyPaths) {
+    m_keys = KeyPath();
+    for (const string &strPath : arrKeyPaths) {
+        KeyPath *pnode = &m_keys;
+        size_t uBegin = 0;
+        while (uBegin <= strPath.size()) {
+            size_t uEnd = strPath.find(':', uBegin);
+            if (string::npos == uEnd) {
+                uEnd = strPath.size();
+            }
+            KeyPath *pchild = const_cast<KeyPath *>(pnode->find(strPath.data() + uBegin, uEnd - uBegin));
+            if (NULL == pchild) {
+                pnode->arrChildren.emplace_back();
+                pchild = &pnode->arrChildren.back();
+                pchild->strKey.assign(strPath, uBegin, uEnd - uBegin);
+            }
+            pnode = pchild;
+            uBegin = uEnd + 1;
+        }
+        pnode->bWhole = true;
+        pnode->uPath = (size_t)(&strPath - arrKeyPaths.data());
+    }
+    m_uWanted = m_keys.finish();
+    m_arrSpans.assign(arrKeyPaths.size(), make_pair(string::npos, (size_t)0));
+
+    root.clear();
+    if (NULL == pdoc || len < 30) {
+        return false;
+    }
+
+    if (0 == memcmp(pdoc, "bplist00", 8)) {
+        m_pBeg = pdoc;
+        m_pTrailer = m_pBeg + len - 26;
+        m_uOffsetSize = m_pTrailer[0];
+        m_uDictParamSize = m_pTrailer[1];
+        m_uObjects = getUIntVal(m_pTrailer + 2, 8);
+        if (0 == m_uObjects) {
+            return false;
+        }
+        m_pOffsetTable = m_pBeg + getUIntVal(m_pTrailer + 18, 8);
+        return readBinaryDictionary(m_pBeg + getUIntVal(m_pOffsetTable, m_uOffsetSize), root, m_keys);
+    }
+
+    m_pBeg = pdoc;
+    m_pEnd = m_pBeg + len;
+    m_pCur = m_pBeg;
+    m_pErr = m_pBeg;
+    m_strErr = "null";
+
+    Token token;
+    readToken(token);
+    if (Token::E_DictionaryBegin == token.type) {
+        return readDictionary(root, m_keys);
+    } else if (Token::E_DictionaryNull == token.type) {
+        root = JValue(JValue::E_OBJECT);
+        return true;
+    }
+    return skipValue(token);
+}
+
+bool PReader::readValue(JValue &pval, Token &token) {
+    switch (token.type) {
+        case Token::E_True:
+            pval = true;
+            break;
+        case Token::E_False:
+            pval = false;
+            break;
+        case Token::E_Null:
+            pval = JValue();
+            break;
+        case Token::E_Integer:
+            return decodeNumber(token, pval);
+            break;
+        case Token::E_Real:
+            return decodeDouble(token, pval);
+            break;
+        case Token::E_ArrayNull:
+            pval = JValue(JValue::E_ARRAY);
+            break;
         case Token::E_ArrayBegin:
             return readArray(pval);
             break;
@@ -1691,10 +2354,10 @@ bool PReader::readValue(JValue &pval, Token &token) {
             string strval;
             decodeString(token, strval);
 
-            ZBase64 b64;
-            int nDecLen = 0;
-            const char *data = b64.Decode(strval.data(), (int)strval.size(), &nDecLen);
-            pval.assignData(data, nDecLen);
+            // decoded over the text, which is never shorter
+            size_t uDataLen = 0;
+            ZBase64::Decode(strval.data(), strval.size(), &strval[0], uDataLen);
+            pval.assignData(strval.data(), uDataLen);
         } break;
         case Token::E_String: {
             string strval;
@@ -1709,122 +2372,108 @@ bool PReader::readValue(JValue &pval, Token &token) {
     return true;
 }
 
-bool PReader::readLabel(string &label) {
+// pname is what follows '<' up to the first space or '>', so "<plist version=\"1.0\">" gives "plist"
+bool PReader::readLabel(const char *&pname, size_t &len) {
     skipSpaces();
-
-    char c = *m_pCur++;
-    if ('<' != c) {
+    if (m_pCur >= m_pEnd || '<' != *m_pCur++) {
         return false;
     }
 
-    label.clear();
-    label.reserve(10);
-    label += c;
-
-    bool bEnd = false;
-    while (m_pCur != m_pEnd) {
-        c = *m_pCur++;
-        if ('>' == c) {
-            if ('/' == *(m_pCur - 1) || '?' == *(m_pCur - 1)) {
-                label += *(m_pCur - 1);
-            }
-
-            label += c;
-            break;
-        } else if (' ' == c) {
-            bEnd = true;
-        } else if (!bEnd) {
-            label += c;
-        }
+    pname = m_pCur;
+    const char *pclose = ScanBytes(m_pCur, m_pEnd, true, '>', ' ', '>', ' ');
+    len = size_t(pclose - pname);
+    if (pclose != m_pEnd && ' ' == *pclose) {
+        pclose = ScanBytes(pclose, m_pEnd, true, '>', '>', '>', '>');
     }
 
-    if ('>' != c) {
-        label.clear();
+    if (pclose == m_pEnd) {
+        m_pCur = m_pEnd;
         return false;
     }
-
-    return (!label.empty());
+    m_pCur = pclose + 1;
+    return true;
 }
 
-void PReader::endLabel(Token &token, const char *szLabel) {
-    string label;
-    readLabel(label);
-    if (szLabel != label) {
+void PReader::endLabel(Token &token, const char *szName) {
+    const char *pname = NULL;
+    size_t len = 0;
+    if (!readLabel(pname, len) || !IsLabel(pname, len, szName)) {
         token.type = Token::E_Error;
     }
 }
 
 bool PReader::readToken(Token &token) {
-    string label;
-    if (!readLabel(label)) {
+    const char *pname = NULL;
+    size_t len = 0;
+    if (!readLabel(pname, len)) {
         token.type = Token::E_Error;
         return false;
     }
 
-    if ('?' == label.at(1) || '!' == label.at(1)) {
+    if (len > 0 && ('?' == pname[0] || '!' == pname[0])) {
         return readToken(token);
     }
 
-    if ("<dict>" == label) {
+    if (IsLabel(pname, len, "dict")) {
         token.type = Token::E_DictionaryBegin;
-    } else if ("</dict>" == label) {
+    } else if (IsLabel(pname, len, "/dict")) {
         token.type = Token::E_DictionaryEnd;
-    } else if ("<array>" == label) {
+    } else if (IsLabel(pname, len, "array")) {
         token.type = Token::E_ArrayBegin;
-    } else if ("</array>" == label) {
+    } else if (IsLabel(pname, len, "/array")) {
         token.type = Token::E_ArrayEnd;
-    } else if ("<key>" == label) {
+    } else if (IsLabel(pname, len, "key")) {
         token.pbeg = m_pCur;
         token.type = readString() ? Token::E_Key : Token::E_Error;
         token.pend = m_pCur;
 
-        endLabel(token, "</key>");
-    } else if ("<key/>" == label) {
+        endLabel(token, "/key");
+    } else if (IsLabel(pname, len, "key/")) {
         token.type = Token::E_Key;
-    } else if ("<string>" == label) {
+    } else if (IsLabel(pname, len, "string")) {
         token.pbeg = m_pCur;
         token.type = readString() ? Token::E_String : Token::E_Error;
         token.pend = m_pCur;
 
-        endLabel(token, "</string>");
-    } else if ("<date>" == label) {
+        endLabel(token, "/string");
+    } else if (IsLabel(pname, len, "date")) {
         token.pbeg = m_pCur;
         token.type = readString() ? Token::E_Date : Token::E_Error;
         token.pend = m_pCur;
 
-        endLabel(token, "</date>");
-    } else if ("<data>" == label) {
+        endLabel(token, "/date");
+    } else if (IsLabel(pname, len, "data")) {
         token.pbeg = m_pCur;
         token.type = readString() ? Token::E_Data : Token::E_Error;
         token.pend = m_pCur;
 
-        endLabel(token, "</data>");
-    } else if ("<integer>" == label) {
+        endLabel(token, "/data");
+    } else if (IsLabel(pname, len, "integer")) {
         token.pbeg = m_pCur;
         token.type = readNumber() ? Token::E_Integer : Token::E_Error;
         token.pend = m_pCur;
 
-        endLabel(token, "</integer>");
-    } else if ("<real>" == label) {
+        endLabel(token, "/integer");
+    } else if (IsLabel(pname, len, "real")) {
         token.pbeg = m_pCur;
         token.type = readNumber() ? Token::E_Real : Token::E_Error;
         token.pend = m_pCur;
 
-        endLabel(token, "</real>");
-    } else if ("<true/>" == label) {
+        endLabel(token, "/real");
+    } else if (IsLabel(pname, len, "true/")) {
         token.type = Token::E_True;
-    } else if ("<false/>" == label) {
+    } else if (IsLabel(pname, len, "false/")) {
         token.type = Token::E_False;
-    } else if ("<array/>" == label) {
+    } else if (IsLabel(pname, len, "array/")) {
         token.type = Token::E_ArrayNull;
-    } else if ("<dict/>" == label) {
+    } else if (IsLabel(pname, len, "dict/")) {
         token.type = Token::E_DictionaryNull;
-    } else if ("<data/>" == label || "<date/>" == label || "<string/>" == label || "<integer/>" == label ||
-               "<real/>" == label) {
+    } else if (IsLabel(pname, len, "data/") || IsLabel(pname, len, "date/") || IsLabel(pname, len, "string/") ||
+               IsLabel(pname, len, "integer/") || IsLabel(pname, len, "real/")) {
         token.type = Token::E_Null;
-    } else if ("<plist>" == label) {
+    } else if (IsLabel(pname, len, "plist")) {
         return readToken(token);
-    } else if ("</plist>" == label || "<plist/>" == label) {
+    } else if (IsLabel(pname, len, "/plist") || IsLabel(pname, len, "plist/")) {
         token.type = Token::E_End;
     } else {
         token.type = Token::E_Error;
@@ -1833,16 +2482,7 @@ bool PReader::readToken(Token &token) {
     return true;
 }
 
-void PReader::skipSpaces() {
-    while (m_pCur != m_pEnd) {
-        char c = *m_pCur;
-        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-            m_pCur++;
-        } else {
-            break;
-        }
-    }
-}
+void PReader::skipSpaces() { m_pCur = ScanBytes(m_pCur, m_pEnd, false, ' ', '\t', '\r', '\n'); }
 
 bool PReader::readNumber() {
     while (m_pCur != m_pEnd) {
@@ -1857,13 +2497,8 @@ bool PReader::readNumber() {
 }
 
 bool PReader::readString() {
-    while (m_pCur != m_pEnd) {
-        if ('<' == *m_pCur) {
-            break;
-        }
-        m_pCur++;
-    }
-    return ('<' == *m_pCur);
+    m_pCur = ScanBytes(m_pCur, m_pEnd, true, '<', '<', '<', '<');
+    return (m_pCur != m_pEnd);
 }
 
 bool PReader::readDictionary(JValue &pval) {
@@ -1894,6 +2529,88 @@ bool PReader::readDictionary(JValue &pval) {
     return addError("Missing '</dict>' or dictionary member name", key.pbeg);
 }
 
+bool PReader::readDictionary(JValue &pval, const KeyPath &path) {
+    Token key;
+    string strKey;
+    pval = JValue(JValue::E_OBJECT);
+    while (readToken(key)) {
+        if (Token::E_DictionaryEnd == key.type) {
+            return true;
+        }
+
+        if (Token::E_Key != key.type) {
+            break;
+        }
+
+        strKey.clear();
+        decodeString(key, strKey);
+        XMLUnescape(strKey);
+
+        Token val;
+        readToken(val);
+        const KeyPath *pchild = path.find(strKey.data(), strKey.size());
+        if (NULL == pchild) {
+            if (!skipValue(val)) {
+                return false;
+            }
+            continue;
+        }
+
+        // whatever this member held, the paths below it are settled once it has been read
+        size_t uWanted = m_uWanted;
+        bool bret = true;
+        if (pchild->bWhole) {
+            if (Token::E_String == val.type) {
+                m_arrSpans[pchild->uPath] = make_pair(size_t(val.pbeg - m_pBeg), size_t(val.pend - val.pbeg));
+            }
+            bret = readValue(pval[strKey.c_str()], val);
+        } else if (Token::E_DictionaryBegin == val.type) {
+            bret = readDictionary(pval[strKey.c_str()], *pchild);
+        } else {
+            bret = skipValue(val);
+        }
+        if (!bret) {
+            return false;
+        }
+
+        m_uWanted = uWanted - pchild->uLeaves;
+        if (0 == m_uWanted) {
+            return true;
+        }
+    }
+    return addError("Missing '</dict>' or dictionary member name", key.pbeg);
+}
+
+// steps over a value, nested ones included, without decoding anything
+bool PReader::skipValue(Token &token) {
+    size_t uDepth = 0;
+    while (true) {
+        switch (token.type) {
+            case Token::E_Error:
+            case Token::E_End:
+                return addError("Syntax error: value, dictionary or array expected.", token.pbeg);
+            case Token::E_DictionaryBegin:
+            case Token::E_ArrayBegin:
+                uDepth++;
+                break;
+            case Token::E_DictionaryEnd:
+            case Token::E_ArrayEnd:
+                if (0 == uDepth) {
+                    return addError("Syntax error: value, dictionary or array expected.", token.pbeg);
+                }
+                uDepth--;
+                break;
+            default:
+                break;
+        }
+
+        if (0 == uDepth) {
+            return true;
+        }
+        readToken(token);
+    }
+}
+
 bool PReader::readArray(JValue &pval) {
     pval = JValue(JValue::E_ARRAY);
 
@@ -1954,13 +2671,11 @@ bool PReader::decodeDouble(Token &token, JValue &pval) {
 bool PReader::decodeString(Token &token, string &strdec, bool filter) {
     const char *pcur = token.pbeg;
     const char *pend = token.pend;
-    strdec.reserve(size_t(token.pend - token.pbeg) + 6);
+    strdec.reserve(strdec.size() + size_t(pend - pcur));
     while (pcur != pend) {
-        char c = *pcur++;
-        if (filter && ('\n' == c || '\r' == c || '\t' == c)) {
-            continue;
-        }
-        strdec += c;
+        const char *pstop = filter ? ScanBytes(pcur, pend, true, '\n', '\r', '\t', '\t') : pend;
+        strdec.append(pcur, size_t(pstop - pcur));
+        pcur = (pstop == pend) ? pend : pstop + 1;
     }
     return true;
 }
@@ -2035,46 +2750,43 @@ bool PReader::readUIntSize(const char *&pcur, size_t &size) {
     return false;
 }
 
-bool PReader::readUnicode(const char *pcur, size_t size, JValue &pv) {
-    if (0 == size) {
-        pv = "";
-        return false;
-    }
-
-    uint16_t *unistr = (uint16_t *)malloc(2 * size);
-    memcpy(unistr, pcur, 2 * size);
-    for (size_t i = 0; i < size; i++) {
-        byteConvert((uint8_t *)(unistr + i), 2);
-    }
-
-    char *outbuf = (char *)malloc(3 * (size + 1));
-
-    size_t p = 0;
+// big-endian UTF-16 as bplist00 stores it, surrogate pairs combined and lone ones kept as they are
+static void AppendUTF16(const uint8_t *pcur, size_t size, string &strout) {
+    strout.reserve(strout.size() + 3 * size);
     size_t i = 0;
-    uint16_t wc = 0;
     while (i < size) {
-        wc = unistr[i++];
-        if (wc >= 0x800) {
-            outbuf[p++] = (char)(0xE0 + ((wc >> 12) & 0xF));
-            outbuf[p++] = (char)(0x80 + ((wc >> 6) & 0x3F));
-            outbuf[p++] = (char)(0x80 + (wc & 0x3F));
+        uint16_t wc = (uint16_t)((pcur[2 * i] << 8) | pcur[2 * i + 1]);
+        i++;
+        uint16_t wn = (i < size) ? (uint16_t)((pcur[2 * i] << 8) | pcur[2 * i + 1]) : 0;
+        if (wc >= 0xD800 && wc <= 0xDBFF && wn >= 0xDC00 && wn <= 0xDFFF) {
+            uint32_t uc = 0x10000 + ((uint32_t)(wc - 0xD800) << 10) + (wn - 0xDC00); // surrogate pair
+            i++;
+            strout += (char)(0xF0 + ((uc >> 18) & 0x7));
+            strout += (char)(0x80 + ((uc >> 12) & 0x3F));
+            strout += (char)(0x80 + ((uc >> 6) & 0x3F));
+            strout += (char)(0x80 + (uc & 0x3F));
+        } else if (wc >= 0x800) {
+            strout += (char)(0xE0 + ((wc >> 12) & 0xF));
+            strout += (char)(0x80 + ((wc >> 6) & 0x3F));
+            strout += (char)(0x80 + (wc & 0x3F));
         } else if (wc >= 0x80) {
-            outbuf[p++] = (char)(0xC0 + ((wc >> 6) & 0x1F));
-            outbuf[p++] = (char)(0x80 + (wc & 0x3F));
+            strout += (char)(0xC0 + ((wc >> 6) & 0x1F));
+            strout += (char)(0x80 + (wc & 0x3F));
         } else {
-            outbuf[p++] = (char)(wc & 0x7F);
+            strout += (char)(wc & 0x7F);
         }
     }
+}
 
-    outbuf[p] = 0;
-
-    pv = outbuf;
-
-    free(outbuf);
-    outbuf = NULL;
-    free(unistr);
-    unistr = NULL;
+bool PReader::readUnicode(const char *pcur, size_t size, JValue &pv) {
+    if (0 == size) {
+        pv = "";
+        return false;
+    }
 
+    string strval;
+    AppendUTF16((const uint8_t *)pcur, size, strval);
+    pv = strval.c_str();
     return true;
 }
 
@@ -2218,6 +2930,8 @@ bool PReader::readBinaryValue(const char *&pcur, JValue &pv) {
                 }
             }
 
+            pv = JValue(JValue::E_ARRAY); // empty ones too, as in XML
+
             for (size_t i = 0; i < size; i++) {
                 uint64_t uIndex = getUIntVal((const char *)pcur + i * m_uDictParamSize, m_uDictParamSize);
                 if (uIndex < m_uObjects) {
@@ -2239,9 +2953,10 @@ bool PReader::readBinaryValue(const char *&pcur, JValue &pv) {
                 }
             }
 
+            pv = JValue(JValue::E_OBJECT);
+
             for (size_t i = 0; i < size; i++) {
                 JValue pvKey;
-                JValue pvVal;
 
                 uint64_t uKeyIndex = getUIntVal((const char *)pcur + i * m_uDictParamSize, m_uDictParamSize);
                 uint64_t uValIndex = getUIntVal((const char *)pcur + (i + size) * m_uDictParamSize, m_uDictParamSize);
@@ -2251,13 +2966,13 @@ bool PReader::readBinaryValue(const char *&pcur, JValue &pv) {
                     readBinaryValue(pval, pvKey);
                 }
 
-                if (uValIndex < m_uObjects) {
+                if (pvKey.isString() && uValIndex < m_uObjects) { // read in place, not into a copy of the subtree
                     const char *pval = (m_pBeg + getUIntVal(m_pOffsetTable + uValIndex * m_uOffsetSize, m_uOffsetSize));
+                    JValue &pvVal = pv[pvKey.asCString()];
                     readBinaryValue(pval, pvVal);
-                }
-
-                if (pvKey.isString() && !pvVal.isNull()) {
-                    pv[pvKey.asCString()] = pvVal;
+                    if (pvVal.isNull()) {
+                        pv.remove(pvKey.asCString());
+                    }
                 }
             }
         } break;
@@ -2270,6 +2985,73 @@ bool PReader::readBinaryValue(const char *&pcur, JValue &pv) {
     return true;
 }
 
+// pcur is the marker of the object, anything but a dict leaves pv as it is
+bool PReader::readBinaryDictionary(const char *pcur, JValue &pv, const KeyPath &path) {
+    uint8_t c = *pcur++;
+    if (0xD0 != (c & 0xF0)) {
+        return true;
+    }
+
+    size_t size = c & 0x0F;
+    if (0x0F == size) {
+        if (!readUIntSize(pcur, size)) {
+            return false;
+        }
+    }
+
+    pv = JValue(JValue::E_OBJECT);
+
+    JValue pvKey;
+    for (size_t i = 0; i < size; i++) {
+        uint64_t uKeyIndex = getUIntVal((const char *)pcur + i * m_uDictParamSize, m_uDictParamSize);
+        uint64_t uValIndex = getUIntVal((const char *)pcur + (i + size) * m_uDictParamSize, m_uDictParamSize);
+        if (uKeyIndex >= m_uObjects || uValIndex >= m_uObjects) {
+            assert(0);
+            return false;
+        }
+
+        // ASCII keys are compared where they lie, only UTF-16 ones are decoded
+        const char *pkey = (m_pBeg + getUIntVal(m_pOffsetTable + uKeyIndex * m_uOffsetSize, m_uOffsetSize));
+        const char *szKey = NULL;
+        size_t uKeyLen = 0;
+        if (0x50 == ((uint8_t)*pkey & 0xF0)) {
+            uKeyLen = *pkey++ & 0x0F;
+            if (0x0F == uKeyLen && !readUIntSize(pkey, uKeyLen)) {
+                return false;
+            }
+            szKey = pkey;
+        } else {
+            readBinaryValue(pkey, pvKey);
+            if (!pvKey.isString()) {
+                continue;
+            }
+            szKey = pvKey.asCString();
+            uKeyLen = strlen(szKey);
+        }
+
+        const KeyPath *pchild = path.find(szKey, uKeyLen);
+        if (NULL == pchild) {
+            continue;
+        }
+
+        size_t uWanted = m_uWanted;
+        const char *pval = (m_pBeg + getUIntVal(m_pOffsetTable + uValIndex * m_uOffsetSize, m_uOffsetSize));
+        JValue &pvVal = pv[pchild->strKey.c_str()];
+        if (!(pchild->bWhole ? readBinaryValue(pval, pvVal) : readBinaryDictionary(pval, pvVal, *pchild))) {
+            return false;
+        }
+        if (pvVal.isNull()) {
+            pv.remove(pchild->strKey.c_str());
+        }
+
+        m_uWanted = uWanted - pchild->uLeaves;
+        if (0 == m_uWanted) {
+            return true;
+        }
+    }
+    return true;
+}
+
 bool PReader::parseBinary(const char *pbdoc, size_t len, JValue &pv) {
     m_pBeg = pbdoc;
 
@@ -2289,6 +3071,11 @@ bool PReader::parseBinary(const char *pbdoc, size_t len, JValue &pv) {
 }
 
 void PReader::XMLUnescape(string &strval) {
+    const char *pend = strval.data() + strval.size();
+    if (pend == ScanBytes(strval.data(), pend, true, '&', '&', '&', '&')) {
+        return;
+    }
+
     PWriter::StringReplace(strval, "&amp;", "&");
     PWriter::StringReplace(strval, "&lt;", "<");
     // PWriter::StringReplace(strval,"&gt;", ">");		//optional
@@ -2297,139 +3084,1162 @@ void PReader::XMLUnescape(string &strval) {
 }
 
 //////////////////////////////////////////////////////////////////////////
-void PWriter::FastWrite(const JValue &pval, string &strdoc) {
-    strdoc.clear();
-    strdoc =
-        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-        "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
-        "<plist version=\"1.0\">\n";
+static uint64_t ReadBE(const uint8_t *p, size_t size) {
+    uint64_t val = 0;
+    for (size_t i = 0; i < size; i++) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+PView::PView()
+    : m_pBeg(NULL), m_pEnd(NULL), m_pOffsetTable(NULL), m_uObjects(0), m_uOffsetSize(0), m_uRefSize(0), m_uObject(0) {
+}
+
+PView::PView(const char *pdoc, size_t len) : PView() {
+    if (NULL == pdoc || len < 40 || 0 != memcmp(pdoc, "bplist00", 8)) {
+        return;
+    }
 
-    string strindent;
-    FastWriteValue(pval, strdoc, strindent);
+    const uint8_t *pbeg = (const uint8_t *)pdoc;
+    const uint8_t *ptrailer = pbeg + len - 32;
+    uint8_t uOffsetSize = ptrailer[6];
+    uint8_t uRefSize = ptrailer[7];
+    uint64_t uObjects = ReadBE(ptrailer + 8, 8);
+    uint64_t uTop = ReadBE(ptrailer + 16, 8);
+    uint64_t uTable = ReadBE(ptrailer + 24, 8);
+    if (uOffsetSize < 1 || uOffsetSize > 8 || uRefSize < 1 || uRefSize > 8 || uTable < 8 || uTable > len - 32 ||
+        uObjects > (len - 32 - uTable) / uOffsetSize || uTop >= uObjects) {
+        return;
+    }
 
-    strdoc += "</plist>";
+    m_pBeg = pbeg;
+    m_pEnd = ptrailer;
+    m_pOffsetTable = pbeg + uTable;
+    m_uObjects = uObjects;
+    m_uOffsetSize = uOffsetSize;
+    m_uRefSize = uRefSize;
+    m_uObject = uTop;
 }
 
-void PWriter::FastWriteValue(const JValue &pval, string &strdoc, string &strindent) {
-    if (pval.isObject()) {
-        strdoc += strindent;
-        if (pval.isEmpty()) {
-            strdoc += "<dict/>\n";
-            return;
-        }
-        strdoc += "<dict>\n";
-        vector<string> arrKeys;
-        if (pval.keys(arrKeys)) {
-            strindent.push_back('\t');
-            for (size_t i = 0; i < arrKeys.size(); i++) {
-                if (!pval[arrKeys[i].c_str()].isNull()) {
-                    string strkey = arrKeys[i];
-                    XMLEscape(strkey);
-                    strdoc += strindent;
-                    strdoc += "<key>";
-                    strdoc += strkey;
-                    strdoc += "</key>\n";
-                    FastWriteValue(pval[arrKeys[i].c_str()], strdoc, strindent);
-                }
-            }
-            strindent.erase(strindent.end() - 1);
-        }
-        strdoc += strindent;
-        strdoc += "</dict>\n";
-    } else if (pval.isArray()) {
-        strdoc += strindent;
-        if (pval.isEmpty()) {
-            strdoc += "<array/>\n";
-            return;
-        }
-        strdoc += "<array>\n";
-        strindent.push_back('\t');
-        for (size_t i = 0; i < pval.size(); i++) {
-            FastWriteValue(pval[i], strdoc, strindent);
-        }
-        strindent.erase(strindent.end() - 1);
-        strdoc += strindent;
-        strdoc += "</array>\n";
-    } else if (pval.isDate()) {
-        strdoc += strindent;
-        strdoc += "<date>";
-        strdoc += JWriter::d2s(pval.asDate());
-        strdoc += "</date>\n";
-    } else if (pval.isData()) {
-        ZBase64 b64;
-        string strdata = pval.asData();
-        strdoc += strindent;
-        strdoc += "<data>\n";
-        strdoc += strindent;
-        strdoc += b64.Encode(strdata.data(), (int)strdata.size());
-        strdoc += "\n";
-        strdoc += strindent;
-        strdoc += "</data>\n";
-    } else if (pval.isString()) {
-        strdoc += strindent;
-        if (pval.isDateString()) {
-            strdoc += "<date>";
-            strdoc += pval.asString().c_str() + 5;
-            strdoc += "</date>\n";
-        } else if (pval.isDataString()) {
-            strdoc += "<data>\n";
-            strdoc += strindent;
-            strdoc += pval.asString().c_str() + 5;
-            strdoc += "\n";
-            strdoc += strindent;
-            strdoc += "</data>\n";
-        } else {
-            string strval = pval.asCString();
-            XMLEscape(strval);
-            strdoc += "<string>";
-            strdoc += strval;
-            strdoc += "</string>\n";
-        }
-    } else if (pval.isBool()) {
-        strdoc += strindent;
-        strdoc += (pval.asBool() ? "<true/>\n" : "<false/>\n");
-    } else if (pval.isInt()) {
-        strdoc += strindent;
-        strdoc += "<integer>";
-        char temp[32] = {0};
-        sprintf(temp, "%" PRId64, pval.asInt64());
-        strdoc += temp;
-        strdoc += "</integer>\n";
-    } else if (pval.isFloat()) {
-        strdoc += strindent;
-        strdoc += "<real>";
+const uint8_t *PView::object() const {
+    if (m_uObject >= m_uObjects) {
+        return NULL;
+    }
 
-        double v = pval.asFloat();
-        if (numeric_limits<double>::infinity() == v) {
-            strdoc += "+infinity";
-        } else {
-            char temp[32] = {0};
-            if (floor(v) == v) {
-                sprintf(temp, "%" PRId64, (int64_t)v);
-            } else {
-                sprintf(temp, "%.15lf", v);
-            }
-            strdoc += temp;
+    uint64_t uOffset = ReadBE(m_pOffsetTable + m_uObject * m_uOffsetSize, m_uOffsetSize);
+    if (uOffset < 8 || uOffset >= (uint64_t)(m_pEnd - m_pBeg)) {
+        return NULL;
+    }
+    return m_pBeg + uOffset;
+}
+
+// the bytes after the marker and length of a data, string, array or dict object, NULL unless they all fit
+const uint8_t *PView::payload(uint64_t &count) const {
+    const uint8_t *p = object();
+    if (NULL == p) {
+        return NULL;
+    }
+
+    uint8_t marker = *p++;
+    count = marker & 0x0F;
+    if (0x0F == count) {
+        if (p >= m_pEnd || 0x10 != (*p & 0xF0) || (*p & 0x0F) > 3) {
+            return NULL;
         }
+        size_t size = (size_t)1 << (*p++ & 0x0F);
+        if (size > (size_t)(m_pEnd - p)) {
+            return NULL;
+        }
+        count = ReadBE(p, size);
+        p += size;
+    }
 
-        strdoc += "</real>\n";
+    uint64_t unit = 1;
+    switch (marker & 0xF0) {
+        case 0x60:
+            unit = 2;
+            break;
+        case 0xA0:
+        case 0xC0:
+            unit = m_uRefSize;
+            break;
+        case 0xD0:
+            unit = 2 * (uint64_t)m_uRefSize;
+            break;
+    }
+    if (count > (uint64_t)(m_pEnd - p) / unit) {
+        return NULL;
     }
+    return p;
 }
 
-void PWriter::XMLEscape(string &strval) {
-    StringReplace(strval, "&", "&amp;");
-    StringReplace(strval, "<", "&lt;");
-    // StringReplace(strval, ">", "&gt;");		//option
-    // StringReplace(strval, "'", "&apos;");		//option
-    // StringReplace(strval, "\"", "&quot;");	//option
+PView PView::child(const uint8_t *pref) const {
+    PView view = *this;
+    view.m_uObject = ReadBE(pref, m_uRefSize);
+    if (view.m_uObject >= m_uObjects) {
+        view.m_uObject = m_uObjects;
+    }
+    return view;
 }
 
-string &PWriter::StringReplace(string &context, const string &from, const string &to) {
-    size_t lookHere = 0;
-    size_t foundHere;
-    while ((foundHere = context.find(from, lookHere)) != string::npos) {
-        context.replace(foundHere, from.size(), to);
-        lookHere = foundHere + to.size();
+PView::TYPE PView::type() const {
+    const uint8_t *p = object();
+    if (NULL == p) {
+        return E_NULL;
     }
-    return context;
+
+    uint8_t marker = *p;
+    switch (marker & 0xF0) {
+        case 0x00:
+            return (0x08 == marker || 0x09 == marker) ? E_BOOL : E_NULL;
+        case 0x10:
+            return ((marker & 0x0F) <= 3) ? E_INT : E_NULL;
+        case 0x80: // UIDs read as integers, as PReader has them
+            return E_INT;
+        case 0x20:
+            return (0x22 == marker || 0x23 == marker) ? E_REAL : E_NULL;
+        case 0x30:
+            return (0x33 == marker) ? E_DATE : E_NULL;
+        case 0x40:
+            return E_DATA;
+        case 0x50:
+        case 0x60:
+            return E_STRING;
+        case 0xA0:
+        case 0xC0:
+            return E_ARRAY;
+        case 0xD0:
+            return E_DICT;
+    }
+    return E_NULL;
+}
+
+bool PView::isNull() const { return (E_NULL == type()); }
+
+bool PView::isBool() const { return (E_BOOL == type()); }
+
+bool PView::isInt() const { return (E_INT == type()); }
+
+bool PView::isReal() const { return (E_REAL == type()); }
+
+bool PView::isDate() const { return (E_DATE == type()); }
+
+bool PView::isData() const { return (E_DATA == type()); }
+
+bool PView::isString() const { return (E_STRING == type()); }
+
+bool PView::isArray() const { return (E_ARRAY == type()); }
+
+bool PView::isDict() const { return (E_DICT == type()); }
+
+bool PView::asBool() const {
+    const uint8_t *p = object();
+    return (NULL != p && 0x09 == *p);
+}
+
+int64_t PView::asInt64() const {
+    if (E_INT != type()) {
+        return 0;
+    }
+
+    const uint8_t *p = object();
+    size_t size = (0x80 == (*p & 0xF0)) ? (size_t)(*p & 0x0F) + 1 : (size_t)1 << (*p & 0x0F);
+    p++;
+    if (size > (size_t)(m_pEnd - p)) {
+        return 0;
+    }
+    return (int64_t)ReadBE(p, size);
+}
+
+double PView::asReal() const {
+    TYPE t = type();
+    if (E_INT == t) {
+        return (double)asInt64();
+    } else if (E_REAL != t) {
+        return 0;
+    }
+
+    const uint8_t *p = object();
+    size_t size = (0x22 == *p++) ? 4 : 8;
+    if (size > (size_t)(m_pEnd - p)) {
+        return 0;
+    }
+
+    uint64_t bits = ReadBE(p, size);
+    if (4 == size) {
+        uint32_t bits32 = (uint32_t)bits;
+        float val = 0;
+        memcpy(&val, &bits32, sizeof(val));
+        return val;
+    }
+    double val = 0;
+    memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+time_t PView::asDate() const {
+    if (E_DATE != type()) {
+        return 0;
+    }
+
+    const uint8_t *p = object() + 1;
+    if (8 > m_pEnd - p) {
+        return 0;
+    }
+
+    uint64_t bits = ReadBE(p, 8);
+    double val = 0;
+    memcpy(&val, &bits, sizeof(val));
+    return (time_t)val + 978278400; // the epoch PReader and PWriter use
+}
+
+string_view PView::asData() const {
+    uint64_t count = 0;
+    const uint8_t *p = (E_DATA == type()) ? payload(count) : NULL;
+    return (NULL != p) ? string_view((const char *)p, (size_t)count) : string_view();
+}
+
+string_view PView::asStringView() const {
+    const uint8_t *p = object();
+    if (NULL == p || 0x50 != (*p & 0xF0)) {
+        return string_view();
+    }
+
+    uint64_t count = 0;
+    p = payload(count);
+    return (NULL != p) ? string_view((const char *)p, (size_t)count) : string_view();
+}
+
+string PView::asString() const {
+    const uint8_t *p = object();
+    if (NULL == p) {
+        return string();
+    } else if (0x50 == (*p & 0xF0)) {
+        return string(asStringView());
+    } else if (0x60 != (*p & 0xF0)) {
+        return string();
+    }
+
+    string strval;
+    uint64_t count = 0;
+    p = payload(count);
+    if (NULL != p) {
+        AppendUTF16(p, (size_t)count, strval);
+    }
+    return strval;
+}
+
+size_t PView::size() const {
+    TYPE t = type();
+    uint64_t count = 0;
+    if ((E_ARRAY != t && E_DICT != t) || NULL == payload(count)) {
+        return 0;
+    }
+    return (size_t)count;
+}
+
+// dicts aren't sorted in bplist00, so this is a walk over the keys
+size_t PView::find(const char *key) const {
+    uint64_t count = 0;
+    const uint8_t *prefs = isDict() ? payload(count) : NULL;
+    if (NULL == prefs) {
+        return (size_t)-1;
+    }
+
+    size_t len = strlen(key);
+    for (size_t i = 0; i < count; i++) {
+        PView pvKey = child(prefs + i * m_uRefSize);
+        const uint8_t *p = pvKey.object();
+        if (NULL == p) {
+            continue;
+        }
+
+        // a short ASCII key is matched on its marker alone, before any length decoding
+        uint8_t marker = *p;
+        if (0x50 == (marker & 0xF0)) {
+            if ((marker & 0x0F) < 0x0F) {
+                if ((size_t)(marker & 0x0F) == len && len < (size_t)(m_pEnd - p) && 0 == memcmp(p + 1, key, len)) {
+                    return i;
+                }
+            } else {
+                string_view strKey = pvKey.asStringView();
+                if (strKey.size() == len && 0 == memcmp(strKey.data(), key, len)) {
+                    return i;
+                }
+            }
+        } else if (0x60 == (marker & 0xF0) && pvKey.asString() == key) {
+            return i;
+        }
+    }
+    return (size_t)-1;
+}
+
+bool PView::has(const char *key) const { return ((size_t)-1 != find(key)); }
+
+PView PView::operator[](size_t index) const {
+    uint64_t count = 0;
+    const uint8_t *p = isArray() ? payload(count) : NULL;
+    if (NULL == p || index >= count) {
+        return PView();
+    }
+    return child(p + index * m_uRefSize);
+}
+
+PView PView::operator[](const char *key) const {
+    size_t index = find(key);
+    return ((size_t)-1 != index) ? valueAt(index) : PView();
+}
+
+PView PView::keyAt(size_t index) const {
+    uint64_t count = 0;
+    const uint8_t *p = isDict() ? payload(count) : NULL;
+    if (NULL == p || index >= count) {
+        return PView();
+    }
+    return child(p + index * m_uRefSize);
+}
+
+PView PView::valueAt(size_t index) const {
+    uint64_t count = 0;
+    const uint8_t *p = isDict() ? payload(count) : NULL;
+    if (NULL == p || index >= count) {
+        return PView();
+    }
+    return child(p + (count + index) * m_uRefSize);
+}
+
+size_t PView::offset() const {
+    const uint8_t *p = object();
+    return (NULL != p) ? (size_t)(p - m_pBeg) : 0;
+}
+
+bool PView::toJValue(JValue &jv) const { return toJValue(jv, 0); }
+
+// depth stops documents whose refs loop back on themselves
+bool PView::toJValue(JValue &jv, size_t depth) const {
+    if (depth > 512) {
+        return false;
+    }
+
+    switch (type()) {
+        case E_NULL:
+            jv = JValue();
+            break;
+        case E_BOOL:
+            jv = asBool();
+            break;
+        case E_INT:
+            jv = asInt64();
+            break;
+        case E_REAL:
+            jv = asReal();
+            break;
+        case E_DATE:
+            jv.assignDate(asDate());
+            break;
+        case E_DATA: {
+            string_view data = asData();
+            jv.assignData(data.data(), data.size());
+        } break;
+        case E_STRING:
+            jv = asString().c_str();
+            break;
+        case E_ARRAY: {
+            jv = JValue(JValue::E_ARRAY);
+            size_t count = size();
+            for (size_t i = 0; i < count; i++) {
+                if (!(*this)[i].toJValue(jv[i], depth + 1)) {
+                    return false;
+                }
+            }
+        } break;
+        case E_DICT: {
+            jv = JValue(JValue::E_OBJECT);
+            size_t count = size();
+            for (size_t i = 0; i < count; i++) {
+                PView pvKey = keyAt(i);
+                if (!pvKey.isString()) {
+                    continue;
+                }
+
+                string strKey = pvKey.asString();
+                JValue &jvVal = jv[strKey.c_str()];
+                if (!valueAt(i).toJValue(jvVal, depth + 1)) {
+                    return false;
+                }
+                if (jvVal.isNull()) {
+                    jv.remove(strKey.c_str());
+                }
+            }
+        } break;
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+struct JSink::SHAState {
+    SHA_CTX ctx1;
+    SHA256_CTX ctx256;
+};
+
+JSink::JSink(int fd) : m_fd(fd), m_pOutput(NULL), m_pSHA(NULL), m_bGood(fd >= 0), m_pCur(m_szBuffer) {}
+
+JSink::JSink(string &strOutput) : m_fd(-1), m_pOutput(&strOutput), m_pSHA(NULL), m_bGood(true), m_pCur(m_szBuffer) {}
+
+JSink::~JSink() { delete m_pSHA; }
+
+void JSink::EnableSHASum() {
+    if (NULL == m_pSHA) {
+        m_pSHA = new SHAState;
+        SHA1_Init(&m_pSHA->ctx1);
+        SHA256_Init(&m_pSHA->ctx256);
+    }
+}
+
+void JSink::Write(const char *data, size_t len) {
+    size_t room = m_szBuffer + sizeof(m_szBuffer) - m_pCur;
+    if (len > room) {
+        Flush();
+        if (len >= sizeof(m_szBuffer)) { // no point in copying it through the buffer
+            Emit(data, len);
+            return;
+        }
+    }
+    memcpy(m_pCur, data, len);
+    m_pCur += len;
+}
+
+bool JSink::Flush() {
+    Emit(m_szBuffer, m_pCur - m_szBuffer);
+    m_pCur = m_szBuffer;
+    return m_bGood;
+}
+
+bool JSink::Finish(string *pstrSHA1, string *pstrSHA256) {
+    Flush();
+    if (NULL != m_pSHA) {
+        uint8_t hash1[SHA_DIGEST_LENGTH];
+        uint8_t hash256[SHA256_DIGEST_LENGTH];
+        SHA1_Final(hash1, &m_pSHA->ctx1);
+        SHA256_Final(hash256, &m_pSHA->ctx256);
+        if (NULL != pstrSHA1) {
+            pstrSHA1->assign((const char *)hash1, sizeof(hash1));
+        }
+        if (NULL != pstrSHA256) {
+            pstrSHA256->assign((const char *)hash256, sizeof(hash256));
+        }
+        delete m_pSHA;
+        m_pSHA = NULL;
+    }
+    return m_bGood;
+}
+
+void JSink::Emit(const char *data, size_t len) {
+    if (0 == len) {
+        return;
+    }
+
+    if (NULL != m_pSHA) {
+        SHA1_Update(&m_pSHA->ctx1, data, len);
+        SHA256_Update(&m_pSHA->ctx256, data, len);
+    }
+
+    if (NULL != m_pOutput) {
+        m_pOutput->append(data, len);
+        return;
+    }
+
+    while (m_bGood && len > 0) {
+        ssize_t nwrite = write(m_fd, data, len);
+        if (nwrite < 0 && EINTR == errno) {
+            continue;
+        }
+        if (nwrite <= 0) {
+            m_bGood = false;
+            break;
+        }
+        data += nwrite;
+        len -= nwrite;
+    }
+}
+
+void PWriter::FastWrite(const JValue &pval, string &strdoc) {
+    strdoc.clear();
+    JSink sink(strdoc);
+    FastWrite(pval, sink);
+}
+
+bool PWriter::FastWrite(const JValue &pval, JSink &sink) {
+    sink.Write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+               "<plist version=\"1.0\">\n");
+    FastWriteValue(pval, sink, 0);
+    sink.Write("</plist>");
+    return sink.Flush();
+}
+
+static void WriteIndent(JSink &sink, size_t depth) {
+    static const char szTabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+    for (; depth > sizeof(szTabs) - 1; depth -= sizeof(szTabs) - 1) {
+        sink.Write(szTabs, sizeof(szTabs) - 1);
+    }
+    sink.Write(szTabs, depth);
+}
+
+void PWriter::FastWriteValue(const JValue &pval, JSink &sink, size_t depth) {
+    if (pval.isNull()) {
+        return;
+    }
+
+    WriteIndent(sink, depth);
+    if (pval.isObject()) {
+        if (pval.isEmpty()) {
+            sink.Write("<dict/>\n");
+            return;
+        }
+        sink.Write("<dict>\n");
+        vector<string> arrKeys;
+        if (pval.keys(arrKeys)) {
+            for (size_t i = 0; i < arrKeys.size(); i++) {
+                const JValue &pvMember = pval[arrKeys[i].c_str()];
+                if (!pvMember.isNull()) {
+                    WriteIndent(sink, depth + 1);
+                    sink.Write("<key>");
+                    XMLEscape(arrKeys[i].data(), arrKeys[i].size(), sink);
+                    sink.Write("</key>\n");
+                    FastWriteValue(pvMember, sink, depth + 1);
+                }
+            }
+        }
+        WriteIndent(sink, depth);
+        sink.Write("</dict>\n");
+    } else if (pval.isArray()) {
+        if (pval.isEmpty()) {
+            sink.Write("<array/>\n");
+            return;
+        }
+        sink.Write("<array>\n");
+        for (size_t i = 0; i < pval.size(); i++) {
+            FastWriteValue(pval[i], sink, depth + 1);
+        }
+        WriteIndent(sink, depth);
+        sink.Write("</array>\n");
+    } else if (pval.isDate()) {
+        sink.Write("<date>");
+        sink.Write(JWriter::d2s(pval.asDate()).c_str());
+        sink.Write("</date>\n");
+    } else if (pval.isData()) {
+        string strdata = pval.asData();
+        sink.Write("<data>\n");
+        WriteIndent(sink, depth);
+        // a stack buffer at a time, the chunks are a multiple of three so no padding falls between them
+        char szEncoded[4096];
+        for (size_t uOffset = 0; uOffset < strdata.size(); uOffset += 3072) {
+            size_t uLen = min(strdata.size() - uOffset, (size_t)3072);
+            sink.Write(szEncoded, ZBase64::Encode(strdata.data() + uOffset, uLen, szEncoded));
+        }
+        sink.Write('\n');
+        WriteIndent(sink, depth);
+        sink.Write("</data>\n");
+    } else if (pval.isString()) {
+        if (pval.isDateString()) {
+            sink.Write("<date>");
+            sink.Write(pval.asCString() + 5);
+            sink.Write("</date>\n");
+        } else if (pval.isDataString()) {
+            sink.Write("<data>\n");
+            WriteIndent(sink, depth);
+            sink.Write(pval.asCString() + 5);
+            sink.Write('\n');
+            WriteIndent(sink, depth);
+            sink.Write("</data>\n");
+        } else {
+            const char *str = pval.asCString();
+            sink.Write("<string>");
+            XMLEscape(str, strlen(str), sink);
+            sink.Write("</string>\n");
+        }
+    } else if (pval.isBool()) {
+        sink.Write(pval.asBool() ? "<true/>\n" : "<false/>\n");
+    } else if (pval.isInt()) {
+        sink.Write("<integer>");
+        char temp[32] = {0};
+        sprintf(temp, "%" PRId64, pval.asInt64());
+        sink.Write(temp);
+        sink.Write("</integer>\n");
+    } else if (pval.isFloat()) {
+        sink.Write("<real>");
+
+        double v = pval.asFloat();
+        if (numeric_limits<double>::infinity() == v) {
+            sink.Write("+infinity");
+        } else {
+            char temp[32] = {0};
+            if (floor(v) == v) {
+                sprintf(temp, "%" PRId64, (int64_t)v);
+            } else {
+                sprintf(temp, "%.15lf", v);
+            }
+            sink.Write(temp);
+        }
+
+        sink.Write("</real>\n");
+    }
+}
+
+void PWriter::XMLEscape(const char *str, size_t len, JSink &sink) {
+    const char *pend = str + len;
+    const char *prun = str;
+    for (const char *p = str; p < pend; p++) {
+        if ('&' == *p || '<' == *p) { // '>', '\'' and '"' are optional
+            sink.Write(prun, p - prun);
+            sink.Write(('&' == *p) ? "&amp;" : "&lt;");
+            prun = p + 1;
+        }
+    }
+    sink.Write(prun, pend - prun);
+}
+
+// bplist00 writer. Objects are numbered depth first from the root, scalars that encode to the same bytes (keys,
+// above all) are stored once, and object references and offsets are as wide as the object count and the
+// document size need.
+class BPListWriter {
+public:
+    BPListWriter() : m_uOffset(0), m_uScalars(0) {}
+
+    bool Write(const JValue &pval, JSink &sink) {
+        Flatten(pval);
+
+        size_t uRefSize = IntSize(m_arrObjects.size() - 1);
+        vector<uint64_t> arrOffsets(m_arrObjects.size());
+        string strObject;
+        Emit(sink, "bplist00", 8);
+        for (size_t i = 0; i < m_arrObjects.size(); i++) {
+            const Object &object = m_arrObjects[i];
+            arrOffsets[i] = m_uOffset;
+            if (NULL != object.pBytes) {
+                Emit(sink, object.pBytes, object.uRefCount);
+                continue;
+            }
+
+            strObject.clear();
+            bool bDict = object.pval->isObject();
+            PutMarker(strObject, bDict ? 0xD0 : 0xA0, bDict ? object.uRefCount / 2 : object.uRefCount);
+            for (size_t j = 0; j < object.uRefCount; j++) {
+                PutBE(strObject, m_arrRefs[object.uRefBegin + j], uRefSize);
+            }
+            Emit(sink, strObject.data(), strObject.size());
+        }
+
+        uint64_t uOffsetTable = m_uOffset;
+        size_t uOffsetSize = IntSize(uOffsetTable);
+        strObject.clear();
+        for (size_t i = 0; i < arrOffsets.size(); i++) {
+            PutBE(strObject, arrOffsets[i], uOffsetSize);
+        }
+        strObject.append(6, 0);
+        strObject.push_back((char)uOffsetSize);
+        strObject.push_back((char)uRefSize);
+        PutBE(strObject, m_arrObjects.size(), 8);
+        PutBE(strObject, 0, 8); // the root
+        PutBE(strObject, uOffsetTable, 8);
+        Emit(sink, strObject.data(), strObject.size());
+        return sink.Flush();
+    }
+
+private:
+    struct Object {
+        const JValue *pval; // arrays and dicts
+        const char *pBytes; // scalars, encoded. uRefCount is their length and uRefBegin their hash
+        size_t uRefBegin;
+        size_t uRefCount;
+    };
+
+    uint64_t Flatten(const JValue &pval) {
+        if (!pval.isObject() && !pval.isArray()) {
+            m_strScratch.clear();
+            EncodeScalar(pval, m_strScratch);
+            return AddScalar(m_strScratch);
+        }
+
+        uint64_t uIndex = m_arrObjects.size();
+        Object object = {&pval, NULL, 0, 0};
+        m_arrObjects.push_back(object);
+
+        vector<uint64_t> arrRefs;
+        if (pval.isObject()) { // all the keys, then all the values
+            vector<string> arrKeys;
+            pval.keys(arrKeys);
+            vector<const JValue *> arrValues;
+            for (size_t i = 0; i < arrKeys.size(); i++) {
+                const JValue &pvMember = pval[arrKeys[i].c_str()];
+                if (!pvMember.isNull()) { // as in XML, null members are left out
+                    m_strScratch.clear();
+                    EncodeString(arrKeys[i].data(), arrKeys[i].size(), m_strScratch);
+                    arrRefs.push_back(AddScalar(m_strScratch));
+                    arrValues.push_back(&pvMember);
+                }
+            }
+            for (size_t i = 0; i < arrValues.size(); i++) {
+                arrRefs.push_back(Flatten(*arrValues[i]));
+            }
+        } else {
+            for (size_t i = 0; i < pval.size(); i++) {
+                if (!pval[i].isNull()) {
+                    arrRefs.push_back(Flatten(pval[i]));
+                }
+            }
+        }
+
+        m_arrObjects[uIndex].uRefBegin = m_arrRefs.size();
+        m_arrObjects[uIndex].uRefCount = arrRefs.size();
+        m_arrRefs.insert(m_arrRefs.end(), arrRefs.begin(), arrRefs.end());
+        return uIndex;
+    }
+
+    // open-addressed over the scalars written so far, their bytes are kept in an arena until the end
+    uint64_t AddScalar(const string &strBytes) {
+        if (2 * (m_uScalars + 1) > m_arrScalarIndex.size()) {
+            vector<uint64_t> arrIndex(max((size_t)1024, m_arrScalarIndex.size() * 2));
+            for (size_t i = 0; i < m_arrScalarIndex.size(); i++) {
+                if (0 != m_arrScalarIndex[i]) {
+                    size_t j = m_arrObjects[m_arrScalarIndex[i] - 1].uRefBegin & (arrIndex.size() - 1);
+                    while (0 != arrIndex[j]) {
+                        j = (j + 1) & (arrIndex.size() - 1);
+                    }
+                    arrIndex[j] = m_arrScalarIndex[i];
+                }
+            }
+            m_arrScalarIndex.swap(arrIndex);
+        }
+
+        size_t uHash = KeyHash(strBytes.data(), strBytes.size());
+        size_t i = uHash & (m_arrScalarIndex.size() - 1);
+        for (; 0 != m_arrScalarIndex[i]; i = (i + 1) & (m_arrScalarIndex.size() - 1)) {
+            const Object &object = m_arrObjects[m_arrScalarIndex[i] - 1];
+            if (object.uRefBegin == uHash && object.uRefCount == strBytes.size() &&
+                0 == memcmp(object.pBytes, strBytes.data(), strBytes.size())) {
+                return m_arrScalarIndex[i] - 1;
+            }
+        }
+
+        uint64_t uIndex = m_arrObjects.size();
+        Object object = {NULL, m_arena.NewString(strBytes.data(), strBytes.size()), uHash, strBytes.size()};
+        m_arrObjects.push_back(object);
+        m_arrScalarIndex[i] = uIndex + 1;
+        m_uScalars++;
+        return uIndex;
+    }
+
+    void Emit(JSink &sink, const char *data, size_t len) {
+        sink.Write(data, len);
+        m_uOffset += len;
+    }
+
+public: // encoding, PPatch writes its objects with these too
+    static size_t IntSize(uint64_t uValue) {
+        if (uValue <= 0xFF) {
+            return 1;
+        } else if (uValue <= 0xFFFF) {
+            return 2;
+        } else if (uValue <= 0xFFFFFFFF) {
+            return 4;
+        }
+        return 8;
+    }
+
+    static void PutBE(string &strOut, uint64_t uValue, size_t size) {
+        for (size_t i = size; i > 0; i--) {
+            strOut.push_back((char)(uValue >> (8 * (i - 1))));
+        }
+    }
+
+    static void PutInt(string &strOut, int64_t nValue) {
+        size_t size = (nValue < 0) ? 8 : IntSize((uint64_t)nValue); // negative numbers are always 8 bytes
+        strOut.push_back((char)(0x10 | ((1 == size) ? 0 : (2 == size) ? 1 : (4 == size) ? 2 : 3)));
+        PutBE(strOut, (uint64_t)nValue, size);
+    }
+
+    static void PutMarker(string &strOut, uint8_t uType, size_t uCount) {
+        if (uCount < 15) {
+            strOut.push_back((char)(uType | uCount));
+        } else {
+            strOut.push_back((char)(uType | 0x0F));
+            PutInt(strOut, (int64_t)uCount);
+        }
+    }
+
+    static void PutDouble(string &strOut, uint8_t uMarker, double dValue) {
+        uint64_t uBits = 0;
+        memcpy(&uBits, &dValue, sizeof(uBits));
+        strOut.push_back((char)uMarker);
+        PutBE(strOut, uBits, 8);
+    }
+
+    // ASCII as is, anything else as UTF-16BE
+    static void EncodeString(const char *str, size_t len, string &strOut) {
+        size_t i = 0;
+        while (i < len && 0 == (str[i] & 0x80)) {
+            i++;
+        }
+        if (i == len) {
+            PutMarker(strOut, 0x50, len);
+            strOut.append(str, len);
+            return;
+        }
+
+        vector<uint16_t> arrUnits;
+        const uint8_t *p = (const uint8_t *)str;
+        const uint8_t *pend = p + len;
+        while (p < pend) {
+            uint32_t c = *p++;
+            size_t extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : 0;
+            if (c >= 0x80 && (0 == extra || (size_t)(pend - p) < extra)) {
+                c = 0xFFFD; // not UTF-8
+                extra = 0;
+            } else if (extra > 0) {
+                c &= (0x3F >> extra);
+                for (size_t j = 0; j < extra; j++) {
+                    c = (c << 6) | (*p++ & 0x3F);
+                }
+            }
+
+            if (c >= 0x10000) {
+                c -= 0x10000;
+                arrUnits.push_back((uint16_t)(0xD800 | (c >> 10)));
+                arrUnits.push_back((uint16_t)(0xDC00 | (c & 0x3FF)));
+            } else {
+                arrUnits.push_back((uint16_t)c);
+            }
+        }
+
+        PutMarker(strOut, 0x60, arrUnits.size());
+        for (size_t j = 0; j < arrUnits.size(); j++) {
+            PutBE(strOut, arrUnits[j], 2);
+        }
+    }
+
+    static void EncodeScalar(const JValue &pval, string &strOut) {
+        // same epoch as PReader, so dates come back as they were read
+        static const time_t tEpoch = 978278400;
+        if (pval.isBool()) {
+            strOut.push_back(pval.asBool() ? 0x09 : 0x08);
+        } else if (pval.isInt()) {
+            PutInt(strOut, pval.asInt64());
+        } else if (pval.isFloat()) {
+            PutDouble(strOut, 0x23, pval.asFloat());
+        } else if (pval.isDate() || pval.isDateString()) {
+            PutDouble(strOut, 0x33, (double)(pval.asDate() - tEpoch));
+        } else if (pval.isData() || pval.isDataString()) {
+            string strData = pval.asData();
+            PutMarker(strOut, 0x40, strData.size());
+            strOut += strData;
+        } else if (pval.isString()) {
+            const char *str = pval.asCString();
+            EncodeString(str, strlen(str), strOut);
+        } else {
+            strOut.push_back(0x00); // null, only as the root
+        }
+    }
+
+private:
+    uint64_t m_uOffset;
+    vector<Object> m_arrObjects;
+    vector<uint64_t> m_arrRefs;
+    vector<uint64_t> m_arrScalarIndex; // object number + 1, 0 for an empty bucket
+    size_t m_uScalars;
+    JArena m_arena;
+    string m_strScratch;
+};
+
+void PWriter::BinaryWrite(const JValue &pval, string &strdoc) {
+    strdoc.clear();
+    JSink sink(strdoc);
+    BinaryWrite(pval, sink);
+}
+
+bool PWriter::BinaryWrite(const JValue &pval, JSink &sink) {
+    BPListWriter writer;
+    return writer.Write(pval, sink);
+}
+
+void PWriter::XMLEscape(string &strval) {
+    StringReplace(strval, "&", "&amp;");
+    StringReplace(strval, "<", "&lt;");
+    // StringReplace(strval, ">", "&gt;");		//option
+    // StringReplace(strval, "'", "&apos;");		//option
+    // StringReplace(strval, "\"", "&quot;");	//option
+}
+
+string &PWriter::StringReplace(string &context, const string &from, const string &to) {
+    size_t lookHere = 0;
+    size_t foundHere;
+    while ((foundHere = context.find(from, lookHere)) != string::npos) {
+        context.replace(foundHere, from.size(), to);
+        lookHere = foundHere + to.size();
+    }
+    return context;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void PPatch::Set(const string &strKeyPath, const string &strValue) {
+    Edit edit = {strKeyPath, "", strValue, true};
+    m_arrEdits.push_back(edit);
+}
+
+void PPatch::Replace(const string &strKeyPath, const string &strFrom, const string &strTo) {
+    Edit edit = {strKeyPath, strFrom, strTo, false};
+    m_arrEdits.push_back(edit);
+}
+
+bool PPatch::Apply(string &strDoc, vector<string> *parrOld /*= NULL*/) const {
+    vector<string> arrOld;
+    bool bChanged = false;
+    if (!Patch(strDoc, arrOld, bChanged)) {
+        return false;
+    }
+
+    if (NULL != parrOld) {
+        parrOld->swap(arrOld);
+    }
+    return true;
+}
+
+bool PPatch::Apply(const char *file, vector<string> *parrOld /*= NULL*/, string *pstrSHA1 /*= NULL*/,
+                   string *pstrSHA256 /*= NULL*/) const {
+    string strDoc;
+    FILE *fp = (NULL != file) ? fopen(file, "rb") : NULL;
+    if (NULL == fp) {
+        return false;
+    }
+    char buf[4096];
+    size_t nread = 0;
+    while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        strDoc.append(buf, nread);
+    }
+    fclose(fp);
+
+    vector<string> arrOld;
+    bool bChanged = false;
+    if (!Patch(strDoc, arrOld, bChanged)) {
+        return false;
+    }
+    if (NULL != parrOld) {
+        parrOld->swap(arrOld);
+    }
+
+    bool bHash = (NULL != pstrSHA1 || NULL != pstrSHA256);
+    if (!bChanged) {
+        if (NULL != pstrSHA1) {
+            pstrSHA1->resize(SHA_DIGEST_LENGTH);
+            SHA1((const uint8_t *)strDoc.data(), strDoc.size(), (uint8_t *)&(*pstrSHA1)[0]);
+        }
+        if (NULL != pstrSHA256) {
+            pstrSHA256->resize(SHA256_DIGEST_LENGTH);
+            SHA256((const uint8_t *)strDoc.data(), strDoc.size(), (uint8_t *)&(*pstrSHA256)[0]);
+        }
+        return true;
+    }
+
+    int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    JSink sink(fd);
+    if (bHash) {
+        sink.EnableSHASum();
+    }
+    sink.Write(strDoc.data(), strDoc.size());
+    bool bRet = sink.Finish(pstrSHA1, pstrSHA256);
+    return (0 == close(fd)) && bRet;
+}
+
+bool PPatch::Patch(string &strDoc, vector<string> &arrOld, bool &bChanged) const {
+    bChanged = false;
+    arrOld.assign(m_arrEdits.size(), string());
+
+    vector<string> arrKeyPaths;
+    for (const Edit &edit : m_arrEdits) {
+        arrKeyPaths.push_back(edit.strKeyPath);
+    }
+
+    PReader reader;
+    JValue jvOld;
+    if (!reader.parse(strDoc.data(), strDoc.size(), jvOld, arrKeyPaths)) {
+        return false;
+    }
+
+    // arrWrite has the edits that change their value, arrNew the text they change it to
+    bool bSplice = true;
+    vector<size_t> arrWrite;
+    vector<string> arrNew(m_arrEdits.size());
+    for (size_t i = 0; i < m_arrEdits.size(); i++) {
+        const Edit &edit = m_arrEdits[i];
+        const JValue *pjv = &jvOld;
+        size_t uBegin = 0;
+        while (uBegin <= edit.strKeyPath.size()) {
+            size_t uEnd = edit.strKeyPath.find(':', uBegin);
+            if (string::npos == uEnd) {
+                uEnd = edit.strKeyPath.size();
+            }
+            pjv = &(*pjv)[edit.strKeyPath.substr(uBegin, uEnd - uBegin)];
+            uBegin = uEnd + 1;
+        }
+
+        bool bString = pjv->isString();
+        arrOld[i] = pjv->asString();
+        if (!edit.bSet && (!bString || edit.strFrom.empty())) {
+            continue;
+        }
+
+        string strNew = edit.strTo;
+        if (!edit.bSet) {
+            strNew = arrOld[i];
+            PWriter::StringReplace(strNew, edit.strFrom, edit.strTo);
+        }
+        if (bString && strNew == arrOld[i]) {
+            continue;
+        }
+
+        arrNew[i] = strNew;
+        arrWrite.push_back(i);
+        bSplice = bSplice && bString;
+    }
+
+    bChanged = !arrWrite.empty();
+    if (!bChanged) {
+        return true;
+    }
+
+    if (bSplice) {
+        bool bBinary = (0 == memcmp(strDoc.data(), "bplist00", 8));
+        if (bBinary ? SpliceBinary(strDoc, arrWrite, arrNew)
+                    : SpliceXML(strDoc, reader.stringSpans(), arrWrite, arrNew)) {
+            return true;
+        }
+    }
+
+    // a key to add or a value to retype, the document is read and written as a whole
+    JValue jvDoc;
+    if (!jvDoc.readPList(strDoc)) {
+        return false;
+    }
+    for (size_t i : arrWrite) {
+        const string &strKeyPath = m_arrEdits[i].strKeyPath;
+        JValue *pjv = &jvDoc;
+        size_t uBegin = 0;
+        while (uBegin <= strKeyPath.size() && (pjv->isObject() || pjv->isNull())) {
+            size_t uEnd = strKeyPath.find(':', uBegin);
+            if (string::npos == uEnd) {
+                uEnd = strKeyPath.size();
+            }
+            pjv = &(*pjv)[strKeyPath.substr(uBegin, uEnd - uBegin)];
+            uBegin = uEnd + 1;
+        }
+        if (uBegin > strKeyPath.size()) {
+            *pjv = arrNew[i];
+        }
+    }
+    jvDoc.writePList(strDoc);
+    return true;
+}
+
+bool PPatch::SpliceXML(string &strDoc, const vector<pair<size_t, size_t>> &arrSpans, const vector<size_t> &arrWrite,
+                       const vector<string> &arrNew) const {
+    vector<pair<pair<size_t, size_t>, string>> arrSplices;
+    for (size_t i : arrWrite) {
+        if (string::npos == arrSpans[i].first) {
+            return false;
+        }
+
+        string strText = arrNew[i];
+        PWriter::XMLEscape(strText);
+        arrSplices.push_back(make_pair(arrSpans[i], strText));
+    }
+
+    // back to front, so the offsets of the ones still to come hold
+    sort(arrSplices.begin(), arrSplices.end());
+    for (size_t i = 1; i < arrSplices.size(); i++) {
+        if (arrSplices[i].first.first == arrSplices[i - 1].first.first) {
+            return false; // two edits of one key
+        }
+    }
+    for (size_t i = arrSplices.size(); i > 0; i--) {
+        const pair<pair<size_t, size_t>, string> &splice = arrSplices[i - 1];
+        strDoc.replace(splice.first.first, splice.first.second, splice.second);
+    }
+    return true;
+}
+
+bool PPatch::SpliceBinary(string &strDoc, const vector<size_t> &arrWrite, const vector<string> &arrNew) const {
+    PView pvRoot(strDoc.data(), strDoc.size());
+    if (!pvRoot.isDict()) {
+        return false;
+    }
+
+    // the new strings go where the offset table was, the table and trailer move behind them
+    uint64_t uTable = (uint64_t)(pvRoot.m_pOffsetTable - pvRoot.m_pBeg);
+    uint64_t uObjects = pvRoot.m_uObjects;
+    string strObjects;
+    vector<uint64_t> arrOffsets;
+    vector<pair<size_t, uint64_t>> arrRefs; // where a ref lies in the document, the object it now points at
+    for (size_t i : arrWrite) {
+        const string &strKeyPath = m_arrEdits[i].strKeyPath;
+        PView pvDict = pvRoot;
+        size_t uBegin = 0;
+        size_t uEnd = strKeyPath.find(':');
+        while (string::npos != uEnd) {
+            pvDict = pvDict[strKeyPath.substr(uBegin, uEnd - uBegin).c_str()];
+            uBegin = uEnd + 1;
+            uEnd = strKeyPath.find(':', uBegin);
+        }
+
+        uint64_t count = 0;
+        size_t index = pvDict.find(strKeyPath.c_str() + uBegin);
+        const uint8_t *prefs = pvDict.payload(count);
+        if ((size_t)-1 == index || NULL == prefs) {
+            return false;
+        }
+
+        size_t uRef = (size_t)(prefs + (count + index) * pvRoot.m_uRefSize - pvRoot.m_pBeg);
+        for (size_t j = 0; j < arrRefs.size(); j++) {
+            if (arrRefs[j].first == uRef) {
+                return false; // two edits of one key
+            }
+        }
+        arrRefs.push_back(make_pair(uRef, uObjects + arrOffsets.size()));
+        arrOffsets.push_back(uTable + strObjects.size());
+        BPListWriter::EncodeString(arrNew[i].data(), arrNew[i].size(), strObjects);
+    }
+
+    uint64_t uCount = uObjects + arrOffsets.size();
+    if ((pvRoot.m_uRefSize < 8 && (uCount - 1) >> (8 * pvRoot.m_uRefSize)) ||
+        (pvRoot.m_uOffsetSize < 8 && arrOffsets.back() >> (8 * pvRoot.m_uOffsetSize))) {
+        return false; // the refs or offsets would need to grow
+    }
+
+    string strTrailer(strDoc, strDoc.size() - 32, 6);
+    strTrailer.push_back((char)pvRoot.m_uOffsetSize);
+    strTrailer.push_back((char)pvRoot.m_uRefSize);
+    BPListWriter::PutBE(strTrailer, uCount, 8);
+    BPListWriter::PutBE(strTrailer, pvRoot.m_uObject, 8);
+    BPListWriter::PutBE(strTrailer, uTable + strObjects.size(), 8);
+
+    string strTable(strDoc, (size_t)uTable, (size_t)(uObjects * pvRoot.m_uOffsetSize));
+    for (size_t i = 0; i < arrOffsets.size(); i++) {
+        BPListWriter::PutBE(strTable, arrOffsets[i], pvRoot.m_uOffsetSize);
+    }
+
+    strDoc.resize((size_t)uTable);
+    for (size_t i = 0; i < arrRefs.size(); i++) {
+        string strRef;
+        BPListWriter::PutBE(strRef, arrRefs[i].second, pvRoot.m_uRefSize);
+        strDoc.replace(arrRefs[i].first, strRef.size(), strRef);
+    }
+    strDoc += strObjects;
+    strDoc += strTable;
+    strDoc += strTrailer;
+    return true;
 }
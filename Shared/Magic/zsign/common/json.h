@@ -51,11 +51,99 @@
 #include <cinttypes>
 #include <limits>
 #include <map>
+#include <new>
 #include <queue>
 #include <string>
+#include <string_view>
 #include <vector>
 using namespace std;
 
+class JValue;
+
+// Bump allocator for the nodes and strings of a JDocument. Nothing is freed on its own,
+// the blocks go away all at once when the arena is reset or destroyed.
+class JArena {
+public:
+    JArena(const JValue *pOwner = NULL);
+    ~JArena();
+
+public:
+    void *Alloc(size_t size, size_t align);
+    char *NewString(const char *str, size_t len);
+    const char *Intern(const char *str, size_t len, uint32_t hash);
+    void Reset();
+    size_t Used() const;
+    bool IsOwner(const JValue *pValue) const { return (NULL != pValue && pValue == m_pOwner); }
+
+private:
+    JArena(const JArena &);
+    JArena &operator=(const JArena &);
+
+private:
+    struct Atom {
+        const char *pStr;
+        uint32_t uLen;
+        uint32_t uHash;
+    };
+
+    char *m_pCur;
+    char *m_pEnd;
+    size_t m_sBlockSize;
+    size_t m_sUsed;
+    vector<char *> m_arrBlocks;
+    vector<Atom> m_arrAtoms; // open-addressed, every key of the document is stored once
+    size_t m_sAtoms;
+    const JValue *m_pOwner; // the root node, clearing it resets the arena
+};
+
+// Allocates from an arena when it has one and from the heap otherwise, so containers of both kinds share a type
+template <class T>
+class JAllocator {
+public:
+    typedef T value_type;
+
+    JAllocator(JArena *pArena = NULL) : m_pArena(pArena) {}
+
+    template <class U>
+    JAllocator(const JAllocator<U> &other) : m_pArena(other.m_pArena) {}
+
+    T *allocate(size_t n) {
+        void *p = (NULL != m_pArena) ? m_pArena->Alloc(n * sizeof(T), alignof(T)) : ::operator new(n * sizeof(T));
+        if (NULL == p) {
+            throw bad_alloc();
+        }
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t) {
+        if (NULL == m_pArena) {
+            ::operator delete(p);
+        }
+    }
+
+    template <class U, class... Args>
+    void construct(U *p, Args &&...args) {
+        ::new ((void *)p) U(std::forward<Args>(args)...);
+    }
+
+    // elements get the arena of their container, see JValue(const JValue &, JArena *)
+    void construct(JValue *p, const JValue &src);
+    void construct(JValue *p, JValue &&src);
+
+    template <class U>
+    bool operator==(const JAllocator<U> &other) const {
+        return m_pArena == other.m_pArena;
+    }
+
+    template <class U>
+    bool operator!=(const JAllocator<U> &other) const {
+        return m_pArena != other.m_pArena;
+    }
+
+public:
+    JArena *m_pArena;
+};
+
 class JValue {
 public:
     enum TYPE {
@@ -118,6 +206,13 @@ public:
      * @param other The JValue to copy
      */
     JValue(const JValue &other);
+
+    /**
+     * Move constructor, takes over the tree of a heap value and leaves it null.
+     * Values of a JDocument are copied instead, the new value is always a heap value.
+     * @param other The JValue to move from
+     */
+    JValue(JValue &&other) noexcept;
     
     /**
      * Constructor that creates a JValue from a C-string of specified length
@@ -170,8 +265,18 @@ public:
     bool push_back(const char *val);
     bool push_back(const string &val);
     bool push_back(const JValue &jval);
+    bool push_back(JValue &&jval);
     bool push_back(const char *val, size_t len);
 
+    // appends a value made from args and returns it, emplace_back() appends a null to fill in place
+    template <class... Args>
+    JValue &emplace_back(Args &&...args) {
+        push_back(JValue(std::forward<Args>(args)...));
+        return back();
+    }
+
+    void swap(JValue &other);
+
     bool isInt() const;
     bool isNull() const;
     bool isBool() const;
@@ -193,6 +298,7 @@ public:
     operator const char *() const;
 
     JValue &operator=(const JValue &other);
+    JValue &operator=(JValue &&other) noexcept;
     JValue &operator=(int val);
     JValue &operator=(bool val);
     JValue &operator=(double val);
@@ -224,9 +330,21 @@ public:
     friend bool operator!=(const char *psz, const JValue &jv) { return (0 != strcmp(jv.asCString(), psz)); }
 
 private:
+    typedef basic_string<char, char_traits<char>, JAllocator<char> > JString;
+    typedef vector<JValue, JAllocator<JValue> > JArray;
+    struct JSlot;
+    class JObject;
+
+    friend class JDocument;
+    friend class JAllocator<JValue>;
+    JValue(const JValue &other, JArena *pArena);
+    JValue(JValue &&other, JArena *pArena) noexcept;
+
     void Free();
-    char *NewString(const char *cstr);
+    void SetString(const char *cstr);
+    void SetData(const char *data, size_t len);
     void CopyValue(const JValue &src);
+    void MoveValue(JValue &src);
     bool WriteDataToFile(const char *file, const char *data, size_t len);
 
 public:
@@ -239,14 +357,18 @@ private:
         double vFloat;
         int64_t vInt64;
         char *vString;
-        vector<JValue> *vArray;
-        map<string, JValue> *vObject;
+        JArray *vArray;
+        JObject *vObject;
         time_t vDate;
-        string *vData;
+        JString *vData;
         wchar_t *vUnicode;
+        char vInline[24]; // short strings and data, see m_uInline
     } m_Value;
 
     TYPE m_eType;
+    uint8_t m_uInline;   // length + 1 of a string or data stored in vInline, 0 if it's stored out of line
+    bool m_bBinaryPList; // read from a bplist00 document, written back as one
+    JArena *m_pArena;    // set on every node of a JDocument, NULL for heap values
 
 public:
     string write() const;
@@ -264,11 +386,21 @@ public:
     bool readPList(const string &strdoc, string *pstrerr = NULL);
     bool readPList(const char *pdoc, size_t len = 0, string *pstrerr = NULL);
 
+    // reads only the given key paths, nested keys separated by ':' as in "Entitlements:get-task-allow".
+    // other subtrees are skipped without being built and reading stops once every path has been seen.
+    bool readPListKeys(const string &strdoc, const vector<string> &arrKeyPaths, string *pstrerr = NULL);
+    bool readPListKeys(const char *pdoc, size_t len, const vector<string> &arrKeyPaths, string *pstrerr = NULL);
+
+    // the writePList family keeps the format of the document that was read, XML for anything else
+    bool isBinaryPList() const;
+    void setBinaryPList(bool bBinary);
+
     bool readFile(const char *file, string *pstrerr = NULL);
     bool readPListFile(const char *file, string *pstrerr = NULL);
 
     bool writeFile(const char *file);
     bool writePListFile(const char *file);
+    bool writePListFile(const char *file, string &strSHA1, string &strSHA256);
     bool styleWriteFile(const char *file);
 
     bool readPath(const char *path, ...);
@@ -278,6 +410,36 @@ public:
     bool styleWritePath(const char *path, ...);
 };
 
+template <class T>
+void JAllocator<T>::construct(JValue *p, const JValue &src) {
+    ::new ((void *)p) JValue(src, m_pArena);
+}
+
+template <class T>
+void JAllocator<T>::construct(JValue *p, JValue &&src) {
+    ::new ((void *)p) JValue(std::move(src), m_pArena);
+}
+
+// A JValue tree whose nodes and strings are all allocated from an arena owned by the root. Reading a plist
+// or JSON document into it costs a handful of block allocations instead of one per node and string, and
+// destroying it frees the blocks without walking the tree. References into the tree must not outlive it;
+// values copied out of it are ordinary heap values.
+class JDocument : public JValue {
+public:
+    JDocument();
+    ~JDocument();
+
+public:
+    using JValue::operator=;
+
+private:
+    JDocument(const JDocument &);
+    JDocument &operator=(const JDocument &);
+
+private:
+    JArena m_arena;
+};
+
 class JReader {
 public:
     /**
@@ -415,9 +577,27 @@ public:
 
 public:
     bool parse(const char *pdoc, size_t len, JValue &root);
+    bool parse(const char *pdoc, size_t len, JValue &root, const vector<string> &arrKeyPaths);
     void error(string &strmsg) const;
 
+    // after a projected parse of XML, where the text of each key path's <string> value lies in the document,
+    // as {offset, length} in the order of arrKeyPaths. {npos, 0} for paths that held anything else.
+    const vector<pair<size_t, size_t>> &stringSpans() const { return m_arrSpans; }
+
 private:
+    // the wanted keys as a tree, uLeaves counts the values a node still waits for
+    struct KeyPath {
+        string strKey;
+        bool bWhole;
+        size_t uLeaves;
+        size_t uPath; // index in arrKeyPaths of a whole value
+        vector<KeyPath> arrChildren;
+
+        KeyPath() : bWhole(false), uLeaves(0), uPath(string::npos) {}
+        const KeyPath *find(const char *szKey, size_t uKeyLen) const;
+        size_t finish();
+    };
+
     struct Token {
         enum TYPE {
             E_Error = 0,
@@ -453,15 +633,17 @@ private:
     };
 
     bool readToken(Token &token);
-    bool readLabel(string &label);
+    bool readLabel(const char *&pname, size_t &len);
     bool readValue(JValue &jval, Token &token);
     bool readArray(JValue &jval);
     bool readNumber();
 
     bool readString();
     bool readDictionary(JValue &jval);
+    bool readDictionary(JValue &jval, const KeyPath &path);
+    bool skipValue(Token &token);
 
-    void endLabel(Token &token, const char *szLabel);
+    void endLabel(Token &token, const char *szName);
 
     bool decodeNumber(Token &token, JValue &jval);
     bool decodeString(Token &token, string &decoded, bool filter = true);
@@ -479,6 +661,7 @@ private:
     uint64_t getUIntVal(const char *v, size_t size);
     bool readUIntSize(const char *&pcur, size_t &size);
     bool readBinaryValue(const char *&pcur, JValue &pv);
+    bool readBinaryDictionary(const char *pcur, JValue &pv, const KeyPath &path);
     bool readUnicode(const char *pcur, size_t size, JValue &pv);
 
 public:
@@ -497,12 +680,171 @@ private: // binary
     uint8_t m_uOffsetSize;
     const char *m_pOffsetTable;
     uint8_t m_uDictParamSize;
+
+private: // key projection
+    KeyPath m_keys;
+    size_t m_uWanted;
+    vector<pair<size_t, size_t>> m_arrSpans;
+};
+
+// A read-only view of a bplist00 document, over a buffer the caller has read or mapped and keeps alive.
+// Nothing is decoded up front: every accessor follows the offset table to its object when it is called,
+// and ASCII strings and data come back as views into the buffer. Refs and offsets that point outside the
+// document read as null, so a damaged file can be queried without being checked first.
+class PView {
+public:
+    enum TYPE {
+        E_NULL = 0,
+        E_BOOL,
+        E_INT,
+        E_REAL,
+        E_DATE,
+        E_DATA,
+        E_STRING,
+        E_ARRAY,
+        E_DICT
+    };
+
+public:
+    PView();
+    PView(const char *pdoc, size_t len); // the root object, null if pdoc isn't a bplist00 document
+
+public:
+    TYPE type() const;
+    bool isNull() const;
+    bool isBool() const;
+    bool isInt() const;
+    bool isReal() const;
+    bool isDate() const;
+    bool isData() const;
+    bool isString() const;
+    bool isArray() const;
+    bool isDict() const;
+
+    bool asBool() const;
+    int64_t asInt64() const;
+    double asReal() const;
+    time_t asDate() const;
+    string_view asData() const;
+    string_view asStringView() const; // ASCII strings only, empty for UTF-16 ones
+    string asString() const;          // any string, UTF-16 converted to UTF-8
+
+    size_t size() const; // elements of an array or members of a dict
+    bool has(const char *key) const;
+    PView operator[](size_t index) const;
+    PView operator[](const char *key) const;
+    PView keyAt(size_t index) const;
+    PView valueAt(size_t index) const;
+
+    // builds the subtree as readPList would, for the parts a caller does want as a JValue
+    bool toJValue(JValue &jv) const;
+
+    // where the object's marker byte lies in the document
+    size_t offset() const;
+
+private:
+    friend class PPatch;
+    size_t find(const char *key) const;
+    PView child(const uint8_t *pref) const;
+    const uint8_t *object() const;
+    const uint8_t *payload(uint64_t &count) const;
+    bool toJValue(JValue &jv, size_t depth) const;
+
+private:
+    const uint8_t *m_pBeg;
+    const uint8_t *m_pEnd; // start of the trailer, no object lies beyond it
+    const uint8_t *m_pOffsetTable;
+    uint64_t m_uObjects;
+    uint8_t m_uOffsetSize;
+    uint8_t m_uRefSize;
+    uint64_t m_uObject; // m_uObjects for a null view
+};
+
+// Rewrites string values of a plist without a read and write of the whole document. The new text is spliced
+// in where the old one lies, so every other byte, the formatting and the format are kept. In XML the text of
+// the <string> element is replaced. In bplist00 the new string is appended as an object of its own and the
+// dict's ref pointed at it, which leaves a string shared with other keys as it was. Whatever can't be spliced,
+// a key that has to be added, a value that isn't a string or refs that would outgrow their size, falls back
+// to reading the document into a JValue and writing it again.
+class PPatch {
+public:
+    // strValue at strKeyPath, added if it isn't there. Nested keys are separated by ':'.
+    void Set(const string &strKeyPath, const string &strValue);
+    // strFrom replaced with strTo in the string at strKeyPath, if there is one
+    void Replace(const string &strKeyPath, const string &strFrom, const string &strTo);
+    bool IsEmpty() const { return m_arrEdits.empty(); }
+
+    // parrOld gets the value each edit found, "" where there was none, in the order they were added.
+    // The digests are of the file as it is afterwards, raw bytes as the signature wants them.
+    bool Apply(string &strDoc, vector<string> *parrOld = NULL) const;
+    bool Apply(const char *file, vector<string> *parrOld = NULL, string *pstrSHA1 = NULL,
+               string *pstrSHA256 = NULL) const;
+
+private:
+    struct Edit {
+        string strKeyPath;
+        string strFrom;
+        string strTo;
+        bool bSet;
+    };
+
+    bool Patch(string &strDoc, vector<string> &arrOld, bool &bChanged) const;
+    bool SpliceXML(string &strDoc, const vector<pair<size_t, size_t>> &arrSpans, const vector<size_t> &arrWrite,
+                   const vector<string> &arrNew) const;
+    bool SpliceBinary(string &strDoc, const vector<size_t> &arrWrite, const vector<string> &arrNew) const;
+
+private:
+    vector<Edit> m_arrEdits;
+};
+
+// Output of the writers, collected in a fixed buffer and flushed to a file descriptor or appended to a string
+// whenever it fills up, so a document never has to exist as a whole in memory. With EnableSHASum() the bytes
+// are also hashed on their way out.
+class JSink {
+public:
+    explicit JSink(int fd);
+    explicit JSink(string &strOutput);
+    ~JSink();
+
+public:
+    void EnableSHASum();
+    void Write(const char *data, size_t len);
+    void Write(const char *str) { Write(str, strlen(str)); }
+    void Write(char c) {
+        if (m_pCur == m_szBuffer + sizeof(m_szBuffer)) {
+            Flush();
+        }
+        *m_pCur++ = c;
+    }
+    bool Flush();
+    bool Finish(string *pstrSHA1 = NULL, string *pstrSHA256 = NULL); // flushes, the digests need EnableSHASum()
+    bool IsGood() const { return m_bGood; }
+
+private:
+    JSink(const JSink &);
+    JSink &operator=(const JSink &);
+    void Emit(const char *data, size_t len);
+
+private:
+    struct SHAState;
+
+    int m_fd;
+    string *m_pOutput;
+    SHAState *m_pSHA;
+    bool m_bGood;
+    char *m_pCur;
+    char m_szBuffer[32 * 1024];
 };
 
 class PWriter {
 public:
     static void FastWrite(const JValue &pval, string &strdoc);
-    static void FastWriteValue(const JValue &pval, string &strdoc, string &strindent);
+    static bool FastWrite(const JValue &pval, JSink &sink);
+    static void FastWriteValue(const JValue &pval, JSink &sink, size_t depth);
+    static void XMLEscape(const char *str, size_t len, JSink &sink);
+
+    static void BinaryWrite(const JValue &pval, string &strdoc);
+    static bool BinaryWrite(const JValue &pval, JSink &sink);
 
 public:
     static void XMLEscape(string &strval);
@@ -250,6 +250,10 @@ typedef int vm_prot_t;
 #define LC_LINKER_OPTIMIZATION_HINT 0x0000002E
 #define LC_VERSION_MIN_TVOS 0x0000002F
 #define LC_VERSION_MIN_WATCHOS 0x00000030
+#define LC_NOTE 0x00000031
+#define LC_BUILD_VERSION 0x00000032
+#define LC_DYLD_EXPORTS_TRIE 0x80000033
+#define LC_DYLD_CHAINED_FIXUPS 0x80000034
 
 /* Constants for the flags field of the segment_command */
 #define SG_HIGHVM                                                                                                      \
@@ -462,6 +466,92 @@ struct dylib_command {
     struct dylib dylib; /* the library identification */
 };
 
+struct rpath_command {
+    uint32_t cmd;      /* LC_RPATH */
+    uint32_t cmdsize;  /* includes string */
+    union lc_str path; /* path to add to run path */
+};
+
+struct symtab_command {
+    uint32_t cmd;     /* LC_SYMTAB */
+    uint32_t cmdsize; /* sizeof(struct symtab_command) */
+    uint32_t symoff;  /* symbol table offset */
+    uint32_t nsyms;   /* number of symbol table entries */
+    uint32_t stroff;  /* string table offset */
+    uint32_t strsize; /* string table size in bytes */
+};
+
+struct dysymtab_command {
+    uint32_t cmd;            /* LC_DYSYMTAB */
+    uint32_t cmdsize;        /* sizeof(struct dysymtab_command) */
+    uint32_t ilocalsym;      /* index to local symbols */
+    uint32_t nlocalsym;      /* number of local symbols */
+    uint32_t iextdefsym;     /* index to externally defined symbols */
+    uint32_t nextdefsym;     /* number of externally defined symbols */
+    uint32_t iundefsym;      /* index to undefined symbols */
+    uint32_t nundefsym;      /* number of undefined symbols */
+    uint32_t tocoff;         /* file offset to table of contents */
+    uint32_t ntoc;           /* number of entries in table of contents */
+    uint32_t modtaboff;      /* file offset to module table */
+    uint32_t nmodtab;        /* number of module table entries */
+    uint32_t extrefsymoff;   /* offset to referenced symbol table */
+    uint32_t nextrefsyms;    /* number of referenced symbol table entries */
+    uint32_t indirectsymoff; /* file offset to the indirect symbol table */
+    uint32_t nindirectsyms;  /* number of indirect symbol table entries */
+    uint32_t extreloff;      /* offset to external relocation entries */
+    uint32_t nextrel;        /* number of external relocation entries */
+    uint32_t locreloff;      /* offset to local relocation entries */
+    uint32_t nlocrel;        /* number of local relocation entries */
+};
+
+struct dyld_info_command {
+    uint32_t cmd;            /* LC_DYLD_INFO or LC_DYLD_INFO_ONLY */
+    uint32_t cmdsize;        /* sizeof(struct dyld_info_command) */
+    uint32_t rebase_off;     /* file offset to rebase info */
+    uint32_t rebase_size;    /* size of rebase info */
+    uint32_t bind_off;       /* file offset to binding info */
+    uint32_t bind_size;      /* size of binding info */
+    uint32_t weak_bind_off;  /* file offset to weak binding info */
+    uint32_t weak_bind_size; /* size of weak binding info */
+    uint32_t lazy_bind_off;  /* file offset to lazy binding info */
+    uint32_t lazy_bind_size; /* size of lazy binding info */
+    uint32_t export_off;     /* file offset to export info */
+    uint32_t export_size;    /* size of export info */
+};
+
+struct linkedit_data_command {
+    uint32_t cmd;      /* LC_CODE_SIGNATURE, LC_FUNCTION_STARTS, LC_DATA_IN_CODE, ... */
+    uint32_t cmdsize;  /* sizeof(struct linkedit_data_command) */
+    uint32_t dataoff;  /* file offset of data in __LINKEDIT segment */
+    uint32_t datasize; /* file size of data in __LINKEDIT segment */
+};
+
+struct nlist {
+    uint32_t n_strx;  /* index into the string table */
+    uint8_t n_type;   /* type flag, see below */
+    uint8_t n_sect;   /* section number or NO_SECT */
+    int16_t n_desc;   /* see <mach-o/stab.h> */
+    uint32_t n_value; /* value of this symbol (or stab offset) */
+};
+
+struct nlist_64 {
+    uint32_t n_strx;  /* index into the string table */
+    uint8_t n_type;   /* type flag, see below */
+    uint8_t n_sect;   /* section number or NO_SECT */
+    uint16_t n_desc;  /* see <mach-o/stab.h> */
+    uint64_t n_value; /* value of this symbol (or stab offset) */
+};
+
+/* Masks for the n_type field of nlist */
+#define N_STAB 0xe0 /* if any of these bits set, a symbolic debugging entry */
+#define N_PEXT 0x10 /* private external symbol bit */
+#define N_TYPE 0x0e /* mask for the type bits */
+#define N_EXT 0x01  /* external symbol bit, set for external symbols */
+
+/* Special values of indirect symbol table entries */
+#define INDIRECT_SYMBOL_LOCAL 0x80000000
+#define INDIRECT_SYMBOL_ABS 0x40000000
+
 #pragma pack(pop)
 
 //////CodeSignature
@@ -0,0 +1,72 @@
+/*
+ * Proprietary Software License Version 1.0
+ *
+ * Copyright (C) 2025 BDG
+ *
+ * Backdoor App Signer is proprietary software. You may not use, modify, or distribute it except as expressly permitted
+ * under the terms of the Proprietary Software License.
+ */
+
+/*
+ */
+
+#pragma once
+#include "common.h"
+#include "mach-o.h"
+#include <type_traits>
+
+// Bounds-checked access to the bytes of a slice. Typed pointers are only handed out for
+// ranges that lie entirely inside the view, anything else yields NULL.
+class ZMachOView {
+public:
+    ZMachOView() : m_pBase(NULL), m_uLength(0) {}
+    ZMachOView(uint8_t *pBase, uint32_t uLength) : m_pBase(pBase), m_uLength(uLength) {}
+
+public:
+    bool Contains(uint64_t uOffset, uint64_t uSize) const {
+        return (NULL != m_pBase && uOffset <= m_uLength && uSize <= m_uLength - uOffset);
+    }
+
+    template <class T>
+    T *At(uint64_t uOffset, uint64_t uCount = 1) const {
+        if (uCount > UINT32_MAX || !Contains(uOffset, uCount * sizeof(T))) {
+            return NULL;
+        }
+        return reinterpret_cast<T *>(m_pBase + uOffset);
+    }
+
+    // NUL-terminated string at uOffset, cut at uEnd or the end of the view
+    string String(uint64_t uOffset, uint64_t uEnd) const {
+        uEnd = min(uEnd, (uint64_t)m_uLength);
+        if (NULL == m_pBase || uOffset >= uEnd) {
+            return string();
+        }
+        const char *szString = reinterpret_cast<const char *>(m_pBase + uOffset);
+        return string(szString, strnlen(szString, (size_t)(uEnd - uOffset)));
+    }
+
+    uint8_t *Base() const { return m_pBase; }
+    uint32_t Length() const { return m_uLength; }
+
+private:
+    uint8_t *m_pBase;
+    uint32_t m_uLength;
+};
+
+// Byte order and bitness of a slice as template parameters, so code written against it compiles
+// to one specialization per layout with no byte-order branches and no separate 32/64-bit paths.
+template <bool bBigEndian, bool b64>
+struct ZMachOLayout {
+    typedef typename conditional<b64, mach_header_64, mach_header>::type header_t;
+    typedef typename conditional<b64, segment_command_64, segment_command>::type segment_t;
+    typedef typename conditional<b64, section_64, section>::type section_t;
+    typedef typename conditional<b64, nlist_64, nlist>::type nlist_t;
+    typedef typename conditional<b64, uint64_t, uint32_t>::type addr_t;
+
+    static const uint32_t uSegmentCmd = b64 ? LC_SEGMENT_64 : LC_SEGMENT;
+
+    // converts between file and host byte order, in both directions
+    static uint32_t BO(uint32_t uValue) { return bBigEndian ? _Swap(uValue) : uValue; }
+    static uint64_t BO(uint64_t uValue) { return bBigEndian ? _Swap(uValue) : uValue; }
+    static int32_t BO(int32_t nValue) { return (int32_t)BO((uint32_t)nValue); }
+};
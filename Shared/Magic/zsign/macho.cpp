@@ -9,15 +9,19 @@
 
 #include "macho.h"
 #include "common/common.h"
+#include "common/fileio.h"
 #include "common/json.h"
 #include "common/mach-o.h"
 #include "openssl.h"
 #include "signing.h"
+#include <algorithm>
+#include <thread>
 
                 ZMachO::ZMachO() {
     m_pBase = NULL;
     m_sSize = 0;
     m_bCSRealloced = false;
+    m_bReadOnly = false;
 }
 
 ZMachO::~ZMachO() { FreeArchOes(); }
@@ -37,6 +41,11 @@ bool ZMachO::InitV(const char *szFormatPath, ...) {
     return Init(szFile);
 }
 
+bool ZMachO::InitReadOnly(const char *szFile, bool bMapFile) {
+    m_strFile = szFile;
+    return OpenFileReadOnly(szFile, bMapFile);
+}
+
 bool ZMachO::Free() {
     FreeArchOes();
     return CloseFile();
@@ -52,11 +61,75 @@ bool ZMachO::NewArchO(uint8_t *pBase, uint32_t uLength) {
     return false;
 }
 
+bool ZMachO::NewArchOHeader(int fd, uint32_t uOffset, uint32_t uLength) {
+    mach_header_64 header;
+    memset(&header, 0, sizeof(header));
+    if (uLength < sizeof(mach_header) || !ReadFileRange(fd, &header, sizeof(mach_header), uOffset)) {
+        return false;
+    }
+
+    bool b64 = (MH_MAGIC_64 == header.magic || MH_CIGAM_64 == header.magic);
+    bool bBigEndian = (MH_CIGAM == header.magic || MH_CIGAM_64 == header.magic);
+    uint32_t uHeaderSize = b64 ? sizeof(mach_header_64) : sizeof(mach_header);
+    uint32_t uSizeOfCmds = bBigEndian ? LE(header.sizeofcmds) : header.sizeofcmds;
+    if (uSizeOfCmds > uLength - uHeaderSize) {
+        return false;
+    }
+
+    uint32_t uHeaderLength = uHeaderSize + uSizeOfCmds;
+    uint8_t *pHeader = (uint8_t *)malloc(uHeaderLength);
+    if (NULL == pHeader) {
+        return false;
+    }
+    m_arrBuffers.push_back(pHeader);
+    if (!ReadFileRange(fd, pHeader, uHeaderLength, uOffset)) {
+        return false;
+    }
+
+    ZArchO *archo = new ZArchO();
+    if (!archo->InitHeader(pHeader, uLength)) {
+        delete archo;
+        return false;
+    }
+
+    // the embedded Info.plist and the signature blob are small, read them for inspection
+    if (archo->m_uInfoPlistSize > 0 && archo->m_uInfoPlistOffset <= uLength &&
+        archo->m_uInfoPlistSize <= uLength - archo->m_uInfoPlistOffset) {
+        archo->m_strInfoPlist.resize(archo->m_uInfoPlistSize);
+        if (!ReadFileRange(fd, &archo->m_strInfoPlist[0], archo->m_uInfoPlistSize,
+                           uOffset + archo->m_uInfoPlistOffset)) {
+            archo->m_strInfoPlist.clear();
+        }
+    }
+
+    if (archo->m_uSignDataSize >= sizeof(CS_SuperBlob) && archo->m_uCodeLength <= uLength &&
+        archo->m_uSignDataSize <= uLength - archo->m_uCodeLength) {
+        uint8_t *pSignBase = (uint8_t *)malloc(archo->m_uSignDataSize);
+        if (NULL != pSignBase) {
+            m_arrBuffers.push_back(pSignBase);
+            if (ReadFileRange(fd, pSignBase, archo->m_uSignDataSize, uOffset + archo->m_uCodeLength)) {
+                uint32_t uSignLength = GetCodeSignatureLength(pSignBase);
+                if (uSignLength > 0 && uSignLength <= archo->m_uSignDataSize) {
+                    archo->m_pSignBase = pSignBase;
+                    archo->m_uSignLength = uSignLength;
+                }
+            }
+        }
+    }
+
+    m_arrArchOes.push_back(archo);
+    return true;
+}
+
 void ZMachO::FreeArchOes() {
     for (size_t i = 0; i < m_arrArchOes.size(); i++) {
         ZArchO *archo = m_arrArchOes[i];
         delete archo;
     }
+    for (size_t i = 0; i < m_arrBuffers.size(); i++) {
+        free(m_arrBuffers[i]);
+    }
+    m_arrBuffers.clear();
     m_pBase = NULL;
     m_sSize = 0;
     m_arrArchOes.clear();
@@ -64,9 +137,28 @@ void ZMachO::FreeArchOes() {
 
 bool ZMachO::OpenFile(const char *szPath) {
     FreeArchOes();
+    m_bReadOnly = false;
 
     m_sSize = 0;
     m_pBase = (uint8_t *)MapFile(szPath, 0, 0, &m_sSize, false);
+    return LoadArchOes();
+}
+
+bool ZMachO::RemapFile(size_t sNewSize) {
+#if defined(__linux__)
+    void *pBase = mremap(m_pBase, m_sSize, sNewSize, MREMAP_MAYMOVE);
+    if (MAP_FAILED != pBase) {
+        FreeArchOes(); // slices still point into the old mapping
+        m_pBase = (uint8_t *)pBase;
+        m_sSize = sNewSize;
+        return LoadArchOes();
+    }
+#endif
+    CloseFile();
+    return OpenFile(m_strFile.c_str());
+}
+
+bool ZMachO::LoadArchOes() {
     if (NULL != m_pBase && m_sSize > 0) {
         uint32_t magic = *((uint32_t *)m_pBase);
         if (FAT_CIGAM == magic || FAT_MAGIC == magic) {
@@ -95,6 +187,60 @@ bool ZMachO::OpenFile(const char *szPath) {
     return (!m_arrArchOes.empty());
 }
 
+bool ZMachO::OpenFileReadOnly(const char *szPath, bool bMapFile) {
+    FreeArchOes();
+    m_bReadOnly = true;
+
+    if (bMapFile) { // whole file mapped read-only, for checks that need the section contents
+        m_sSize = 0;
+        m_pBase = (uint8_t *)MapFile(szPath, 0, 0, &m_sSize, true);
+        return LoadArchOes();
+    }
+
+    int fd = open(szPath, O_RDONLY);
+    if (fd < 0) {
+        ZLog::ErrorV(">>> Can't Open File! %s, %s\n", szPath, strerror(errno));
+        return false;
+    }
+
+    int64_t nFileSize = GetFileSize(fd);
+    uint32_t magic = 0;
+    if (nFileSize < (int64_t)sizeof(magic) || !ReadFileRange(fd, &magic, sizeof(magic), 0)) {
+        close(fd);
+        ZLog::ErrorV(">>> Invalid Macho File (2)!\n");
+        return false;
+    }
+
+    bool bRet = true;
+    if (FAT_CIGAM == magic || FAT_MAGIC == magic) {
+        fat_header fath;
+        bRet = ReadFileRange(fd, &fath, sizeof(fat_header), 0);
+        int nFatArch = (FAT_MAGIC == magic) ? fath.nfat_arch : LE(fath.nfat_arch);
+        for (int i = 0; bRet && i < nFatArch; i++) {
+            fat_arch arch;
+            bRet = ReadFileRange(fd, &arch, sizeof(fat_arch), sizeof(fat_header) + sizeof(fat_arch) * i);
+            uint32_t uArchOffset = (FAT_MAGIC == magic) ? arch.offset : LE(arch.offset);
+            uint32_t uArchLength = (FAT_MAGIC == magic) ? arch.size : LE(arch.size);
+            if (!bRet || (int64_t)uArchOffset + uArchLength > nFileSize ||
+                !NewArchOHeader(fd, uArchOffset, uArchLength)) {
+                ZLog::ErrorV(">>> Invalid Arch File In Fat Macho File!\n");
+                bRet = false;
+            }
+        }
+    } else if (MH_MAGIC == magic || MH_CIGAM == magic || MH_MAGIC_64 == magic || MH_CIGAM_64 == magic) {
+        if (nFileSize > UINT32_MAX || !NewArchOHeader(fd, 0, (uint32_t)nFileSize)) {
+            ZLog::ErrorV(">>> Invalid Macho File!\n");
+            bRet = false;
+        }
+    } else {
+        ZLog::ErrorV(">>> Invalid Macho File (2)!\n");
+        bRet = false;
+    }
+    close(fd);
+
+    return (bRet && !m_arrArchOes.empty());
+}
+
 bool ZMachO::CloseFile() {
     if (NULL == m_pBase || m_sSize <= 0) {
         return false;
@@ -115,19 +261,25 @@ void ZMachO::PrintInfo() {
 }
 
 bool ZMachO::Sign(ZSignAsset *pSignAsset, bool bForce, string strBundleId, string strInfoPlistSHA1,
-                  string strInfoPlistSHA256, const string &strCodeResourcesData) {
+                  string strInfoPlistSHA256, string strCodeResourcesSHA1, string strCodeResourcesSHA256) {
+    if (m_bReadOnly) {
+        ZLog::Error(">>> MachO File Is Opened Read-Only!\n");
+        return false;
+    }
+
     if (NULL == m_pBase || m_arrArchOes.empty()) {
         return false;
     }
 
+    // identifier and Info.plist hashes come from the first slice that has them, as they did when slices were signed in order
     for (size_t i = 0; i < m_arrArchOes.size(); i++) {
         ZArchO *archo = m_arrArchOes[i];
         if (strBundleId.empty()) {
             JValue jvInfo;
-            jvInfo.readPList(archo->m_strInfoPlist);
+            jvInfo.readPListKeys(archo->m_strInfoPlist, {"CFBundleIdentifier"});
             strBundleId = jvInfo["CFBundleIdentifier"].asCString();
             if (strBundleId.empty()) {
-                strBundleId = basename(const_cast<char *>(m_strFile.c_str()));
+                strBundleId = m_strFile.substr(m_strFile.rfind('/') + 1); // basename() isn't reentrant
             }
         }
 
@@ -139,118 +291,220 @@ bool ZMachO::Sign(ZSignAsset *pSignAsset, bool bForce, string strBundleId, strin
                 SHASum(archo->m_strInfoPlist, strInfoPlistSHA1, strInfoPlistSHA256);
             }
         }
+    }
 
-        if (!archo->Sign(pSignAsset, bForce, strBundleId, strInfoPlistSHA1, strInfoPlistSHA256, strCodeResourcesData)) {
-            if (!archo->m_bEnoughSpace && !m_bCSRealloced) {
-                m_bCSRealloced = true;
-                if (ReallocCodeSignSpace()) {
-                    return Sign(pSignAsset, bForce, strBundleId, strInfoPlistSHA1, strInfoPlistSHA256,
-                                strCodeResourcesData);
-                }
+    if (strCodeResourcesSHA1.empty() || strCodeResourcesSHA256.empty()) { // not in a bundle
+        strCodeResourcesSHA1.assign(20, 0);
+        strCodeResourcesSHA256.assign(32, 0);
+    }
+
+    // slices live in disjoint ranges of the mapping, so they can be hashed and written concurrently.
+    // debug mode dumps every slot to fixed paths, keep it serial there.
+    vector<uint8_t> arrSigned(m_arrArchOes.size(), 0);
+    auto SignArchO = [&](size_t i) {
+        arrSigned[i] = m_arrArchOes[i]->Sign(pSignAsset, bForce, strBundleId, strInfoPlistSHA1, strInfoPlistSHA256,
+                                             strCodeResourcesSHA1, strCodeResourcesSHA256) ? 1 : 0;
+    };
+    if (m_arrArchOes.size() > 1 && !ZLog::IsDebug()) {
+        vector<thread> arrThreads;
+        for (size_t i = 1; i < m_arrArchOes.size(); i++) {
+            arrThreads.push_back(thread(SignArchO, i));
+        }
+        SignArchO(0);
+        for (size_t i = 0; i < arrThreads.size(); i++) {
+            arrThreads[i].join();
+        }
+    } else {
+        for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+            SignArchO(i);
+        }
+    }
+
+    bool bRealloc = false;
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        if (!arrSigned[i]) {
+            if (m_arrArchOes[i]->m_bEnoughSpace) {
+                return false;
             }
-            return false;
+            bRealloc = true;
         }
     }
 
+    // every slice that ran short is grown in the same pass, so the file is re-laid out at most once
+    if (bRealloc) {
+        if (!m_bCSRealloced) {
+            m_bCSRealloced = true;
+            if (ReallocCodeSignSpace()) { // load commands changed, existing code slots are stale
+                return Sign(pSignAsset, true, strBundleId, strInfoPlistSHA1, strInfoPlistSHA256,
+                            strCodeResourcesSHA1, strCodeResourcesSHA256);
+            }
+        }
+        return false;
+    }
+
     return CloseFile();
 }
 
+bool ZMachO::Verify(const string &strInfoPlistData, const string &strCodeResourcesData, JValue &jvOutput) {
+    if (NULL == m_pBase || m_arrArchOes.empty()) {
+        return false;
+    }
+
+    bool bValid = true;
+    jvOutput["archs"] = JValue(JValue::E_ARRAY);
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        JValue jvArch;
+        bValid = m_arrArchOes[i]->Verify(strInfoPlistData, strCodeResourcesData, jvArch) && bValid;
+        jvOutput["archs"].push_back(std::move(jvArch));
+    }
+    return bValid;
+}
+
+bool ZMachO::IsSignedBy(ZSignAsset *pSignAsset, string strBundleId, const string &strInfoPlistData,
+                        const string &strCodeResourcesData) {
+    if (NULL == m_pBase || m_arrArchOes.empty()) {
+        return false;
+    }
+
+    // same identifier Sign would derive for a binary outside a bundle
+    for (size_t i = 0; i < m_arrArchOes.size() && strBundleId.empty(); i++) {
+        JValue jvInfo;
+        jvInfo.readPListKeys(m_arrArchOes[i]->m_strInfoPlist, {"CFBundleIdentifier"});
+        strBundleId = jvInfo["CFBundleIdentifier"].asCString();
+        if (strBundleId.empty()) {
+            strBundleId = m_strFile.substr(m_strFile.rfind('/') + 1);
+        }
+    }
+
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        if (!m_arrArchOes[i]->IsSignedBy(pSignAsset, strBundleId, strInfoPlistData, strCodeResourcesData)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool ZMachO::ReallocCodeSignSpace() {
     ZLog::Warn(">>> Realloc CodeSignature Space... \n");
 
+    uint32_t magic = *((uint32_t *)m_pBase);
+    bool bFat = (FAT_MAGIC == magic || FAT_CIGAM == magic);
+    vector<fat_arch> arrArches;
+    if (bFat) {
+        fat_header *pFatHeader = reinterpret_cast<fat_header *>(m_pBase);
+        int nFatArch = (FAT_MAGIC == magic) ? pFatHeader->nfat_arch : LE(pFatHeader->nfat_arch);
+        for (int i = 0; i < nFatArch; i++) {
+            arrArches.push_back(*(reinterpret_cast<fat_arch *>(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * i)));
+        }
+        if (arrArches.size() != m_arrArchOes.size()) {
+            return false;
+        }
+    }
+
+    // the new lengths and the layout are worked out first, the load commands of the slices are only
+    // rewritten once the file has been grown, so a failure before that leaves it as it was
     vector<uint32_t> arrMachOesSizes;
     for (size_t i = 0; i < m_arrArchOes.size(); i++) {
-        string strNewArchOFile;
-        StringFormat(strNewArchOFile, "%s.archo.%d", m_strFile.c_str(), i);
-        uint32_t uNewLength = m_arrArchOes[i]->ReallocCodeSignSpace(strNewArchOFile);
+        uint32_t uNewLength = m_arrArchOes[i]->ReallocCodeSignSpace(true);
         if (uNewLength == 0) {
             ZLog::Error(">>> Failed!\n");
             return false;
         }
         arrMachOesSizes.push_back(uNewLength);
     }
-    ZLog::Warn(">>> Success!\n");
 
-    if (1 == m_arrArchOes.size()) {
-        CloseFile();
-        RemoveFile(m_strFile.c_str());
-        string strNewArchOFile = m_strFile + ".archo.0";
-        if (0 == rename(strNewArchOFile.c_str(), m_strFile.c_str())) {
-            return OpenFile(m_strFile.c_str());
-        }
-    } else { // fat
-        uint32_t uAlign = 16384;
-        vector<fat_arch> arrArches;
-        fat_header fath = *(reinterpret_cast<fat_header *>(m_pBase));
-        int nFatArch = (FAT_MAGIC == fath.magic) ? fath.nfat_arch : LE(fath.nfat_arch);
-        for (int i = 0; i < nFatArch; i++) {
-            fat_arch arch = *(reinterpret_cast<fat_arch *>(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * i));
-            arrArches.push_back(arch);
-        }
-        CloseFile();
-
-        if (arrArches.size() != m_arrArchOes.size()) {
+    if (!bFat) { // the signature space is at the end, growing the file is enough
+        int fd = open(m_strFile.c_str(), O_RDWR);
+        if (fd < 0) {
+            ZLog::ErrorV(">>> Can't Open File! %s, %s\n", m_strFile.c_str(), strerror(errno));
             return false;
         }
-
-        uint32_t uFatHeaderSize = sizeof(fat_header) + arrArches.size() * sizeof(fat_arch);
-        uint32_t uPadding1 = (uAlign - uFatHeaderSize % uAlign);
-        uint32_t uOffset = uFatHeaderSize + uPadding1;
-        for (size_t i = 0; i < arrArches.size(); i++) {
-            fat_arch &arch = arrArches[i];
-            uint32_t uMachOSize = arrMachOesSizes[i];
-
-            arch.align = (FAT_MAGIC == fath.magic) ? 14 : BE((uint32_t)14);
-            arch.offset = (FAT_MAGIC == fath.magic) ? uOffset : BE(uOffset);
-            arch.size = (FAT_MAGIC == fath.magic) ? uMachOSize : BE(uMachOSize);
-
-            uOffset += uMachOSize;
-            uOffset = uOffset + (uAlign - uOffset % uAlign);
+        bool bRet = (0 == ftruncate(fd, arrMachOesSizes[0]));
+        close(fd);
+        if (!bRet) {
+            ZLog::ErrorV(">>> Can't Grow File! %s, %s\n", m_strFile.c_str(), strerror(errno));
+            return false;
         }
+        m_arrArchOes[0]->ReallocCodeSignSpace();
+        ZLog::Warn(">>> Success!\n");
+        return RemapFile(arrMachOesSizes[0]);
+    }
 
-        string strNewFatMachOFile = m_strFile + ".fato";
-
-        string strFatHeader;
-        strFatHeader.append((const char *)&fath, sizeof(fat_header));
-        for (size_t i = 0; i < arrArches.size(); i++) {
-            fat_arch &arch = arrArches[i];
-            strFatHeader.append((const char *)&arch, sizeof(fat_arch));
+    // plan the new layout in file order. a slice never moves down, so moving them last to first
+    // only overwrites bytes that have already been moved.
+    auto FatValue = [magic](uint32_t uValue) { return (FAT_MAGIC == magic) ? uValue : LE(uValue); };
+    vector<size_t> arrOrder(arrArches.size());
+    for (size_t i = 0; i < arrOrder.size(); i++) {
+        arrOrder[i] = i;
+    }
+    sort(arrOrder.begin(), arrOrder.end(),
+         [&](size_t a, size_t b) { return FatValue(arrArches[a].offset) < FatValue(arrArches[b].offset); });
+
+    vector<uint32_t> arrOffsets(arrArches.size());
+    uint64_t uEnd = 0;
+    for (size_t k = 0; k < arrOrder.size(); k++) {
+        size_t i = arrOrder[k];
+        uint32_t uAlignBits = max(FatValue(arrArches[i].align), (uint32_t)14);
+        uint64_t uAlign = (uint64_t)1 << uAlignBits;
+        uint64_t uOffset = max((uint64_t)FatValue(arrArches[i].offset), ((uEnd + uAlign - 1) / uAlign) * uAlign);
+        if (uOffset + arrMachOesSizes[i] > UINT32_MAX) {
+            ZLog::Error(">>> Failed!\n");
+            return false;
         }
+        arrOffsets[i] = (uint32_t)uOffset;
+        uEnd = uOffset + arrMachOesSizes[i];
+        arrArches[i].align = (FAT_MAGIC == magic) ? uAlignBits : BE(uAlignBits);
+    }
 
-        string strPadding1;
-        strPadding1.append(uPadding1, 0);
-
-        AppendFile(strNewFatMachOFile.c_str(), strFatHeader);
-        AppendFile(strNewFatMachOFile.c_str(), strPadding1);
-
-        for (size_t i = 0; i < arrArches.size(); i++) {
-            size_t sSize = 0;
-            string strNewArchOFile = m_strFile + ".archo." + JValue((int)i).asString();
-            uint8_t *pData = (uint8_t *)MapFile(strNewArchOFile.c_str(), 0, 0, &sSize, true);
-            if (NULL == pData) {
-                RemoveFile(strNewFatMachOFile.c_str());
-                return false;
-            }
-            string strPadding;
-            strPadding.append((uAlign - sSize % uAlign), 0);
+    int fd = open(m_strFile.c_str(), O_RDWR);
+    if (fd < 0) {
+        ZLog::ErrorV(">>> Can't Open File! %s, %s\n", m_strFile.c_str(), strerror(errno));
+        return false;
+    }
+    if (0 != ftruncate(fd, (off_t)uEnd)) {
+        ZLog::ErrorV(">>> Can't Grow File! %s, %s\n", m_strFile.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
 
-            AppendFile(strNewFatMachOFile.c_str(), (const char *)pData, sSize);
-            AppendFile(strNewFatMachOFile.c_str(), strPadding);
+    // the slices are still where they were in the mapping, their commands move along with them
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        m_arrArchOes[i]->ReallocCodeSignSpace();
+    }
+    ZLog::Warn(">>> Success!\n");
 
-            munmap(static_cast<void *>(pData), sSize);
-            RemoveFile(strNewArchOFile.c_str());
-        }
+    bool bRet = true;
+    for (size_t k = arrOrder.size(); bRet && k > 0; k--) {
+        size_t i = arrOrder[k - 1];
+        uint32_t uOldOffset = FatValue(arrArches[i].offset);
+        uint32_t uOldSize = FatValue(arrArches[i].size);
+        uint64_t uStale = (uint64_t)arrOffsets[i] + uOldSize; // old bytes up to the next slice, past the old end it's zeros
+        uint64_t uNext = min((k < arrOrder.size()) ? (uint64_t)arrOffsets[arrOrder[k]] : uEnd, (uint64_t)m_sSize);
+        bRet = MoveFileRange(fd, uOldOffset, arrOffsets[i], uOldSize) &&
+               (uNext <= uStale || ZeroFileRange(fd, uStale, (size_t)(uNext - uStale)));
+    }
 
-        RemoveFile(m_strFile.c_str());
-        if (0 == rename(strNewFatMachOFile.c_str(), m_strFile.c_str())) {
-            return OpenFile(m_strFile.c_str());
-        }
+    for (size_t i = 0; bRet && i < arrArches.size(); i++) {
+        fat_arch *pFatArch = reinterpret_cast<fat_arch *>(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * i);
+        pFatArch->align = arrArches[i].align;
+        pFatArch->offset = (FAT_MAGIC == magic) ? arrOffsets[i] : BE(arrOffsets[i]);
+        pFatArch->size = (FAT_MAGIC == magic) ? arrMachOesSizes[i] : BE(arrMachOesSizes[i]);
     }
+    close(fd);
 
-    return false;
+    if (!bRet) {
+        ZLog::ErrorV(">>> Can't Rebuild Fat Macho File! %s\n", m_strFile.c_str());
+        return false;
+    }
+    return RemapFile((size_t)uEnd);
 }
 
 bool ZMachO::InjectDyLib(bool bWeakInject, const char *szDyLibPath, bool &bCreate) {
+    if (m_bReadOnly) {
+        ZLog::Error(">>> MachO File Is Opened Read-Only!\n");
+        return false;
+    }
+
     ZLog::WarnV(">>> Inject DyLib: %s ... \n", szDyLibPath);
 
     vector<uint32_t> arrMachOesSizes;
@@ -265,6 +519,11 @@ bool ZMachO::InjectDyLib(bool bWeakInject, const char *szDyLibPath, bool &bCreat
 }
 
 bool ZMachO::ChangeDylibPath(const char *oldPath, const char *newPath) {
+    if (m_bReadOnly) {
+        ZLog::Error(">>> MachO File Is Opened Read-Only!\n");
+        return false;
+    }
+
     ZLog::WarnV(">>> Change DyLib Path: %s -> %s ... \n", oldPath, newPath);
 
     bool pathChanged = true;
@@ -294,6 +553,11 @@ std::vector<std::string> ZMachO::ListDylibs() {
     return dylibList;
 }
 bool ZMachO::RemoveDylib(const std::set<std::string> &dylibNames) {
+    if (m_bReadOnly) {
+        ZLog::Error(">>> MachO File Is Opened Read-Only!\n");
+        return false;
+    }
+
     ZLog::Warn(">>> Removing specified dylibs...\n");
 
     bool removalSuccessful = true;
@@ -304,3 +568,190 @@ bool ZMachO::RemoveDylib(const std::set<std::string> &dylibNames) {
     ZLog::Warn(">>> Finished removing specified dylibs!\n");
     return removalSuccessful;
 }
+
+bool ZMachO::ApplyEdits(const vector<ZLoadCommandEdit> &arrEdits, bool &bChanged) {
+    if (m_bReadOnly) {
+        ZLog::Error(">>> MachO File Is Opened Read-Only!\n");
+        return false;
+    }
+
+    ZLog::WarnV(">>> Apply %lu Load Command Edits ... \n", arrEdits.size());
+
+    // every slice is checked before the first one is written, a fat file is never left half edited
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        bool bSliceChanged = false;
+        if (!m_arrArchOes[i]->ApplyEdits(arrEdits, bSliceChanged, true)) {
+            ZLog::Error(">>> Failed!\n");
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        if (!m_arrArchOes[i]->ApplyEdits(arrEdits, bChanged)) {
+            ZLog::Error(">>> Failed!\n");
+            return false;
+        }
+    }
+    ZLog::Warn(">>> Success!\n");
+    return true;
+}
+
+bool ZMachO::Thin(const set<string> &setArchs, bool &bChanged, bool bKeepUnmatched) {
+    if (m_bReadOnly) {
+        ZLog::Error(">>> MachO File Is Opened Read-Only!\n");
+        return false;
+    }
+
+    if (NULL == m_pBase || m_arrArchOes.empty() || setArchs.empty()) {
+        return false;
+    }
+
+    uint32_t magic = *((uint32_t *)m_pBase);
+    vector<size_t> arrKeep;
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        if (setArchs.count(m_arrArchOes[i]->GetArchName()) > 0) {
+            arrKeep.push_back(i);
+        }
+    }
+
+    if (arrKeep.empty()) {
+        if (bKeepUnmatched) {
+            ZLog::WarnV(">>> No Matched Architecture, Kept! %s\n", m_strFile.c_str());
+            return true;
+        }
+        ZLog::ErrorV(">>> No Architecture Left After Thinning! %s\n", m_strFile.c_str());
+        return false;
+    }
+
+    if (arrKeep.size() == m_arrArchOes.size() || (FAT_MAGIC != magic && FAT_CIGAM != magic)) {
+        return true;
+    }
+
+    vector<fat_arch> arrArches;
+    for (size_t i = 0; i < arrKeep.size(); i++) {
+        arrArches.push_back(*(reinterpret_cast<fat_arch *>(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * arrKeep[i])));
+    }
+
+    ZLog::WarnV(">>> Thin: %s, %lu -> %lu Archs\n", m_strFile.c_str(), m_arrArchOes.size(), arrArches.size());
+
+    if (!PackSlices(arrArches, 1 == arrArches.size())) {
+        ZLog::ErrorV(">>> Can't Thin Macho File! %s\n", m_strFile.c_str());
+        return false;
+    }
+
+    bChanged = true;
+    return true;
+}
+
+bool ZMachO::Strip(uint32_t uFlags, uint64_t &uSaved) {
+    uSaved = 0;
+    if (m_bReadOnly) {
+        ZLog::Error(">>> MachO File Is Opened Read-Only!\n");
+        return false;
+    }
+
+    if (NULL == m_pBase || m_arrArchOes.empty()) {
+        return false;
+    }
+
+    uint32_t magic = *((uint32_t *)m_pBase);
+    bool bFat = (FAT_MAGIC == magic || FAT_CIGAM == magic);
+    vector<fat_arch> arrArches;
+    bool bStripped = false;
+    for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+        uint32_t uOldLength = m_arrArchOes[i]->m_uLength;
+        uint32_t uNewLength = 0;
+        if (!m_arrArchOes[i]->Strip(uFlags, uNewLength)) {
+            ZLog::ErrorV(">>> Can't Strip Macho File! %s\n", m_strFile.c_str());
+            return false;
+        }
+        bStripped = bStripped || (uNewLength < uOldLength);
+
+        if (bFat) {
+            fat_arch arch = *(reinterpret_cast<fat_arch *>(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * i));
+            arch.size = (FAT_MAGIC == magic) ? uNewLength : BE(uNewLength);
+            arrArches.push_back(arch);
+        } else {
+            arrArches.resize(1);
+            arrArches[0].size = uNewLength;
+        }
+    }
+
+    if (!bStripped) {
+        return true;
+    }
+
+    size_t sOldSize = m_sSize;
+    bool bRet = false;
+    if (bFat) {
+        bRet = PackSlices(arrArches, false);
+    } else {
+        int fd = open(m_strFile.c_str(), O_RDWR);
+        if (fd >= 0) {
+            bRet = (0 == ftruncate(fd, arrArches[0].size));
+            close(fd);
+            bRet = bRet && RemapFile(arrArches[0].size);
+        }
+    }
+
+    if (!bRet) {
+        ZLog::ErrorV(">>> Can't Strip Macho File! %s\n", m_strFile.c_str());
+        return false;
+    }
+
+    uSaved = sOldSize - m_sSize;
+    ZLog::PrintV(">>> Stripped: %s, %lu -> %lu Bytes\n", m_strFile.c_str(), sOldSize, m_sSize);
+    return true;
+}
+
+bool ZMachO::PackSlices(vector<fat_arch> arrArches, bool bThin) {
+    uint32_t magic = *((uint32_t *)m_pBase);
+    auto FatValue = [magic](uint32_t uValue) { return (FAT_MAGIC == magic) ? uValue : LE(uValue); };
+    sort(arrArches.begin(), arrArches.end(),
+         [&](const fat_arch &a, const fat_arch &b) { return FatValue(a.offset) < FatValue(b.offset); });
+
+    // a thin result is a single slice at offset 0, otherwise the slices are packed behind
+    // the fat header. slices only move down, so moving them first to last is safe.
+    uint64_t uEnd = bThin ? 0 : sizeof(fat_header) + sizeof(fat_arch) * arrArches.size();
+    vector<uint32_t> arrOffsets;
+    for (size_t i = 0; i < arrArches.size(); i++) {
+        uint32_t uOldOffset = FatValue(arrArches[i].offset);
+        uint64_t uAlign = (uint64_t)1 << FatValue(arrArches[i].align);
+        uint64_t uOffset = min((uint64_t)uOldOffset, ((uEnd + uAlign - 1) / uAlign) * uAlign);
+        arrOffsets.push_back((uint32_t)uOffset);
+        uEnd = uOffset + FatValue(arrArches[i].size);
+    }
+
+    int fd = open(m_strFile.c_str(), O_RDWR);
+    if (fd < 0) {
+        ZLog::ErrorV(">>> Can't Open File! %s, %s\n", m_strFile.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool bRet = true;
+    uint64_t uPrevEnd = arrOffsets[0];
+    for (size_t i = 0; bRet && i < arrArches.size(); i++) {
+        uint32_t uSize = FatValue(arrArches[i].size);
+        bRet = (uPrevEnd >= arrOffsets[i] || ZeroFileRange(fd, uPrevEnd, (size_t)(arrOffsets[i] - uPrevEnd))) &&
+               MoveFileRange(fd, FatValue(arrArches[i].offset), arrOffsets[i], uSize);
+        uPrevEnd = (uint64_t)arrOffsets[i] + uSize;
+    }
+
+    if (bRet && !bThin) { // the header pages are in front of every slice, patch them through the mapping
+        fat_header *pFatHeader = reinterpret_cast<fat_header *>(m_pBase);
+        uint32_t uOldArches = FatValue(pFatHeader->nfat_arch);
+        uint32_t uArches = (uint32_t)arrArches.size();
+        pFatHeader->nfat_arch = (FAT_MAGIC == magic) ? uArches : BE(uArches);
+        fat_arch *pFatArches = reinterpret_cast<fat_arch *>(m_pBase + sizeof(fat_header));
+        for (size_t i = 0; i < arrArches.size(); i++) {
+            pFatArches[i] = arrArches[i];
+            pFatArches[i].offset = (FAT_MAGIC == magic) ? arrOffsets[i] : BE(arrOffsets[i]);
+        }
+        memset(pFatArches + uArches, 0, sizeof(fat_arch) * (uOldArches - uArches));
+    }
+
+    bRet = bRet && (0 == ftruncate(fd, (off_t)uEnd));
+    close(fd);
+
+    return bRet && RemapFile((size_t)uEnd);
+}
@@ -21,27 +21,42 @@ public:
 public:
     bool Init(const char *szFile);
     bool InitV(const char *szFormatPath, ...);
+    bool InitReadOnly(const char *szFile, bool bMapFile = false);
     bool Free();
     void PrintInfo();
     bool Sign(ZSignAsset *pSignAsset, bool bForce, string strBundleId, string strInfoPlistSHA1,
-              string strInfoPlistSHA256, const string &strCodeResourcesData);
+              string strInfoPlistSHA256, string strCodeResourcesSHA1, string strCodeResourcesSHA256);
     bool InjectDyLib(bool bWeakInject, const char *szDyLibPath, bool &bCreate);
     bool ChangeDylibPath(const char *oldPath, const char *newPath);
     std::vector<std::string> ListDylibs();
     bool RemoveDylib(const std::set<std::string> &dylibNames);
+    bool ApplyEdits(const vector<ZLoadCommandEdit> &arrEdits, bool &bChanged);
+    // bKeepUnmatched leaves a file without any of setArchs as it is, instead of failing
+    bool Thin(const set<string> &setArchs, bool &bChanged, bool bKeepUnmatched = false);
+    bool Strip(uint32_t uFlags, uint64_t &uSaved);
+    bool Verify(const string &strInfoPlistData, const string &strCodeResourcesData, JValue &jvOutput);
+    bool IsSignedBy(ZSignAsset *pSignAsset, string strBundleId, const string &strInfoPlistData,
+                    const string &strCodeResourcesData);
 
 private:
     bool OpenFile(const char *szPath);
+    bool OpenFileReadOnly(const char *szPath, bool bMapFile);
+    bool RemapFile(size_t sNewSize);
+    bool LoadArchOes();
     bool CloseFile();
 
     bool NewArchO(uint8_t *pBase, uint32_t uLength);
+    bool NewArchOHeader(int fd, uint32_t uOffset, uint32_t uLength);
     void FreeArchOes();
     bool ReallocCodeSignSpace();
+    bool PackSlices(vector<fat_arch> arrArches, bool bThin);
 
 private:
     size_t m_sSize;
     string m_strFile;
     uint8_t *m_pBase;
     bool m_bCSRealloced;
+    bool m_bReadOnly;
+    vector<uint8_t *> m_arrBuffers;
     vector<ZArchO *> m_arrArchOes;
 };
@@ -344,6 +344,38 @@ bool GetCertSubjectCN(X509 *cert, string &strSubjectCN) {
     return (!strSubjectCN.empty());
 }
 
+// SHA-256 over the DER encoding and the serial number, both as hex. A renewed certificate keeps its
+// subject CN but not these.
+bool GetCertFingerprint(X509 *cert, string &strSHA256, string &strSerial) {
+    strSHA256.clear();
+    strSerial.clear();
+    if (!cert) {
+        return CMSError();
+    }
+
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    if (1 != X509_digest(cert, EVP_sha256(), md, &len)) {
+        return CMSError();
+    }
+    for (unsigned int i = 0; i < len; i++) {
+        char szHex[3];
+        snprintf(szHex, sizeof(szHex), "%02x", md[i]);
+        strSHA256 += szHex;
+    }
+
+    BIGNUM *bignum = ASN1_INTEGER_to_BN(X509_get_serialNumber(cert), NULL);
+    if (NULL != bignum) {
+        char *szSerial = BN_bn2hex(bignum);
+        if (NULL != szSerial) {
+            strSerial = szSerial;
+            OPENSSL_free(szSerial);
+        }
+        BN_free(bignum);
+    }
+    return (!strSHA256.empty() && !strSerial.empty());
+}
+
 bool GetCertSubjectCN(const string &strCertData, string &strSubjectCN) {
     if (strCertData.empty()) {
         return false;
@@ -362,6 +394,46 @@ bool GetCertSubjectCN(const string &strCertData, string &strSubjectCN) {
     return GetCertSubjectCN(cert, strSubjectCN);
 }
 
+bool VerifyCMS(uint8_t *pCMSData, uint32_t uCMSLength, const string &strContentData, string &strSignerCN,
+               string *pstrSignerSHA256 /*= NULL*/, string *pstrSignerSerial /*= NULL*/) {
+    strSignerCN.clear();
+    BIO *in = BIO_new_mem_buf(pCMSData, (int)uCMSLength);
+    if (!in) {
+        return CMSError();
+    }
+
+    CMS_ContentInfo *cms = d2i_CMS_bio(in, NULL);
+    BIO_free(in);
+    if (!cms) {
+        return CMSError();
+    }
+
+    BIO *content = BIO_new_mem_buf(strContentData.data(), (int)strContentData.size());
+    if (!content) {
+        CMS_ContentInfo_free(cms);
+        return CMSError();
+    }
+
+    // checks the signer's signature over the detached content, the certificate chain isn't evaluated
+    int nRet = CMS_verify(cms, NULL, NULL, content, NULL, CMS_BINARY | CMS_NO_SIGNER_CERT_VERIFY);
+    BIO_free(content);
+    if (1 == nRet) {
+        STACK_OF(X509) *signers = CMS_get0_signers(cms);
+        if (NULL != signers && sk_X509_num(signers) > 0) {
+            GetCertSubjectCN(sk_X509_value(signers, 0), strSignerCN);
+            if (NULL != pstrSignerSHA256 && NULL != pstrSignerSerial) {
+                GetCertFingerprint(sk_X509_value(signers, 0), *pstrSignerSHA256, *pstrSignerSerial);
+            }
+        }
+        sk_X509_free(signers);
+    }
+    CMS_ContentInfo_free(cms);
+    if (1 != nRet) {
+        return CMSError();
+    }
+    return true;
+}
+
 void ParseCertSubject(const string &strSubject, JValue &jvSubject) {
     vector<string> arrNodes;
     StringSplit(strSubject, "/", arrNodes);
@@ -453,8 +525,9 @@ bool GetCMSInfo(uint8_t *pCMSData, uint32_t uCMSLength, JValue &jvOutput) {
     ASN1_OCTET_STRING **pos = CMS_get0_content(cms);
     if (pos) {
         if ((*pos)) {
-            ZBase64 b64;
-            jvOutput["content"] = b64.Encode((const char *)(*pos)->data, (*pos)->length);
+            string strContent;
+            ZBase64::Encode((*pos)->data, (size_t)(*pos)->length, strContent);
+            jvOutput["content"] = strContent;
         }
     }
 
@@ -462,7 +535,7 @@ bool GetCMSInfo(uint8_t *pCMSData, uint32_t uCMSLength, JValue &jvOutput) {
     for (int i = 0; i < sk_X509_num(certs); i++) {
         JValue jvCertInfo;
         if (GetCertInfo(sk_X509_value(certs, i), jvCertInfo)) {
-            jvOutput["certs"].push_back(jvCertInfo);
+            jvOutput["certs"].push_back(std::move(jvCertInfo));
         }
     }
 
@@ -569,7 +642,7 @@ bool GetCMSInfo(uint8_t *pCMSData, uint32_t uCMSLength, JValue &jvOutput) {
                     jvAttr["name"] = OBJ_nid2ln(OBJ_obj2nid(obj));
                     jvAttr["type"] = av->type;
                     jvAttr["count"] = nCount;
-                    jvOutput["attrs"]["unknown"].push_back(jvAttr);
+                    jvOutput["attrs"]["unknown"].push_back(std::move(jvAttr));
                 }
             }
         }
@@ -592,10 +665,10 @@ bool ZSignAsset::Init(const string &strSignerCertFile, const string &strSignerPK
         return false;
     }
 
-    JValue jvProv;
+    JDocument jvProv;
     string strProvContent;
     if (GetCMSContent(m_strProvisionData, strProvContent)) {
-        if (jvProv.readPList(strProvContent)) {
+        if (jvProv.readPListKeys(strProvContent, {"TeamIdentifier", "Entitlements", "DeveloperCertificates"})) {
             m_strTeamId = jvProv["TeamIdentifier"][0].asCString();
             if (m_strEntitlementsData.empty()) {
                 jvProv["Entitlements"].writePList(m_strEntitlementsData);
@@ -683,6 +756,11 @@ bool ZSignAsset::Init(const string &strSignerCertFile, const string &strSignerPK
         return false;
     }
 
+    if (!GetCertFingerprint(x509Cert, m_strCertSHA256, m_strCertSerial)) {
+        ZLog::Error(">>> Can't Get Certificate Fingerprint!\n");
+        return false;
+    }
+
     m_evpPKey = evpPKey;
     m_x509Cert = x509Cert;
     return true;
@@ -13,6 +13,9 @@
 bool GetCertSubjectCN(const string &strCertData, string &strSubjectCN);
 bool GetCMSInfo(uint8_t *pCMSData, uint32_t uCMSLength, JValue &jvOutput);
 bool GetCMSContent(const string &strCMSDataInput, string &strContentOutput);
+// pstrSignerSHA256 and pstrSignerSerial, if given, get the fingerprint and serial of the signer certificate
+bool VerifyCMS(uint8_t *pCMSData, uint32_t uCMSLength, const string &strContentData, string &strSignerCN,
+               string *pstrSignerSHA256 = NULL, string *pstrSignerSerial = NULL);
 bool GenerateCMS(const string &strSignerCertData, const string &strSignerPKeyData, const string &strCDHashData,
                  const string &strCDHashesPlist, string &strCMSOutput);
 
@@ -30,6 +33,8 @@ public:
 public:
     string m_strTeamId;
     string m_strSubjectCN;
+    string m_strCertSHA256; // hex, of the DER certificate
+    string m_strCertSerial;
     string m_strProvisionData;
     string m_strEntitlementsData;
 
@@ -13,7 +13,9 @@
 #include "common/common.h"
 #include "common/json.h"
 #include "common/mach-o.h"
+#include "common/machoview.h"
 #include "openssl.h"
+#include <algorithm>
 
 static void _DERLength(string &strBlob, uint64_t uLength) {
     if (uLength < 128) {
@@ -707,3 +709,256 @@ bool GetCodeSignatureExistsCodeSlotsData(uint8_t *pCSBase, uint8_t *&pCodeSlots1
     return ((NULL != pCodeSlots1Data) && (NULL != pCodeSlots256Data) && uCodeSlots1DataLength > 0 &&
             uCodeSlots256DataLength > 0);
 }
+
+static string _HexString(const string &strData) {
+    string strOutput;
+    char buf[16] = {0};
+    for (size_t i = 0; i < strData.size(); i++) {
+        sprintf(buf, "%02x", (uint8_t)strData[i]);
+        strOutput += buf;
+    }
+    return strOutput;
+}
+
+struct ZSignatureBlob {
+    uint32_t uSlot;
+    uint8_t *pBase;
+    uint32_t uLength;
+};
+
+static bool _VerifyCodeDirectory(const ZSignatureBlob &cd, uint8_t *pCodeBase, uint32_t uCodeLength, bool bCodeSlots,
+                                 const string *arrSpecialData, JValue &jvErrors, string &strCDHash) {
+    string strError;
+    CS_CodeDirectory cdHeader;
+    memset(&cdHeader, 0, sizeof(cdHeader));
+    memcpy(&cdHeader, cd.pBase, min((size_t)cd.uLength, sizeof(cdHeader)));
+
+    uint32_t uHashType = cdHeader.hashType;
+    uint32_t uHashSize = cdHeader.hashSize;
+    if (cd.uLength < 44 || (1 != uHashType && 2 != uHashType) || uHashSize != ((1 == uHashType) ? 20 : 32)) {
+        jvErrors.push_back(StringFormat(strError, "CodeDirectory 0x%x: unsupported hash type %u", cd.uSlot, uHashType));
+        return false;
+    }
+    SHASum(uHashType, cd.pBase, cd.uLength, strCDHash);
+
+    uint64_t uCodeLimit = LE(cdHeader.codeLimit);
+    if (LE(cdHeader.version) >= 0x20300 && cd.uLength >= offsetof(CS_CodeDirectory, codeLimit64) + 8 &&
+        0 != cdHeader.codeLimit64) {
+        uCodeLimit = LE(cdHeader.codeLimit64);
+    }
+    if (uCodeLimit != uCodeLength) {
+        jvErrors.push_back(StringFormat(strError, "CodeDirectory 0x%x: code limit %llu doesn't match signature offset %u",
+                                        cd.uSlot, (unsigned long long)uCodeLimit, uCodeLength));
+        uCodeLimit = min(uCodeLimit, (uint64_t)uCodeLength);
+    }
+
+    uint64_t uHashOffset = LE(cdHeader.hashOffset);
+    uint64_t uSpecialSlots = LE(cdHeader.nSpecialSlots);
+    uint64_t uCodeSlots = LE(cdHeader.nCodeSlots);
+    if (uHashOffset < uSpecialSlots * uHashSize || uHashOffset + uCodeSlots * uHashSize > cd.uLength ||
+        cdHeader.pageSize >= 32) {
+        jvErrors.push_back(StringFormat(strError, "CodeDirectory 0x%x: slots out of bounds", cd.uSlot));
+        return false;
+    }
+    uint8_t *pHashes = cd.pBase + uHashOffset;
+
+    // a page size of 0 means the whole range is hashed as one page
+    uint64_t uPageSize = (0 == cdHeader.pageSize) ? max(uCodeLimit, (uint64_t)1) : (1ULL << cdHeader.pageSize);
+    uint64_t uPages = (uCodeLimit + uPageSize - 1) / uPageSize;
+    bool bValid = true;
+    if (uPages != uCodeSlots) {
+        jvErrors.push_back(StringFormat(strError, "CodeDirectory 0x%x: %llu code slots for %llu pages", cd.uSlot,
+                                        (unsigned long long)uCodeSlots, (unsigned long long)uPages));
+        bValid = false;
+    }
+
+    uint64_t uBadSlots = 0;
+    uint64_t uFirstBadSlot = 0;
+    for (uint64_t i = 0; bCodeSlots && i < min(uPages, uCodeSlots); i++) {
+        string strSHASum;
+        uint64_t uOffset = i * uPageSize;
+        SHASum(uHashType, pCodeBase + uOffset, (size_t)min(uPageSize, uCodeLimit - uOffset), strSHASum);
+        if (0 != memcmp(strSHASum.data(), pHashes + i * uHashSize, uHashSize)) {
+            uFirstBadSlot = (0 == uBadSlots) ? i : uFirstBadSlot;
+            uBadSlots++;
+        }
+    }
+    if (uBadSlots > 0) {
+        jvErrors.push_back(StringFormat(strError, "CodeDirectory 0x%x: %llu code slots mismatch, first at page %llu",
+                                        cd.uSlot, (unsigned long long)uBadSlots, (unsigned long long)uFirstBadSlot));
+        bValid = false;
+    }
+
+    static const uint32_t arrSpecialSlots[] = {CSSLOT_INFOSLOT, CSSLOT_REQUIREMENTS, CSSLOT_RESOURCEDIR,
+                                               CSSLOT_ENTITLEMENTS, CSSLOT_DER_ENTITLEMENTS};
+    static const char *arrSpecialNames[] = {"Info.plist", "Requirements", "CodeResources", "Entitlements",
+                                            "Entitlements(DER)"};
+    for (size_t i = 0; i < sizeof(arrSpecialSlots) / sizeof(arrSpecialSlots[0]); i++) {
+        uint32_t uSlot = arrSpecialSlots[i];
+        const string &strData = arrSpecialData[i];
+        if (uSlot > uSpecialSlots) { // unbound, fine as long as there is nothing to bind
+            if (!strData.empty()) {
+                jvErrors.push_back(
+                    StringFormat(strError, "CodeDirectory 0x%x: %s not bound", cd.uSlot, arrSpecialNames[i]));
+                bValid = false;
+            }
+            continue;
+        }
+
+        string strExpected(uHashSize, 0);
+        if (!strData.empty()) {
+            SHASum(uHashType, strData, strExpected);
+        }
+        if (0 != memcmp(strExpected.data(), pHashes - uSlot * uHashSize, uHashSize)) {
+            jvErrors.push_back(
+                StringFormat(strError, "CodeDirectory 0x%x: %s slot mismatch", cd.uSlot, arrSpecialNames[i]));
+            bValid = false;
+        }
+    }
+
+    return bValid;
+}
+
+bool VerifyCodeSignature(uint8_t *pCSBase, uint32_t uCSLength, uint8_t *pCodeBase, uint32_t uCodeLength,
+                         const string &strInfoPlistData, const string &strCodeResourcesData, bool bCodeSlots,
+                         JValue &jvOutput) {
+    jvOutput["signed"] = false;
+    jvOutput["cdhashes"] = JValue(JValue::E_ARRAY);
+    jvOutput["errors"] = JValue(JValue::E_ARRAY);
+    JValue &jvErrors = jvOutput["errors"];
+
+    ZMachOView view(pCSBase, uCSLength);
+    CS_SuperBlob *psb = view.At<CS_SuperBlob>(0);
+    if (NULL == psb || CSMAGIC_EMBEDDED_SIGNATURE != LE(psb->magic) || LE(psb->length) > uCSLength) {
+        jvErrors.push_back("invalid code signature");
+        return false;
+    }
+
+    view = ZMachOView(pCSBase, LE(psb->length));
+    CS_BlobIndex *pbi = view.At<CS_BlobIndex>(sizeof(CS_SuperBlob), LE(psb->count));
+    if (NULL == pbi) {
+        jvErrors.push_back("code signature index out of bounds");
+        return false;
+    }
+
+    string strError;
+    map<uint32_t, ZSignatureBlob> mapBlobs;
+    for (uint32_t i = 0; i < LE(psb->count); i++) {
+        ZSignatureBlob blob = {LE(pbi[i].type), NULL, 0};
+        uint32_t uOffset = LE(pbi[i].offset);
+        uint32_t *pHeader = view.At<uint32_t>(uOffset, 2);
+        blob.uLength = (NULL != pHeader) ? LE(pHeader[1]) : 0;
+        if (NULL == pHeader || blob.uLength < 8 || !view.Contains(uOffset, blob.uLength)) {
+            jvErrors.push_back(StringFormat(strError, "blob 0x%x out of bounds", blob.uSlot));
+            continue;
+        }
+        blob.pBase = pCSBase + uOffset;
+        mapBlobs[blob.uSlot] = blob;
+    }
+
+    // Info.plist, Requirements, CodeResources, Entitlements and Entitlements(DER), as bound by the special slots
+    string arrSpecialData[5];
+    arrSpecialData[0] = strInfoPlistData;
+    arrSpecialData[2] = strCodeResourcesData;
+    const uint32_t arrBlobSlots[] = {CSSLOT_REQUIREMENTS, CSSLOT_ENTITLEMENTS, CSSLOT_DER_ENTITLEMENTS};
+    const uint32_t arrDataIndexes[] = {1, 3, 4};
+    for (size_t i = 0; i < 3; i++) {
+        if (mapBlobs.count(arrBlobSlots[i]) > 0) {
+            const ZSignatureBlob &blob = mapBlobs[arrBlobSlots[i]];
+            arrSpecialData[arrDataIndexes[i]].assign((const char *)blob.pBase, blob.uLength);
+        }
+    }
+
+    vector<ZSignatureBlob> arrCodeDirectories;
+    vector<string> arrCDHashes;
+    for (map<uint32_t, ZSignatureBlob>::iterator it = mapBlobs.begin(); it != mapBlobs.end(); it++) {
+        if (CSSLOT_CODEDIRECTORY == it->first ||
+            (it->first >= CSSLOT_ALTERNATE_CODEDIRECTORIES && it->first < CSSLOT_ALTERNATE_CODEDIRECTORY_LIMIT)) {
+            string strCDHash;
+            _VerifyCodeDirectory(it->second, pCodeBase, uCodeLength, bCodeSlots, arrSpecialData, jvErrors, strCDHash);
+            arrCodeDirectories.push_back(it->second);
+            arrCDHashes.push_back(strCDHash);
+            jvOutput["cdhashes"].push_back(_HexString(strCDHash));
+        }
+    }
+    if (arrCodeDirectories.empty() || CSSLOT_CODEDIRECTORY != arrCodeDirectories[0].uSlot) {
+        jvErrors.push_back("no CodeDirectory");
+        return false;
+    }
+
+    CS_CodeDirectory cdHeader;
+    memset(&cdHeader, 0, sizeof(cdHeader));
+    memcpy(&cdHeader, arrCodeDirectories[0].pBase, min((size_t)arrCodeDirectories[0].uLength, sizeof(cdHeader)));
+    if (LE(cdHeader.version) >= 0x20200 && 0 != cdHeader.teamOffset) {
+        ZMachOView cdView(arrCodeDirectories[0].pBase, arrCodeDirectories[0].uLength);
+        jvOutput["teamid"] = cdView.String(LE(cdHeader.teamOffset), arrCodeDirectories[0].uLength);
+    }
+
+    // an empty wrapper is an ad-hoc signature, there is nothing more to check
+    if (mapBlobs.count(CSSLOT_SIGNATURESLOT) > 0 && mapBlobs[CSSLOT_SIGNATURESLOT].uLength > 8) {
+        const ZSignatureBlob &cms = mapBlobs[CSSLOT_SIGNATURESLOT];
+        jvOutput["signed"] = true;
+
+        string strSignerCN;
+        string strSignerSHA256;
+        string strSignerSerial;
+        string strCodeDirectory((const char *)arrCodeDirectories[0].pBase, arrCodeDirectories[0].uLength);
+        if (!VerifyCMS(cms.pBase + 8, cms.uLength - 8, strCodeDirectory, strSignerCN, &strSignerSHA256,
+                       &strSignerSerial)) {
+            jvErrors.push_back("CMS signature doesn't match the CodeDirectory");
+        }
+        jvOutput["signer"] = strSignerCN;
+        jvOutput["signersha256"] = strSignerSHA256;
+        jvOutput["signerserial"] = strSignerSerial;
+
+        JValue jvInfo;
+        GetCMSInfo(cms.pBase + 8, cms.uLength - 8, jvInfo);
+
+        // the plist lists every CDHash truncated to 20 bytes, in CodeDirectory order
+        JValue jvHashes;
+        jvHashes.readPList(jvInfo["attrs"]["CDHashes"]["data"].asString());
+        JValue &jvPListHashes = jvHashes["cdhashes"];
+        if (jvPListHashes.size() != arrCDHashes.size()) {
+            jvErrors.push_back(StringFormat(strError, "CMS lists %lu CDHashes for %lu CodeDirectories",
+                                            (unsigned long)jvPListHashes.size(), (unsigned long)arrCDHashes.size()));
+        }
+        for (size_t i = 0; i < jvPListHashes.size() && i < arrCDHashes.size(); i++) {
+            if (jvPListHashes[i].asData() != arrCDHashes[i].substr(0, 20)) {
+                jvErrors.push_back(StringFormat(strError, "CMS CDHash %lu mismatch", (unsigned long)i));
+            }
+        }
+
+        // CDHashes2 carries the full SHA-256 CDHashes
+        JValue &jvFullHashes = jvInfo["attrs"]["CDHashes2"]["data"];
+        for (size_t i = 0; i < jvFullHashes.size(); i++) {
+            string strHash = jvFullHashes[i].asString();
+            if (arrCDHashes.end() == find_if(arrCDHashes.begin(), arrCDHashes.end(), [&](const string &strCDHash) {
+                    return 32 == strCDHash.size() && strHash == _HexString(strCDHash);
+                })) {
+                jvErrors.push_back(StringFormat(strError, "CMS SHA-256 CDHash %lu mismatch", (unsigned long)i));
+            }
+        }
+    }
+
+    return (0 == jvErrors.size());
+}
+
+bool GetCodeSignatureSlot(uint8_t *pCSBase, uint32_t uCSLength, uint32_t uSlot, string &strOutput) {
+    strOutput.clear();
+    ZMachOView view(pCSBase, uCSLength);
+    CS_SuperBlob *psb = view.At<CS_SuperBlob>(0);
+    if (NULL == psb || CSMAGIC_EMBEDDED_SIGNATURE != LE(psb->magic)) {
+        return false;
+    }
+
+    CS_BlobIndex *pbi = view.At<CS_BlobIndex>(sizeof(CS_SuperBlob), LE(psb->count));
+    for (uint32_t i = 0; NULL != pbi && i < LE(psb->count); i++) {
+        uint32_t uOffset = LE(pbi[i].offset);
+        uint32_t *pHeader = view.At<uint32_t>(uOffset, 2);
+        if (uSlot == LE(pbi[i].type) && NULL != pHeader && view.Contains(uOffset, LE(pHeader[1]))) {
+            strOutput.assign((const char *)pHeader, LE(pHeader[1]));
+            return true;
+        }
+    }
+    return false;
+}
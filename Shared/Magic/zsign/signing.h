@@ -30,3 +30,12 @@ bool SlotBuildCMSSignature(ZSignAsset *pSignAsset, const string &strCodeDirector
 bool GetCodeSignatureExistsCodeSlotsData(uint8_t *pCSBase, uint8_t *&pCodeSlots1Data, uint32_t &uCodeSlots1DataLength,
                                          uint8_t *&pCodeSlots256Data, uint32_t &uCodeSlots256DataLength);
 uint32_t GetCodeSignatureLength(uint8_t *pCSBase);
+
+// Recomputes the code slots of every CodeDirectory over pCodeBase (unless bCodeSlots is false, then only the
+// code limit is checked), checks the special slots against the given Info.plist and CodeResources data and the
+// blobs in the signature, and matches the CDHashes signed by the CMS blob against the CodeDirectories.
+// Fills jvOutput with "signed", "signer", "signersha256", "signerserial", "teamid", "cdhashes" and "errors".
+bool VerifyCodeSignature(uint8_t *pCSBase, uint32_t uCSLength, uint8_t *pCodeBase, uint32_t uCodeLength,
+                         const string &strInfoPlistData, const string &strCodeResourcesData, bool bCodeSlots,
+                         JValue &jvOutput);
+bool GetCodeSignatureSlot(uint8_t *pCSBase, uint32_t uCSLength, uint32_t uSlot, string &strOutput);
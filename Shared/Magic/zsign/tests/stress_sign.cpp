@@ -0,0 +1,372 @@
+/*
+ * Proprietary Software License Version 1.0
+ *
+ * Copyright (C) 2025 BDG
+ *
+ * Backdoor App Signer is proprietary software. You may not use, modify, or distribute it except as expressly permitted
+ * under the terms of the Proprietary Software License.
+ */
+
+// Stress test of the signing engine from many threads, meant to be run under ThreadSanitizer.
+// It creates a throwaway signing identity and a set of thin and fat Mach-O files, signs every file
+// once on the main thread and once on a pool of threads, and checks each copy ends up with the same
+// CodeDirectories. usage: zsign_stress [files] [threads]
+
+#include "common/base64.h"
+#include "common/common.h"
+#include "macho.h"
+#include "openssl.h"
+#include <atomic>
+#include <openssl/cms.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <thread>
+
+#define STRESS_TEAM_ID "STRESS0001"
+
+static string g_strWorkFolder;
+
+// common.cpp logs to <documents>/logs.txt, the app gets the folder from Utils.mm
+extern "C" const char *getDocumentsDirectory() { return g_strWorkFolder.c_str(); }
+
+static void AppendUInt32(string &strData, uint32_t uValue) { strData.append((const char *)&uValue, sizeof(uValue)); }
+
+static void AppendUInt64(string &strData, uint64_t uValue) { strData.append((const char *)&uValue, sizeof(uValue)); }
+
+static void AppendName(string &strData, const char *szName) {
+    char szBuffer[16] = {0};
+    memcpy(szBuffer, szName, min(strlen(szName), sizeof(szBuffer) - 1));
+    strData.append(szBuffer, sizeof(szBuffer));
+}
+
+static void AppendSegment(string &strData, const char *szName, uint64_t uOffset, uint64_t uSize, uint32_t uProt,
+                          uint32_t uSections) {
+    AppendUInt32(strData, LC_SEGMENT_64);
+    AppendUInt32(strData, sizeof(segment_command_64) + uSections * sizeof(section_64));
+    AppendName(strData, szName);
+    AppendUInt64(strData, uOffset); // vmaddr
+    AppendUInt64(strData, uSize);
+    AppendUInt64(strData, uOffset); // fileoff
+    AppendUInt64(strData, uSize);
+    AppendUInt32(strData, uProt);
+    AppendUInt32(strData, uProt);
+    AppendUInt32(strData, uSections);
+    AppendUInt32(strData, 0);
+}
+
+static void AppendSection(string &strData, const char *szName, uint64_t uOffset, uint64_t uSize, uint32_t uFlags) {
+    AppendName(strData, szName);
+    AppendName(strData, "__TEXT");
+    AppendUInt64(strData, uOffset);
+    AppendUInt64(strData, uSize);
+    AppendUInt32(strData, (uint32_t)uOffset);
+    AppendUInt32(strData, 0); // align
+    AppendUInt32(strData, 0); // reloff
+    AppendUInt32(strData, 0); // nreloc
+    AppendUInt32(strData, uFlags);
+    AppendUInt32(strData, 0);
+    AppendUInt32(strData, 0);
+    AppendUInt32(strData, 0);
+}
+
+// an arm64 executable with __TEXT (code and an embedded Info.plist), __LINKEDIT and one dylib, and a
+// reserved LC_CODE_SIGNATURE if bSigned, so both the in-place and the grow path of Sign are taken
+static string BuildArchO(uint32_t uCPUSubType, uint32_t uTextSize, bool bSigned) {
+    string strPList = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\"><dict>"
+                      "<key>CFBundleIdentifier</key><string>com.zsign.stress</string></dict></plist>\n";
+    uint32_t uLinkEditOffset = uTextSize;
+    uint32_t uSignOffset = uLinkEditOffset + 0x1000;
+    uint32_t uSignSize = bSigned ? 0x4000 : 0;
+    uint32_t uTotal = uSignOffset + uSignSize;
+
+    string strCommands;
+    uint32_t uCommands = 0;
+    AppendSegment(strCommands, "__TEXT", 0, uTextSize, 5 /* r-x */, 2);
+    AppendSection(strCommands, "__text", 0x1000, 0x100, S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS);
+    AppendSection(strCommands, "__info_plist", 0x2000, strPList.size(), 0);
+    uCommands++;
+    AppendSegment(strCommands, "__LINKEDIT", uLinkEditOffset, uTotal - uLinkEditOffset, 1 /* r-- */, 0);
+    uCommands++;
+
+    string strDylib = "/usr/lib/libSystem.B.dylib";
+    strDylib.append(8 - strDylib.size() % 8, '\0');
+    AppendUInt32(strCommands, LC_LOAD_DYLIB);
+    AppendUInt32(strCommands, sizeof(dylib_command) + strDylib.size());
+    AppendUInt32(strCommands, sizeof(dylib_command));
+    AppendUInt32(strCommands, 2);
+    AppendUInt32(strCommands, 0x10000);
+    AppendUInt32(strCommands, 0x10000);
+    strCommands += strDylib;
+    uCommands++;
+
+    if (bSigned) {
+        AppendUInt32(strCommands, LC_CODE_SIGNATURE);
+        AppendUInt32(strCommands, 16); // linkedit_data_command
+        AppendUInt32(strCommands, uSignOffset);
+        AppendUInt32(strCommands, uSignSize);
+        uCommands++;
+    }
+
+    string strArchO;
+    AppendUInt32(strArchO, MH_MAGIC_64);
+    AppendUInt32(strArchO, CPU_TYPE_ARM64);
+    AppendUInt32(strArchO, uCPUSubType);
+    AppendUInt32(strArchO, MH_EXECUTE);
+    AppendUInt32(strArchO, uCommands);
+    AppendUInt32(strArchO, (uint32_t)strCommands.size());
+    AppendUInt32(strArchO, MH_NOUNDEFS | MH_DYLDLINK | MH_TWOLEVEL | MH_PIE);
+    AppendUInt32(strArchO, 0);
+    strArchO += strCommands;
+
+    strArchO.resize(uTotal, '\0');
+    for (uint32_t i = 0x1000; i < 0x1100; i++) {
+        strArchO[i] = (char)(i * 7 + uCPUSubType);
+    }
+    strArchO.replace(0x2000, strPList.size(), strPList);
+    for (uint32_t i = 0x3000; i < uTextSize; i += 0x800) {
+        strArchO[i] = (char)(i / 0x800);
+    }
+    return strArchO;
+}
+
+static string BuildFatMachO(const vector<string> &arrArchOes, const vector<uint32_t> &arrCPUSubTypes) {
+    string strFat;
+    AppendUInt32(strFat, BE((uint32_t)FAT_MAGIC));
+    AppendUInt32(strFat, BE((uint32_t)arrArchOes.size()));
+
+    string strBody;
+    uint32_t uOffset = 0x4000;
+    for (size_t i = 0; i < arrArchOes.size(); i++) {
+        AppendUInt32(strFat, BE((uint32_t)CPU_TYPE_ARM64));
+        AppendUInt32(strFat, BE(arrCPUSubTypes[i]));
+        AppendUInt32(strFat, BE(uOffset));
+        AppendUInt32(strFat, BE((uint32_t)arrArchOes[i].size()));
+        AppendUInt32(strFat, BE((uint32_t)14));
+        strBody += arrArchOes[i];
+        strBody.resize(ByteAlign((uint32_t)strBody.size(), 0x4000), '\0');
+        uOffset = 0x4000 + (uint32_t)strBody.size();
+    }
+    strFat.resize(0x4000, '\0');
+    return strFat + strBody;
+}
+
+static bool AddNameEntries(X509_NAME *pName, const char *arrEntries[][2], size_t sCount) {
+    for (size_t i = 0; i < sCount; i++) {
+        if (!X509_NAME_add_entry_by_txt(pName, arrEntries[i][0], MBSTRING_UTF8,
+                                        (const unsigned char *)arrEntries[i][1], -1, -1, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A self-signed certificate named as if issued by the Apple WWDR CA, since GenerateCMS looks up the
+// intermediate to embed by issuer name, plus a provisioning profile for it signed with the same key.
+static bool CreateSignAsset(const string &strFolder, ZSignAsset &asset) {
+    const char *arrSubject[][2] = {{"CN", "iPhone Distribution: zsign stress (" STRESS_TEAM_ID ")"},
+                                   {"OU", STRESS_TEAM_ID},
+                                   {"O", "zsign stress"},
+                                   {"C", "US"}};
+    const char *arrIssuer[][2] = {{"C", "US"},
+                                  {"O", "Apple Inc."},
+                                  {"OU", "Apple Worldwide Developer Relations"},
+                                  {"CN", "Apple Worldwide Developer Relations Certification Authority"}};
+
+    EVP_PKEY *evpPKey = EVP_RSA_gen(2048);
+    X509 *x509Cert = X509_new();
+    X509_NAME *pSubject = X509_NAME_new();
+    X509_NAME *pIssuer = X509_NAME_new();
+    bool bRet = (NULL != evpPKey && NULL != x509Cert && NULL != pSubject && NULL != pIssuer);
+    bRet = bRet && AddNameEntries(pSubject, arrSubject, 4) && AddNameEntries(pIssuer, arrIssuer, 4);
+    if (bRet) {
+        X509_set_version(x509Cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(x509Cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(x509Cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(x509Cert), 86400);
+        bRet = X509_set_subject_name(x509Cert, pSubject) && X509_set_issuer_name(x509Cert, pIssuer) &&
+               X509_set_pubkey(x509Cert, evpPKey) && X509_sign(x509Cert, evpPKey, EVP_sha256());
+    }
+
+    string strCertFile = strFolder + "/cert.pem";
+    string strPKeyFile = strFolder + "/key.pem";
+    string strProvisionFile = strFolder + "/stress.mobileprovision";
+    if (bRet) {
+        BIO *bioCert = BIO_new_file(strCertFile.c_str(), "w");
+        BIO *bioPKey = BIO_new_file(strPKeyFile.c_str(), "w");
+        bRet = (NULL != bioCert && NULL != bioPKey && PEM_write_bio_X509(bioCert, x509Cert) &&
+                PEM_write_bio_PrivateKey(bioPKey, evpPKey, NULL, NULL, 0, NULL, NULL));
+        BIO_free(bioCert);
+        BIO_free(bioPKey);
+    }
+
+    if (bRet) {
+        unsigned char *pCertDer = NULL;
+        int nCertDer = i2d_X509(x509Cert, &pCertDer);
+        string strProvision = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\"><dict>"
+                              "<key>TeamIdentifier</key><array><string>" STRESS_TEAM_ID "</string></array>"
+                              "<key>Entitlements</key><dict>"
+                              "<key>application-identifier</key><string>" STRESS_TEAM_ID ".com.zsign.stress</string>"
+                              "<key>get-task-allow</key><false/></dict>"
+                              "<key>DeveloperCertificates</key><array><data>";
+        ZBase64 b64;
+        strProvision += b64.Encode(string((const char *)pCertDer, (nCertDer > 0) ? nCertDer : 0));
+        strProvision += "</data></array></dict></plist>\n";
+        OPENSSL_free(pCertDer);
+
+        BIO *bioContent = BIO_new_mem_buf(strProvision.data(), (int)strProvision.size());
+        CMS_ContentInfo *cms = CMS_sign(x509Cert, evpPKey, NULL, bioContent, CMS_BINARY);
+        BIO *bioProvision = BIO_new_file(strProvisionFile.c_str(), "wb");
+        bRet = (nCertDer > 0 && NULL != cms && NULL != bioProvision && i2d_CMS_bio(bioProvision, cms));
+        BIO_free(bioProvision);
+        CMS_ContentInfo_free(cms);
+        BIO_free(bioContent);
+    }
+
+    X509_NAME_free(pSubject);
+    X509_NAME_free(pIssuer);
+    X509_free(x509Cert);
+    EVP_PKEY_free(evpPKey);
+    if (!bRet) {
+        ZLog::Error(">>> Can't Create Signing Identity!\n");
+        return false;
+    }
+    return asset.Init(strCertFile, strPKeyFile, strProvisionFile, "", "");
+}
+
+static uint32_t ReadUInt32(const string &strData, size_t pos) {
+    uint32_t uValue = 0;
+    if (pos + sizeof(uValue) <= strData.size()) {
+        memcpy(&uValue, strData.data() + pos, sizeof(uValue));
+    }
+    return uValue;
+}
+
+// appends the CodeDirectory blobs of the slice at uOffset, which hold everything signed but the CMS
+static bool GetSliceCodeDirectories(const string &strData, uint32_t uOffset, string &strOutput) {
+    uint32_t uCommands = ReadUInt32(strData, uOffset + 16);
+    size_t pos = uOffset + sizeof(mach_header_64);
+    for (uint32_t i = 0; i < uCommands; i++) {
+        uint32_t uCmd = ReadUInt32(strData, pos);
+        uint32_t uCmdSize = ReadUInt32(strData, pos + 4);
+        if (LC_CODE_SIGNATURE == uCmd) {
+            size_t sSuperBlob = uOffset + ReadUInt32(strData, pos + 8);
+            if (CSMAGIC_EMBEDDED_SIGNATURE != BE(ReadUInt32(strData, sSuperBlob))) {
+                return false;
+            }
+            uint32_t uCount = BE(ReadUInt32(strData, sSuperBlob + 8));
+            for (uint32_t j = 0; j < uCount; j++) {
+                size_t sBlob = sSuperBlob + BE(ReadUInt32(strData, sSuperBlob + 12 + j * 8 + 4));
+                if (CSMAGIC_CODEDIRECTORY == BE(ReadUInt32(strData, sBlob))) {
+                    strOutput += strData.substr(sBlob, BE(ReadUInt32(strData, sBlob + 4)));
+                }
+            }
+            return true;
+        }
+        if (uCmdSize < 8) {
+            return false;
+        }
+        pos += uCmdSize;
+    }
+    return false;
+}
+
+// signs the file and returns the CodeDirectories of every slice as one string, empty on failure
+static string SignFile(ZSignAsset *pSignAsset, const string &strFile) {
+    ZMachO macho;
+    bool bRet = macho.Init(strFile.c_str()) && macho.Sign(pSignAsset, true, "", "", "", "", "");
+    macho.Free();
+
+    string strData;
+    string strCodeDirectories;
+    if (bRet && ReadFile(strFile.c_str(), strData)) {
+        if (FAT_MAGIC == BE(ReadUInt32(strData, 0))) {
+            uint32_t uArches = BE(ReadUInt32(strData, 4));
+            for (uint32_t i = 0; bRet && i < uArches; i++) {
+                uint32_t uOffset = BE(ReadUInt32(strData, sizeof(fat_header) + i * sizeof(fat_arch) + 8));
+                bRet = GetSliceCodeDirectories(strData, uOffset, strCodeDirectories);
+            }
+        } else {
+            bRet = GetSliceCodeDirectories(strData, 0, strCodeDirectories);
+        }
+    }
+
+    if (!bRet || strCodeDirectories.empty()) {
+        ZLog::ErrorV(">>> Sign Failed! %s\n", strFile.c_str());
+        return "";
+    }
+    return strCodeDirectories;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t uFiles = (argc > 1) ? (uint32_t)atoi(argv[1]) : 64;
+    uint32_t uThreads = (argc > 2) ? (uint32_t)atoi(argv[2]) : 8;
+    uFiles = (uFiles < 1) ? 1 : uFiles;
+    uThreads = (uThreads < 1) ? 1 : uThreads;
+
+    char szFolder[] = "/tmp/zsign_stress.XXXXXX";
+    if (NULL == mkdtemp(szFolder)) {
+        ZLog::ErrorV(">>> Can't Create Folder! %s\n", strerror(errno));
+        return 1;
+    }
+    g_strWorkFolder = szFolder;
+    ZLog::SetThreadLogLevel(ZLog::E_ERROR);
+
+    ZSignAsset asset;
+    bool bRet = CreateSignAsset(g_strWorkFolder, asset);
+
+    // every third file is fat, every other slice comes without code signature space
+    vector<string> arrSerialFiles;
+    vector<string> arrParallelFiles;
+    for (uint32_t i = 0; bRet && i < uFiles; i++) {
+        uint32_t uTextSize = 0x4000 * (1 + i % 7);
+        string strData;
+        if (2 == i % 3) {
+            vector<string> arrArchOes;
+            arrArchOes.push_back(BuildArchO(CPU_SUBTYPE_ARM64_ALL, uTextSize, 0 == i % 2));
+            arrArchOes.push_back(BuildArchO(CPU_SUBTYPE_ARM64E, uTextSize + 0x4000, true));
+            strData = BuildFatMachO(arrArchOes, {CPU_SUBTYPE_ARM64_ALL, CPU_SUBTYPE_ARM64E});
+        } else {
+            strData = BuildArchO(CPU_SUBTYPE_ARM64_ALL, uTextSize, 0 == i % 2);
+        }
+        arrSerialFiles.push_back(g_strWorkFolder + "/serial_" + to_string(i));
+        arrParallelFiles.push_back(g_strWorkFolder + "/parallel_" + to_string(i));
+        bRet = WriteFile(arrSerialFiles[i].c_str(), strData) && WriteFile(arrParallelFiles[i].c_str(), strData);
+    }
+
+    vector<string> arrSerialCodeDirectories(arrSerialFiles.size());
+    for (size_t i = 0; bRet && i < arrSerialFiles.size(); i++) {
+        arrSerialCodeDirectories[i] = SignFile(&asset, arrSerialFiles[i]);
+        bRet = !arrSerialCodeDirectories[i].empty();
+    }
+
+    ZTimer timer;
+    vector<string> arrParallelCodeDirectories(arrParallelFiles.size());
+    if (bRet) {
+        atomic<size_t> uNext(0);
+        vector<thread> arrWorkers;
+        for (uint32_t i = 0; i < uThreads; i++) {
+            arrWorkers.push_back(thread([&] {
+                ZLog::SetThreadLogLevel(ZLog::E_ERROR);
+                for (size_t j = uNext++; j < arrParallelFiles.size(); j = uNext++) {
+                    arrParallelCodeDirectories[j] = SignFile(&asset, arrParallelFiles[j]);
+                }
+            }));
+        }
+        for (size_t i = 0; i < arrWorkers.size(); i++) {
+            arrWorkers[i].join();
+        }
+    }
+
+    for (size_t i = 0; bRet && i < arrParallelFiles.size(); i++) {
+        if (arrParallelCodeDirectories[i] != arrSerialCodeDirectories[i]) {
+            ZLog::ErrorV(">>> CodeDirectories Differ From The Serial Sign! %s\n", arrParallelFiles[i].c_str());
+            bRet = false;
+        }
+    }
+
+    ZLog::SetThreadLogLevel(-1);
+    timer.PrintResult(bRet, ">>> Signed %u Files On %u Threads %s!", uFiles, uThreads, bRet ? "OK" : "Failed");
+    RemoveFolder(szFolder);
+    return bRet ? 0 : 1;
+}
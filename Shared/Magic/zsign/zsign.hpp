@@ -27,9 +27,47 @@ bool ChangeDylibPath(NSString *filePath, NSString *oldPath, NSString *newPath);
 bool ListDylibs(NSString *filePath, NSMutableArray *dylibPathsArray);
 bool UninstallDylibs(NSString *filePath, NSArray<NSString *> *dylibPathsArray);
 
+// edits are dictionaries of "type" (inject, inject_weak, remove, rename, add_rpath, remove_rpath),
+// "path" and, for rename, "new_path". They are applied to every slice in one pass.
+bool ApplyLoadCommandEdits(NSString *filePath, NSArray<NSDictionary<NSString *, NSString *> *> *edits);
+
+// scans every Mach-O of the bundle in parallel. report maps each file (relative to the .app) to the
+// references matching match, which covers the whole path or a leading path component.
+bool ScanBundleDylibs(NSString *app, NSString *match, NSMutableDictionary<NSString *, NSArray<NSString *> *> *report);
+
+// same as ScanBundleDylibs, then replaces the matched prefix with replace in every file that references it
+bool RewriteBundleDylibs(NSString *app, NSString *match, NSString *replace,
+                         NSMutableDictionary<NSString *, NSArray<NSString *> *> *report);
+
+// verifies every Mach-O of the bundle in parallel against its pages, Info.plist, CodeResources, requirements,
+// entitlements and CMS CDHashes, and rehashes every files2 digest of every CodeResources. report is filled with
+// "valid", "files" (per file and architecture: "cdhashes", "signed", "errors") and "resources" (per bundle:
+// "checked" and "errors" of "file" and "error", which is missing, modified or unreadable).
+bool VerifyBundle(NSString *app, NSMutableDictionary<NSString *, id> *report);
+
 int zsign(NSString *app, NSString *prov, NSString *key, NSString *pass, NSString *bundleid, NSString *displayname,
           NSString *bundleversion, bool dontGenerateEmbeddedMobileProvision);
 
+// signs like zsign, with extra options:
+//   "edits": load command edits (see ApplyLoadCommandEdits), applied to the main executable while it is mapped for signing
+//   "archs": architectures to keep (e.g. arm64, arm64e), every Mach-O in the bundle is thinned to them before signing
+//   "strip": payloads to remove from every Mach-O before signing, "bitcode" (__LLVM segment) and/or "symbols"
+//            (non-external symbols)
+//   "strip_report": NSMutableDictionary filled with the bytes saved per file (relative to the .app)
+//   "reuse_signed": NSNumber bool, nested code whose signature is still valid for this identity (same team and
+//                   signer, CMS present, code limit and CodeResources unchanged) is left as it is, ignored with "strip"
+//   "reuse_report": NSMutableArray filled with the nested Mach-O files left as they were (relative to the .app)
+//   "stream_threshold": NSNumber, files of at least this many bytes are hashed in streamed windows that are
+//                       dropped from the page cache (0 disables it, 64M by default). Process-wide, it stays set
+//   "stream_window": NSNumber, bytes per streamed window, 4M by default, used with "stream_threshold"
+int zsignWithOptions(NSString *app, NSString *prov, NSString *key, NSString *pass, NSString *bundleid,
+                     NSString *displayname, NSString *bundleversion, bool dontGenerateEmbeddedMobileProvision,
+                     NSDictionary<NSString *, id> *options);
+
+int zsignMulti(NSString *app, NSArray<NSString *> *provs, NSArray<NSString *> *keys, NSArray<NSString *> *passes,
+               NSArray<NSString *> *outputs, NSString *bundleid, NSString *displayname, NSString *bundleversion,
+               bool dontGenerateEmbeddedMobileProvision);
+
 #ifdef __cplusplus
 }
 #endif
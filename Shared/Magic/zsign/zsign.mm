@@ -13,6 +13,7 @@
 #include "zsign.hpp"
 #include "bundle.h"
 #include "common/common.h"
+#include "common/fileio.h"
 #include "common/json.h"
 #include "macho.h"
 #include "openssl.h"
@@ -26,6 +27,49 @@ NSString *getTmpDir() {
     return [[[paths objectAtIndex:0] stringByDeletingLastPathComponent] stringByAppendingPathComponent:@"tmp"];
 }
 
+static bool ParseLoadCommandEdits(NSArray<NSDictionary<NSString *, NSString *> *> *edits,
+                                  vector<ZLoadCommandEdit> &arrEdits) {
+    NSDictionary<NSString *, NSNumber *> *types = @{
+        @"inject" : @(ZLoadCommandEdit::E_INJECT_DYLIB),
+        @"inject_weak" : @(ZLoadCommandEdit::E_INJECT_WEAK_DYLIB),
+        @"remove" : @(ZLoadCommandEdit::E_REMOVE_DYLIB),
+        @"rename" : @(ZLoadCommandEdit::E_RENAME_DYLIB),
+        @"add_rpath" : @(ZLoadCommandEdit::E_ADD_RPATH),
+        @"remove_rpath" : @(ZLoadCommandEdit::E_REMOVE_RPATH),
+    };
+
+    for (NSDictionary<NSString *, NSString *> *dict in edits) {
+        NSNumber *type = types[dict[@"type"] ?: @""];
+        NSString *path = dict[@"path"];
+        NSString *newPath = dict[@"new_path"];
+        if (nil == type || path.length == 0 ||
+            (ZLoadCommandEdit::E_RENAME_DYLIB == type.intValue && newPath.length == 0)) {
+            ZLog::ErrorV(">>> Invalid Load Command Edit! %s\n", [[dict description] UTF8String]);
+            return false;
+        }
+
+        ZLoadCommandEdit edit;
+        edit.nType = type.intValue;
+        edit.strPath = [path UTF8String];
+        if (nil != newPath) {
+            edit.strNewPath = [newPath UTF8String];
+        }
+        arrEdits.push_back(edit);
+    }
+    return true;
+}
+
+static void FillDylibScanReport(const vector<ZDylibScanResult> &arrResults,
+                                NSMutableDictionary<NSString *, NSArray<NSString *> *> *report) {
+    for (size_t i = 0; i < arrResults.size(); i++) {
+        NSMutableArray<NSString *> *dylibs = [NSMutableArray array];
+        for (size_t j = 0; j < arrResults[i].arrDylibs.size(); j++) {
+            [dylibs addObject:[NSString stringWithUTF8String:arrResults[i].arrDylibs[j].c_str()]];
+        }
+        report[[NSString stringWithUTF8String:arrResults[i].strFile.c_str()]] = dylibs;
+    }
+}
+
 extern "C" {
 
 bool InjectDyLib(NSString *filePath, NSString *dylibPath, bool weakInject, bool bCreate) {
@@ -63,7 +107,7 @@ bool ListDylibs(NSString *filePath, NSMutableArray *dylibPathsArray) {
         std::string filePathStr = [filePath UTF8String];
 
         ZMachO machO;
-        bool initSuccess = machO.Init(filePathStr.c_str());
+        bool initSuccess = machO.InitReadOnly(filePathStr.c_str());
         if (!initSuccess) {
             gtimer.Print(">>> Failed to initialize ZMachO.");
             return false;
@@ -142,10 +186,113 @@ bool ChangeDylibPath(NSString *filePath, NSString *oldPath, NSString *newPath) {
     }
 }
 
+bool ApplyLoadCommandEdits(NSString *filePath, NSArray<NSDictionary<NSString *, NSString *> *> *edits) {
+    ZTimer gtimer;
+    @autoreleasepool {
+        vector<ZLoadCommandEdit> arrEdits;
+        if (!ParseLoadCommandEdits(edits, arrEdits)) {
+            return false;
+        }
+
+        ZMachO machO;
+        if (!machO.Init([filePath UTF8String])) {
+            gtimer.Print(">>> Failed to initialize ZMachO.");
+            return false;
+        }
+
+        bool bChanged = false;
+        bool success = machO.ApplyEdits(arrEdits, bChanged);
+        machO.Free();
+
+        gtimer.Print(success ? ">>> Load command edits applied!" : ">>> Failed to apply load command edits.");
+        return success;
+    }
+}
+
+bool ScanBundleDylibs(NSString *app, NSString *match, NSMutableDictionary<NSString *, NSArray<NSString *> *> *report) {
+    ZTimer gtimer;
+    @autoreleasepool {
+        ZAppBundle bundle;
+        vector<ZDylibScanResult> arrResults;
+        bool bRet = bundle.ScanDylibs([app UTF8String], (nil != match) ? [match UTF8String] : "", arrResults);
+        FillDylibScanReport(arrResults, report);
+        gtimer.PrintResult(bRet, ">>> Scanned %lu Mach-O Files!", arrResults.size());
+        return bRet;
+    }
+}
+
+bool RewriteBundleDylibs(NSString *app, NSString *match, NSString *replace,
+                         NSMutableDictionary<NSString *, NSArray<NSString *> *> *report) {
+    ZTimer gtimer;
+    @autoreleasepool {
+        ZAppBundle bundle;
+        vector<ZDylibScanResult> arrResults;
+        bool bRet = bundle.RewriteDylibs([app UTF8String], [match UTF8String], [replace UTF8String], arrResults);
+        FillDylibScanReport(arrResults, report);
+        gtimer.PrintResult(bRet, ">>> Rewrote Dylib References In %lu Mach-O Files!", arrResults.size());
+        return bRet;
+    }
+}
+
+bool VerifyBundle(NSString *app, NSMutableDictionary<NSString *, id> *report) {
+    ZTimer gtimer;
+    @autoreleasepool {
+        ZAppBundle bundle;
+        JValue jvReport;
+        bool bRet = bundle.VerifyFolder([app UTF8String], jvReport);
+
+        string strReport = jvReport.write();
+        NSData *data = [NSData dataWithBytes:strReport.data() length:strReport.size()];
+        NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+        if (nil != dict) {
+            [report addEntriesFromDictionary:dict];
+        }
+        gtimer.PrintResult(bRet, ">>> Verified %s!", bRet ? "OK" : "Failed");
+        return bRet;
+    }
+}
+
 int zsign(NSString *app, NSString *prov, NSString *key, NSString *pass, NSString *bundleid, NSString *displayname,
           NSString *bundleversion, bool dontGenerateEmbeddedMobileProvision) {
+    return zsignWithOptions(app, prov, key, pass, bundleid, displayname, bundleversion,
+                            dontGenerateEmbeddedMobileProvision, nil);
+}
+
+int zsignWithOptions(NSString *app, NSString *prov, NSString *key, NSString *pass, NSString *bundleid,
+                     NSString *displayname, NSString *bundleversion, bool dontGenerateEmbeddedMobileProvision,
+                     NSDictionary<NSString *, id> *options) {
     ZTimer gtimer;
 
+    vector<ZLoadCommandEdit> arrEdits;
+    if (!ParseLoadCommandEdits(options[@"edits"], arrEdits)) {
+        return -1;
+    }
+
+    set<string> setThinArchs;
+    for (NSString *arch in options[@"archs"]) {
+        setThinArchs.insert([arch UTF8String]);
+    }
+
+    uint32_t uStripFlags = 0;
+    for (NSString *strip in options[@"strip"]) {
+        if ([strip isEqualToString:@"bitcode"]) {
+            uStripFlags |= E_STRIP_BITCODE;
+        } else if ([strip isEqualToString:@"symbols"]) {
+            uStripFlags |= E_STRIP_LOCAL_SYMBOLS;
+        } else {
+            ZLog::ErrorV(">>> Invalid Strip Option! %s\n", [strip UTF8String]);
+            return -1;
+        }
+    }
+    NSMutableDictionary<NSString *, NSNumber *> *stripReport = options[@"strip_report"];
+    bool bReuseSigned = [options[@"reuse_signed"] boolValue];
+    NSMutableArray<NSString *> *reuseReport = options[@"reuse_report"];
+
+    NSNumber *streamThreshold = options[@"stream_threshold"];
+    if (nil != streamThreshold) {
+        SetSHASumStreamOptions([streamThreshold unsignedLongLongValue], [options[@"stream_window"] unsignedIntValue]);
+    }
+
     bool bForce = false;
     bool bWeakInject = false;
     bool bDontGenerateEmbeddedMobileProvision = dontGenerateEmbeddedMobileProvision;
@@ -181,16 +328,45 @@ int zsign(NSString *app, NSString *prov, NSString *key, NSString *pass, NSString
         bZipFile = IsZipFile(strPath.c_str());
         if (!bZipFile) { // macho file
             ZMachO macho;
-            if (macho.Init(strPath.c_str())) {
-                if (!strDyLibFile.empty()) { // inject dylib
-                    bool bCreate = false;
-                    macho.InjectDyLib(bWeakInject, strDyLibFile.c_str(), bCreate);
-                } else {
+            if (arrEdits.empty() && setThinArchs.empty() && 0 == uStripFlags) {
+                if (macho.InitReadOnly(strPath.c_str())) {
                     macho.PrintInfo();
+                    macho.Free();
                 }
+                return 0;
+            }
+
+            // edit, thin, strip, then sign again, the old signature doesn't cover the changed file
+            ZSignAsset zSignAsset;
+            if (!zSignAsset.Init(strCertFile, strPKeyFile, strProvFile, strEntitlementsFile, strPassword)) {
+                return -1;
+            }
+            if (!macho.Init(strPath.c_str())) {
+                return -1;
+            }
+
+            bool bChanged = false;
+            bool bRet = arrEdits.empty() || macho.ApplyEdits(arrEdits, bChanged);
+            if (bRet && !setThinArchs.empty()) {
+                bRet = macho.Thin(setThinArchs, bChanged);
+            }
+            if (bRet && 0 != uStripFlags) {
+                uint64_t uSavedBytes = 0;
+                bRet = macho.Strip(uStripFlags, uSavedBytes);
+                if (bRet) {
+                    stripReport[app.lastPathComponent] = @(uSavedBytes);
+                }
+            }
+            macho.Free();
+
+            // signed from a fresh mapping, thinning and stripping may have repacked the file
+            bRet = bRet && macho.Init(strPath.c_str());
+            if (bRet) {
+                bRet = macho.Sign(&zSignAsset, true, "", "", "", "", "");
                 macho.Free();
             }
-            return 0;
+            gtimer.PrintResult(bRet, ">>> Signed %s!", bRet ? "OK" : "Failed");
+            return bRet ? 0 : -1;
         }
     }
 
@@ -207,10 +383,63 @@ int zsign(NSString *app, NSString *prov, NSString *key, NSString *pass, NSString
     timer.Reset();
     ZAppBundle bundle;
     bool bRet = bundle.SignFolder(&zSignAsset, strFolder, strBundleId, strBundleVersion, strDisplayName, strDyLibFile,
-                                  bForce, bWeakInject, bEnableCache, bDontGenerateEmbeddedMobileProvision);
+                                  bForce, bWeakInject, bEnableCache, bDontGenerateEmbeddedMobileProvision, arrEdits,
+                                  setThinArchs, uStripFlags, bReuseSigned);
+    for (size_t i = 0; i < bundle.m_arrStripResults.size(); i++) {
+        const ZStripResult &result = bundle.m_arrStripResults[i];
+        stripReport[[NSString stringWithUTF8String:result.strFile.c_str()]] = @(result.uSavedBytes);
+    }
+    for (set<string>::iterator it = bundle.m_setReusedFiles.begin(); it != bundle.m_setReusedFiles.end(); it++) {
+        [reuseReport addObject:[NSString stringWithUTF8String:it->c_str()]];
+    }
     timer.PrintResult(bRet, ">>> Signed %s!", bRet ? "OK" : "Failed");
 
     gtimer.Print(">>> Done.");
     return bRet ? 0 : -1;
 }
+
+int zsignMulti(NSString *app, NSArray<NSString *> *provs, NSArray<NSString *> *keys, NSArray<NSString *> *passes,
+               NSArray<NSString *> *outputs, NSString *bundleid, NSString *displayname, NSString *bundleversion,
+               bool dontGenerateEmbeddedMobileProvision) {
+    ZTimer gtimer;
+
+    if (provs.count == 0 || provs.count != keys.count || provs.count != outputs.count ||
+        (passes.count != 0 && passes.count != provs.count)) {
+        ZLog::Error(">>> Invalid Sign Assets Count!\n");
+        return -1;
+    }
+
+    string strPath = [app cStringUsingEncoding:NSUTF8StringEncoding];
+    if (!IsFolder(strPath.c_str())) {
+        ZLog::ErrorV(">>> Invalid Path! %s\n", strPath.c_str());
+        return -1;
+    }
+
+    string strBundleId = [bundleid cStringUsingEncoding:NSUTF8StringEncoding];
+    string strDisplayName = [displayname cStringUsingEncoding:NSUTF8StringEncoding];
+    string strBundleVersion = [bundleversion cStringUsingEncoding:NSUTF8StringEncoding];
+
+    vector<ZSignAsset> arrSignAssets(provs.count);
+    vector<ZSignAsset *> arrSignAssetPtrs;
+    vector<string> arrOutputFolders;
+    for (NSUInteger i = 0; i < provs.count; i++) {
+        string strPKeyFile = [keys[i] cStringUsingEncoding:NSUTF8StringEncoding];
+        string strProvFile = [provs[i] cStringUsingEncoding:NSUTF8StringEncoding];
+        string strPassword = (passes.count > 0) ? [passes[i] cStringUsingEncoding:NSUTF8StringEncoding] : "";
+        if (!arrSignAssets[i].Init("", strPKeyFile, strProvFile, "", strPassword)) {
+            return -1;
+        }
+        arrSignAssetPtrs.push_back(&arrSignAssets[i]);
+        arrOutputFolders.push_back([outputs[i] cStringUsingEncoding:NSUTF8StringEncoding]);
+    }
+
+    ZTimer timer;
+    ZAppBundle bundle;
+    bool bRet = bundle.SignFolderMulti(arrSignAssetPtrs, strPath, arrOutputFolders, strBundleId, strBundleVersion,
+                                       strDisplayName, "", false, dontGenerateEmbeddedMobileProvision);
+    timer.PrintResult(bRet, ">>> Signed %lu Identities %s!", arrSignAssetPtrs.size(), bRet ? "OK" : "Failed");
+
+    gtimer.Print(">>> Done.");
+    return bRet ? 0 : -1;
+}
 }